@@ -104,26 +104,30 @@ uint16_t tcpip_continue_chksum ( uint16_t partial, const void *data,
 		  "\n2:\n\t"
 		  "loop 1b\n\t"
 
-		  /* Main "lods;adc" loop, unrolled x16 */
+		  /* Main "adc;lea" loop, unrolled x16.  Adding directly from
+		   * memory avoids the microcoded "lods" instruction, and
+		   * "lea" advances the pointer without affecting the
+		   * carry flag.
+		   */
 		  "mov %12, %3\n\t"
 		  "jmp *%4\n\t"
 		  "\nx86_tcpip_loop_start:\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
-		  "lods%z2\n\tadc %2, %0\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
+		  "adc (%1), %0\n\tlea %c15(%1), %1\n\t"
 		  "\nx86_tcpip_loop_end:\n\t"
 		  "loop x86_tcpip_loop_start\n\t"
 		  ".equ x86_tcpip_loop_step_size, "
@@ -167,7 +171,8 @@ uint16_t tcpip_continue_chksum ( uint16_t partial, const void *data,
 		  : "0" ( sum ), "1" ( data ), "2" ( 0 ),
 		    "3" ( initial_word_count + 1 ), "4" ( loop_partial_count ),
 		    "5" ( x86_tcpip_loop_end ), "g" ( loop_count + 1 ),
-		    "g" ( final_word_count + 1 ), "g" ( final_byte ) );
+		    "g" ( final_word_count + 1 ), "g" ( final_byte ),
+		    "i" ( sizeof ( sum ) ) );
 
 	return ( ~sum & 0xffff );
 }
@@ -364,7 +364,10 @@ static size_t bzimage_load_initrd ( struct image *image,
 
 	/* Copy in initrd image body (and cpio header if applicable) */
 	if ( address ) {
-		memmove_user ( address, offset, initrd->data, 0, initrd->len );
+		if ( userptr_add ( address, offset ) != initrd->data ) {
+			memmove_user ( address, offset, initrd->data, 0,
+				       initrd->len );
+		}
 		if ( offset ) {
 			memset_user ( address, 0, 0, offset );
 			copy_to_user ( address, 0, &cpio, sizeof ( cpio ) );
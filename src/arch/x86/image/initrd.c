@@ -71,10 +71,25 @@ static userptr_t initrd_squash_high ( userptr_t top ) {
 		if ( ! highest )
 			break;
 
-		/* Move this image to its final position */
+		/* Calculate final position of this image */
 		len = ( ( highest->len + INITRD_ALIGN - 1 ) &
 			~( INITRD_ALIGN - 1 ) );
 		current = userptr_sub ( current, len );
+
+		/* Leave image untouched if it was downloaded directly
+		 * to its final position (which is the common case,
+		 * since external memory is allocated downwards from
+		 * the top of the initrd region).
+		 */
+		if ( highest->data == current ) {
+			DBGC ( &images, "INITRD %s already at [%#08lx,%#08lx)"
+			       "\n", highest->name,
+			       user_to_phys ( current, 0 ),
+			       user_to_phys ( current, highest->len ) );
+			continue;
+		}
+
+		/* Move this image to its final position */
 		DBGC ( &images, "INITRD squashing %s [%#08lx,%#08lx)->"
 		       "[%#08lx,%#08lx)\n", highest->name,
 		       user_to_phys ( highest->data, 0 ),
@@ -39,6 +39,23 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #define DHCP_DISC_PROXY_TIMEOUT_SEC	2
 //#define DHCP_DISC_PROXY_TIMEOUT_SEC	11	/* as per PXE spec */
 
+/*
+ * On networks known to have no ProxyDHCP server, the wait above is
+ * pure overhead.  Setting this to 0 proceeds as soon as a valid
+ * DHCPOFFER arrives.  Independently of this setting, iPXE remembers
+ * (per network device) any DHCP server for which the wait expired
+ * without a ProxyDHCPOFFER and does not wait again for offers from
+ * that server on that network device.
+ */
+#define DHCP_DISC_PROXY_EXPECTED	1
+
+/*
+ * Request a two-message DHCPDISCOVER/DHCPACK exchange as per RFC
+ * 4039.  Servers not supporting Rapid Commit will ignore the request
+ * and continue with the usual four-message exchange.
+ */
+#define DHCP_DISC_RAPID_COMMIT		1
+
 /*
  * Per the PXE spec, requests are also tried 4 times, but at timeout
  * intervals of 1, 2, 3, 4 seconds.  To adapt this to an exponential
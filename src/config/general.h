@@ -162,6 +162,12 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #define IMAGE_ARCHIVE_CMD	/* Archive image management commands */
 #define SHIM_CMD		/* EFI shim command (or dummy command) */
 
+/*
+ * Automatic boot options
+ *
+ */
+#undef	AUTOBOOT_PARALLEL	/* Configure all network devices concurrently */
+
 /*
  * ROM-specific options
  *
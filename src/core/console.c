@@ -1,7 +1,6 @@
 #include "stddef.h"
 #include <ipxe/console.h>
 #include <ipxe/process.h>
-#include <ipxe/nap.h>
 
 /** @file */
 
@@ -99,9 +98,10 @@ int getchar ( void ) {
 		 * serial port, which is read by polling.  This reduces the
 		 * power dissipation of a modern CPU considerably, and also
 		 * makes Etherboot waiting for user interaction waste a lot
-		 * less CPU time in a VMware session.
+		 * less CPU time in a VMware session.  Skip the doze while
+		 * background work is pending.
 		 */
-		cpu_nap();
+		step_nap();
 
 		/* Keep processing background tasks while we wait for
 		 * input.
@@ -88,8 +88,12 @@ static void downloader_finished ( struct downloader *downloader, int rc ) {
 			 downloader->image->name, strerror ( rc ) );
 	}
 
-	/* Update image length */
+	/* Release any excess allocated space and update image length */
+	xferbuf_shrink ( &downloader->buffer );
 	downloader->image->len = downloader->buffer.len;
+	DBGC ( downloader, "DOWNLOADER %p downloaded %zd bytes (%lu bytes "
+	       "copied by reallocations in total)\n", downloader,
+	       downloader->image->len, xferbuf_realloc_copied );
 
 	/* Shut down interfaces */
 	intf_shutdown ( &downloader->xfer, rc );
@@ -113,6 +113,8 @@ struct io_buffer * alloc_iob_raw ( size_t len, size_t align, size_t offset ) {
 	memset ( &iobuf->map, 0, sizeof ( iobuf->map ) );
 	iobuf->head = iobuf->data = iobuf->tail = data;
 	iobuf->end = ( data + len );
+	iobuf->flags = 0;
+	iobuf->pool = NULL;
 
 	return iobuf;
 }
@@ -138,6 +140,31 @@ struct io_buffer * alloc_iob ( size_t len ) {
 	return alloc_iob_raw ( len, len, 0 );
 }
 
+/**
+ * Return I/O buffer to its pool
+ *
+ * @v iobuf	I/O buffer
+ */
+static void iob_recycle ( struct io_buffer *iobuf ) {
+	struct iob_pool *pool = iobuf->pool;
+	struct refcnt *refcnt = pool->refcnt;
+	size_t len = ( iobuf->end - iobuf->head );
+
+	/* Retain buffer if the pool has space and the buffer is still
+	 * large enough, otherwise return it to the heap.
+	 */
+	if ( ( pool->count < pool->max ) && ( len >= pool->len ) ) {
+		list_add ( &iobuf->list, &pool->free );
+		pool->count++;
+	} else {
+		iobuf->pool = NULL;
+		free_iob ( iobuf );
+	}
+
+	/* Drop reference held by outstanding buffer */
+	ref_put ( refcnt );
+}
+
 /**
  * Free I/O buffer
  *
@@ -156,6 +183,12 @@ void free_iob ( struct io_buffer *iobuf ) {
 	assert ( iobuf->tail <= iobuf->end );
 	assert ( ! dma_mapped ( &iobuf->map ) );
 
+	/* Return to pool, if applicable */
+	if ( iobuf->pool ) {
+		iob_recycle ( iobuf );
+		return;
+	}
+
 	/* Free buffer */
 	len = ( iobuf->end - iobuf->head );
 	if ( iobuf->end == iobuf ) {
@@ -214,6 +247,98 @@ void free_rx_iob ( struct io_buffer *iobuf ) {
 	free_iob ( iobuf );
 }
 
+/**
+ * Allocate I/O buffer from pool
+ *
+ * @v pool		I/O buffer pool
+ * @v len		Length of I/O buffer
+ * @ret iobuf		I/O buffer, or NULL if none available
+ *
+ * The I/O buffer will be returned to the pool when freed via
+ * free_iob().
+ */
+struct io_buffer * iob_pool_alloc ( struct iob_pool *pool, size_t len ) {
+	struct io_buffer *iobuf;
+
+	/* Discard any free buffers of the wrong size */
+	if ( len != pool->len ) {
+		iob_pool_flush ( pool );
+		pool->len = len;
+	}
+
+	/* Reuse a free buffer, if available */
+	iobuf = list_first_entry ( &pool->free, struct io_buffer, list );
+	if ( iobuf ) {
+		list_del ( &iobuf->list );
+		pool->count--;
+		pool->hits++;
+		assert ( iobuf->pool == pool );
+		assert ( ! dma_mapped ( &iobuf->map ) );
+		iobuf->data = iobuf->tail = iobuf->head;
+		iobuf->flags = 0;
+	} else {
+		iobuf = alloc_iob ( len );
+		if ( ! iobuf )
+			return NULL;
+		pool->misses++;
+		iobuf->pool = pool;
+	}
+
+	/* Hold reference to containing object while buffer is outstanding */
+	ref_get ( pool->refcnt );
+
+	return iobuf;
+}
+
+/**
+ * Allocate and map I/O buffer for receive DMA from pool
+ *
+ * @v pool		I/O buffer pool
+ * @v len		Length of I/O buffer
+ * @v dma		DMA device
+ * @ret iobuf		I/O buffer, or NULL on error
+ */
+struct io_buffer * alloc_rx_iob_pool ( struct iob_pool *pool, size_t len,
+				       struct dma_device *dma ) {
+	struct io_buffer *iobuf;
+	int rc;
+
+	/* Allocate I/O buffer */
+	iobuf = iob_pool_alloc ( pool, len );
+	if ( ! iobuf )
+		goto err_alloc;
+
+	/* Map I/O buffer */
+	if ( ( rc = iob_map_rx ( iobuf, dma ) ) != 0 )
+		goto err_map;
+
+	return iobuf;
+
+	iob_unmap ( iobuf );
+ err_map:
+	free_iob ( iobuf );
+ err_alloc:
+	return NULL;
+}
+
+/**
+ * Release all free I/O buffers held by pool
+ *
+ * @v pool		I/O buffer pool
+ */
+void iob_pool_flush ( struct iob_pool *pool ) {
+	struct io_buffer *iobuf;
+	struct io_buffer *tmp;
+
+	/* Return all free buffers to the heap */
+	list_for_each_entry_safe ( iobuf, tmp, &pool->free, list ) {
+		list_del ( &iobuf->list );
+		iobuf->pool = NULL;
+		free_iob ( iobuf );
+	}
+	pool->count = 0;
+}
+
 /**
  * Ensure I/O buffer has sufficient headroom
  *
@@ -87,8 +87,56 @@ struct autosized_block {
  */
 #define NOWHERE ( ( void * ) ~( ( intptr_t ) 0 ) )
 
-/** List of free memory blocks */
-static LIST_HEAD ( free_blocks );
+/**
+ * Heap size
+ *
+ * Currently fixed at 512kB.
+ */
+#define HEAP_SIZE ( 512 * 1024 )
+
+/** The heap itself */
+static char heap[HEAP_SIZE] __attribute__ (( aligned ( __alignof__(void *) )));
+
+/** Start of usable heap (aligned to MIN_MEMBLOCK_SIZE) */
+static void *heap_start;
+
+/** End of usable heap */
+static void *heap_end;
+
+/**
+ * Number of free block size classes per power of two (log2)
+ *
+ * Free blocks are held in segregated lists, one per size class.  Each
+ * power-of-two range of block sizes is split into four size classes,
+ * so that a block taken from a list is never more than 25% larger
+ * than the smallest block in that list.
+ */
+#define HEAP_SUBCLASSES_LOG2 2
+
+/** Number of free block size classes */
+#define HEAP_CLASSES 64
+
+/** Lists of free memory blocks, indexed by size class */
+static struct list_head free_blocks[HEAP_CLASSES];
+
+/** Bitmask of non-empty size classes */
+static uint64_t free_classes;
+
+/** Maximum number of MIN_MEMBLOCK_SIZE granules within the heap */
+#define HEAP_GRANULES ( HEAP_SIZE / sizeof ( struct memory_block ) )
+
+/** Number of bits in an unsigned long */
+#define HEAP_MAP_BITS ( 8 * sizeof ( unsigned long ) )
+
+/** A heap granule bitmap */
+typedef unsigned long heap_map_t[ ( HEAP_GRANULES + HEAP_MAP_BITS - 1 ) /
+				  HEAP_MAP_BITS ];
+
+/** Bitmap of granules at which a free block starts */
+static heap_map_t free_starts;
+
+/** Bitmap of granules at which a free block ends */
+static heap_map_t free_ends;
 
 /** Total amount of free memory */
 size_t freemem;
@@ -100,137 +148,302 @@ size_t usedmem;
 size_t maxusedmem;
 
 /**
- * Heap size
+ * Get size class of free block
  *
- * Currently fixed at 512kB.
+ * @v size		Block size (a non-zero multiple of MIN_MEMBLOCK_SIZE)
+ * @ret class		Size class
+ *
+ * The size class may exceed the number of size classes (if the size
+ * exceeds the size of the heap).
  */
-#define HEAP_SIZE ( 512 * 1024 )
+static inline unsigned int heap_class ( size_t size ) {
+	size_t granules = ( size / MIN_MEMBLOCK_SIZE );
+	unsigned int log2 = ( flsl ( granules ) - 1 );
+	unsigned int shift;
+
+	/* Small blocks each have a dedicated class */
+	if ( log2 < HEAP_SUBCLASSES_LOG2 )
+		return granules;
+
+	/* Larger blocks use the leading bits of the granule count */
+	shift = ( log2 - HEAP_SUBCLASSES_LOG2 );
+	return ( ( ( shift + 1 ) << HEAP_SUBCLASSES_LOG2 ) +
+		 ( ( granules >> shift ) &
+		   ( ( 1 << HEAP_SUBCLASSES_LOG2 ) - 1 ) ) );
+}
 
-/** The heap itself */
-static char heap[HEAP_SIZE] __attribute__ (( aligned ( __alignof__(void *) )));
+/**
+ * Get lowest size class in which all free blocks are large enough
+ *
+ * @v size		Required size (a non-zero multiple of MIN_MEMBLOCK_SIZE)
+ * @ret class		Size class
+ */
+static inline unsigned int heap_fit_class ( size_t size ) {
+	size_t granules = ( size / MIN_MEMBLOCK_SIZE );
+	unsigned int log2 = ( flsl ( granules ) - 1 );
+	size_t round;
+
+	/* Round up to the smallest size within a size class */
+	if ( log2 >= HEAP_SUBCLASSES_LOG2 ) {
+		round = ( ( 1UL << ( log2 - HEAP_SUBCLASSES_LOG2 ) ) - 1 );
+		granules = ( ( granules + round ) & ~round );
+	}
+	return heap_class ( granules * MIN_MEMBLOCK_SIZE );
+}
 
 /**
- * Mark all blocks in free list as defined
+ * Get granule index within heap
  *
+ * @v ptr		Granule address
+ * @ret index		Granule index, or negative if outside the heap
  */
-static inline void valgrind_make_blocks_defined ( void ) {
-	struct memory_block *block;
+static inline long heap_granule ( void *ptr ) {
 
-	/* Do nothing unless running under Valgrind */
-	if ( RUNNING_ON_VALGRIND <= 0 )
-		return;
+	if ( ( ptr < heap_start ) || ( ptr >= heap_end ) )
+		return -1;
+	return ( ( ptr - heap_start ) / MIN_MEMBLOCK_SIZE );
+}
 
-	/* Traverse free block list, marking each block structure as
-	 * defined.  Some contortions are necessary to avoid errors
-	 * from list_check().
-	 */
+/**
+ * Test granule bit
+ *
+ * @v map		Granule bitmap
+ * @v ptr		Granule address (may lie outside the heap)
+ * @ret is_set		Bit is set
+ */
+static inline int heap_test ( heap_map_t map, void *ptr ) {
+	long index = heap_granule ( ptr );
+
+	if ( index < 0 )
+		return 0;
+	return ( ( map[ index / HEAP_MAP_BITS ] >>
+		   ( index % HEAP_MAP_BITS ) ) & 1 );
+}
 
-	/* Mark block list itself as defined */
-	VALGRIND_MAKE_MEM_DEFINED ( &free_blocks, sizeof ( free_blocks ) );
+/**
+ * Set or clear granule bit
+ *
+ * @v map		Granule bitmap
+ * @v ptr		Granule address
+ * @v set		Bit should be set
+ */
+static inline void heap_mark ( heap_map_t map, void *ptr, int set ) {
+	long index = heap_granule ( ptr );
+	unsigned long mask;
+
+	assert ( index >= 0 );
+	mask = ( 1UL << ( index % HEAP_MAP_BITS ) );
+	if ( set ) {
+		map[ index / HEAP_MAP_BITS ] |= mask;
+	} else {
+		map[ index / HEAP_MAP_BITS ] &= ~mask;
+	}
+}
 
-	/* Mark areas accessed by list_check() as defined */
-	VALGRIND_MAKE_MEM_DEFINED ( &free_blocks.prev->next,
-				    sizeof ( free_blocks.prev->next ) );
-	VALGRIND_MAKE_MEM_DEFINED ( free_blocks.next,
-				    sizeof ( *free_blocks.next ) );
-	VALGRIND_MAKE_MEM_DEFINED ( &free_blocks.next->next->prev,
-				    sizeof ( free_blocks.next->next->prev ) );
+/**
+ * Get location of free block size footer
+ *
+ * @v block		Free block
+ * @v size		Size of free block
+ * @ret footer		Size footer
+ *
+ * Every free block larger than a single granule records its size in
+ * its final word, so that a block being freed can locate the start of
+ * an immediately preceding free block.  (A single-granule free block
+ * is identifiable from the free_starts bitmap.)
+ */
+static inline size_t * heap_footer ( struct memory_block *block,
+				     size_t size ) {
+	return ( ( ( void * ) block ) + size - sizeof ( size_t ) );
+}
 
-	/* Mark each block in list as defined */
-	list_for_each_entry ( block, &free_blocks, list ) {
+/**
+ * Add block to free lists
+ *
+ * @v block		Free block
+ * @v size		Size of free block
+ */
+static void heap_insert ( struct memory_block *block, size_t size ) {
+	unsigned int class = heap_class ( size );
+	uint64_t bit = ( 1ULL << class );
+	size_t *footer = heap_footer ( block, size );
 
-		/* Mark block as defined */
-		VALGRIND_MAKE_MEM_DEFINED ( block, sizeof ( *block ) );
+	/* Sanity checks */
+	assert ( size >= MIN_MEMBLOCK_SIZE );
+	assert ( ( size % MIN_MEMBLOCK_SIZE ) == 0 );
+	assert ( class < HEAP_CLASSES );
+
+	/* Record size */
+	VALGRIND_MAKE_MEM_UNDEFINED ( block, sizeof ( *block ) );
+	block->size = size;
+	if ( size > MIN_MEMBLOCK_SIZE ) {
+		VALGRIND_MAKE_MEM_UNDEFINED ( footer, sizeof ( *footer ) );
+		*footer = size;
+	}
 
-		/* Mark areas accessed by list_check() as defined */
-		VALGRIND_MAKE_MEM_DEFINED ( block->list.next,
-					    sizeof ( *block->list.next ) );
-		VALGRIND_MAKE_MEM_DEFINED ( &block->list.next->next->prev,
-				      sizeof ( block->list.next->next->prev ) );
+	/* Add to free list */
+	if ( ! ( free_classes & bit ) ) {
+		INIT_LIST_HEAD ( &free_blocks[class] );
+		free_classes |= bit;
 	}
+	list_add ( &block->list, &free_blocks[class] );
+
+	/* Mark block boundaries */
+	heap_mark ( free_starts, block, 1 );
+	heap_mark ( free_ends, ( ( ( void * ) block ) + size -
+				 MIN_MEMBLOCK_SIZE ), 1 );
 }
 
 /**
- * Mark all blocks in free list as inaccessible
+ * Remove block from free lists
  *
+ * @v block		Free block
  */
-static inline void valgrind_make_blocks_noaccess ( void ) {
+static void heap_remove ( struct memory_block *block ) {
+	size_t size = block->size;
+	unsigned int class = heap_class ( size );
+
+	/* Remove from free list */
+	list_del ( &block->list );
+	if ( list_empty ( &free_blocks[class] ) )
+		free_classes &= ~( 1ULL << class );
+
+	/* Unmark block boundaries */
+	heap_mark ( free_starts, block, 0 );
+	heap_mark ( free_ends, ( ( ( void * ) block ) + size -
+				 MIN_MEMBLOCK_SIZE ), 0 );
+	VALGRIND_MAKE_MEM_NOACCESS ( block, sizeof ( *block ) );
+	VALGRIND_MAKE_MEM_NOACCESS ( heap_footer ( block, size ),
+				     sizeof ( size_t ) );
+}
+
+/**
+ * Mark all blocks in free lists as defined
+ *
+ */
+static inline void valgrind_make_blocks_defined ( void ) {
 	struct memory_block *block;
-	struct memory_block *prev = NULL;
+	struct list_head *head;
+	unsigned int class;
 
 	/* Do nothing unless running under Valgrind */
 	if ( RUNNING_ON_VALGRIND <= 0 )
 		return;
 
-	/* Traverse free block list, marking each block structure as
-	 * inaccessible.  Some contortions are necessary to avoid
-	 * errors from list_check().
-	 */
+	/* Mark block lists themselves as defined */
+	VALGRIND_MAKE_MEM_DEFINED ( free_blocks, sizeof ( free_blocks ) );
 
-	/* Mark each block in list as inaccessible */
-	list_for_each_entry ( block, &free_blocks, list ) {
+	/* Mark each block (and its footer) in each list as defined.
+	 * Each block must be marked as defined before its list
+	 * pointers can be followed.
+	 */
+	for ( class = 0 ; class < HEAP_CLASSES ; class++ ) {
+		if ( ! ( free_classes & ( 1ULL << class ) ) )
+			continue;
+		head = &free_blocks[class];
+		for ( block = list_entry ( head->next, struct memory_block,
+					   list ) ;
+		      &block->list != head ;
+		      block = list_entry ( block->list.next,
+					   struct memory_block, list ) ) {
+			VALGRIND_MAKE_MEM_DEFINED ( block, sizeof ( *block ) );
+			VALGRIND_MAKE_MEM_DEFINED ( heap_footer ( block,
+								  block->size ),
+						    sizeof ( size_t ) );
+		}
+	}
+}
 
-		/* Mark previous block (if any) as inaccessible. (Current
-		 * block will be accessed by list_check().)
-		 */
-		if ( prev )
-			VALGRIND_MAKE_MEM_NOACCESS ( prev, sizeof ( *prev ) );
-		prev = block;
+/**
+ * Mark all blocks in free lists as inaccessible
+ *
+ */
+static inline void valgrind_make_blocks_noaccess ( void ) {
+	struct memory_block *block;
+	struct memory_block *next;
+	struct list_head *head;
+	unsigned int class;
 
-		/* At the end of the list, list_check() will end up
-		 * accessing the first list item.  Temporarily mark
-		 * this area as defined.
-		 */
-		VALGRIND_MAKE_MEM_DEFINED ( &free_blocks.next->prev,
-					    sizeof ( free_blocks.next->prev ) );
-	}
-	/* Mark last block (if any) as inaccessible */
-	if ( prev )
-		VALGRIND_MAKE_MEM_NOACCESS ( prev, sizeof ( *prev ) );
+	/* Do nothing unless running under Valgrind */
+	if ( RUNNING_ON_VALGRIND <= 0 )
+		return;
 
-	/* Mark as inaccessible the area that was temporarily marked
-	 * as defined to avoid errors from list_check().
+	/* Mark each block (and its footer) in each list as
+	 * inaccessible.  Each block's list pointer must be followed
+	 * before the block is marked as inaccessible.
 	 */
-	VALGRIND_MAKE_MEM_NOACCESS ( &free_blocks.next->prev,
-				     sizeof ( free_blocks.next->prev ) );
+	for ( class = 0 ; class < HEAP_CLASSES ; class++ ) {
+		if ( ! ( free_classes & ( 1ULL << class ) ) )
+			continue;
+		head = &free_blocks[class];
+		block = list_entry ( head->next, struct memory_block, list );
+		while ( &block->list != head ) {
+			next = list_entry ( block->list.next,
+					    struct memory_block, list );
+			VALGRIND_MAKE_MEM_NOACCESS ( heap_footer ( block,
+								   block->size ),
+						     sizeof ( size_t ) );
+			VALGRIND_MAKE_MEM_NOACCESS ( block, sizeof ( *block ) );
+			block = next;
+		}
+	}
 
-	/* Mark block list itself as inaccessible */
-	VALGRIND_MAKE_MEM_NOACCESS ( &free_blocks, sizeof ( free_blocks ) );
+	/* Mark block lists themselves as inaccessible */
+	VALGRIND_MAKE_MEM_NOACCESS ( free_blocks, sizeof ( free_blocks ) );
 }
 
 /**
- * Check integrity of the blocks in the free list
+ * Check integrity of the blocks in the free lists
  *
  */
 static inline void check_blocks ( void ) {
 	struct memory_block *block;
-	struct memory_block *prev = NULL;
+	unsigned int class;
 
 	if ( ! ASSERTING )
 		return;
 
-	list_for_each_entry ( block, &free_blocks, list ) {
-
-		/* Check that list structure is intact */
-		list_check ( &block->list );
-
-		/* Check that block size is not too small */
-		assert ( block->size >= sizeof ( *block ) );
-		assert ( block->size >= MIN_MEMBLOCK_SIZE );
-
-		/* Check that block does not wrap beyond end of address space */
-		assert ( ( ( void * ) block + block->size ) >
-			 ( ( void * ) block ) );
-
-		/* Check that blocks remain in ascending order, and
-		 * that adjacent blocks have been merged.
-		 */
-		if ( prev ) {
-			assert ( ( ( void * ) block ) > ( ( void * ) prev ) );
-			assert ( ( ( void * ) block ) >
-				 ( ( ( void * ) prev ) + prev->size ) );
+	for ( class = 0 ; class < HEAP_CLASSES ; class++ ) {
+
+		/* Check that empty lists are marked as empty */
+		if ( ! ( free_classes & ( 1ULL << class ) ) )
+			continue;
+		assert ( ! list_empty ( &free_blocks[class] ) );
+
+		list_for_each_entry ( block, &free_blocks[class], list ) {
+
+			/* Check that list structure is intact */
+			list_check ( &block->list );
+
+			/* Check that block size is valid */
+			assert ( block->size >= sizeof ( *block ) );
+			assert ( block->size >= MIN_MEMBLOCK_SIZE );
+			assert ( ( block->size % MIN_MEMBLOCK_SIZE ) == 0 );
+			assert ( heap_class ( block->size ) == class );
+
+			/* Check that block lies within the heap */
+			assert ( ( ( void * ) block ) >= heap_start );
+			assert ( ( ( void * ) block + block->size ) <=
+				 heap_end );
+
+			/* Check that block boundaries are recorded */
+			assert ( heap_test ( free_starts, block ) );
+			assert ( heap_test ( free_ends,
+					     ( ( ( void * ) block ) +
+					       block->size -
+					       MIN_MEMBLOCK_SIZE ) ) );
+			assert ( ( block->size == MIN_MEMBLOCK_SIZE ) ||
+				 ( *heap_footer ( block, block->size ) ==
+				   block->size ) );
+
+			/* Check that adjacent blocks have been merged */
+			assert ( ! heap_test ( free_ends,
+					       ( ( ( void * ) block ) -
+						 MIN_MEMBLOCK_SIZE ) ) );
+			assert ( ! heap_test ( free_starts,
+					       ( ( ( void * ) block ) +
+						 block->size ) ) );
 		}
-		prev = block;
 	}
 }
 
@@ -263,6 +476,58 @@ static void discard_all_cache ( void ) {
 	} while ( discarded );
 }
 
+/**
+ * Find a free block large enough for an allocation
+ *
+ * @v size		Actual size (a multiple of MIN_MEMBLOCK_SIZE)
+ * @v align_mask	Alignment mask
+ * @v offset		Offset from physical alignment
+ * @ret block		Free block, or NULL
+ * @ret pre_size	Size of unused space before allocation
+ */
+static struct memory_block * heap_find ( size_t size, size_t align_mask,
+					 size_t offset, size_t *pre_size ) {
+	struct memory_block *block;
+	uint64_t classes;
+	size_t worst_size;
+	unsigned int class;
+
+	/* Look for the smallest size class in which every block is
+	 * guaranteed to be large enough, regardless of alignment.
+	 * This requires no list traversal.
+	 */
+	worst_size = ( size + ( align_mask & ~( MIN_MEMBLOCK_SIZE - 1 ) ) );
+	if ( worst_size >= size ) {
+		class = heap_fit_class ( worst_size );
+		classes = ( ( class < HEAP_CLASSES ) ?
+			    ( free_classes & ~( ( 1ULL << class ) - 1 ) ) : 0 );
+		if ( classes ) {
+			class = ( ffsll ( classes ) - 1 );
+			block = list_first_entry ( &free_blocks[class],
+						   struct memory_block, list );
+			*pre_size = ( ( offset - virt_to_phys ( block ) )
+				      & align_mask );
+			assert ( ( *pre_size + size ) <= block->size );
+			return block;
+		}
+	}
+
+	/* Otherwise, search all blocks that may be large enough */
+	for ( class = heap_class ( size ) ; class < HEAP_CLASSES ; class++ ) {
+		if ( ! ( free_classes & ( 1ULL << class ) ) )
+			continue;
+		list_for_each_entry ( block, &free_blocks[class], list ) {
+			*pre_size = ( ( offset - virt_to_phys ( block ) )
+				      & align_mask );
+			if ( ( block->size >= *pre_size ) &&
+			     ( ( block->size - *pre_size ) >= size ) )
+				return block;
+		}
+	}
+
+	return NULL;
+}
+
 /**
  * Allocate a memory block
  *
@@ -280,6 +545,7 @@ void * alloc_memblock ( size_t size, size_t align, size_t offset ) {
 	struct memory_block *block;
 	size_t align_mask;
 	size_t actual_size;
+	size_t sub_offset;
 	size_t pre_size;
 	size_t post_size;
 	struct memory_block *pre;
@@ -293,38 +559,40 @@ void * alloc_memblock ( size_t size, size_t align, size_t offset ) {
 	valgrind_make_blocks_defined();
 	check_blocks();
 
+	/* All blocks start on a MIN_MEMBLOCK_SIZE boundary.  Any
+	 * offset within this boundary is satisfied by returning a
+	 * pointer partway into the first granule of the block.
+	 */
+	sub_offset = ( offset & ( MIN_MEMBLOCK_SIZE - 1 ) );
+	offset -= sub_offset;
+
 	/* Round up size to multiple of MIN_MEMBLOCK_SIZE and
 	 * calculate alignment mask.
 	 */
-	actual_size = ( ( size + MIN_MEMBLOCK_SIZE - 1 ) &
+	actual_size = ( ( size + sub_offset + MIN_MEMBLOCK_SIZE - 1 ) &
 			~( MIN_MEMBLOCK_SIZE - 1 ) );
-	if ( ! actual_size ) {
+	if ( actual_size < size ) {
 		/* The requested size is not permitted to be zero.  A
-		 * zero result at this point indicates that either the
-		 * original requested size was zero, or that unsigned
-		 * integer overflow has occurred.
+		 * result smaller than the requested size at this
+		 * point indicates that unsigned integer overflow has
+		 * occurred.
 		 */
 		ptr = NULL;
 		goto done;
 	}
-	assert ( actual_size >= size );
 	align_mask = ( ( align - 1 ) | ( MIN_MEMBLOCK_SIZE - 1 ) );
 
 	DBGC2 ( &heap, "Allocating %#zx (aligned %#zx+%zx)\n",
-		size, align, offset );
+		size, align, ( offset + sub_offset ) );
 	while ( 1 ) {
-		/* Search through blocks for the first one with enough space */
-		list_for_each_entry ( block, &free_blocks, list ) {
-			pre_size = ( ( offset - virt_to_phys ( block ) )
-				     & align_mask );
-			if ( ( block->size < pre_size ) ||
-			     ( ( block->size - pre_size ) < actual_size ) )
-				continue;
+		/* Find a block with enough space */
+		block = heap_find ( actual_size, align_mask, offset,
+				    &pre_size );
+		if ( block ) {
 			post_size = ( block->size - pre_size - actual_size );
 			/* Split block into pre-block, block, and
-			 * post-block.  After this split, the "pre"
-			 * block is the one currently linked into the
-			 * free list.
+			 * post-block, returning the pre-block and
+			 * post-block (if any) to the free lists.
 			 */
 			pre   = block;
 			block = ( ( ( void * ) pre   ) + pre_size );
@@ -332,48 +600,28 @@ void * alloc_memblock ( size_t size, size_t align, size_t offset ) {
 			DBGC2 ( &heap, "[%p,%p) -> [%p,%p) + [%p,%p)\n", pre,
 				( ( ( void * ) pre ) + pre->size ), pre, block,
 				post, ( ( ( void * ) pre ) + pre->size ) );
-			/* If there is a "post" block, add it in to
-			 * the free list.  Leak it if it is too small
-			 * (which can happen only at the very end of
-			 * the heap).
-			 */
-			if ( post_size >= MIN_MEMBLOCK_SIZE ) {
-				VALGRIND_MAKE_MEM_UNDEFINED ( post,
-							      sizeof ( *post ));
-				post->size = post_size;
-				list_add ( &post->list, &pre->list );
-			}
-			/* Shrink "pre" block, leaving the main block
-			 * isolated and no longer part of the free
-			 * list.
-			 */
-			pre->size = pre_size;
-			/* If there is no "pre" block, remove it from
-			 * the list.  Also remove it (i.e. leak it) if
-			 * it is too small, which can happen only at
-			 * the very start of the heap.
-			 */
-			if ( pre_size < MIN_MEMBLOCK_SIZE ) {
-				list_del ( &pre->list );
-				VALGRIND_MAKE_MEM_NOACCESS ( pre,
-							     sizeof ( *pre ) );
-			}
+			heap_remove ( pre );
+			if ( pre_size )
+				heap_insert ( pre, pre_size );
+			if ( post_size )
+				heap_insert ( post, post_size );
 			/* Update memory usage statistics */
 			freemem -= actual_size;
 			usedmem += actual_size;
 			if ( usedmem > maxusedmem )
 				maxusedmem = usedmem;
 			/* Return allocated block */
-			DBGC2 ( &heap, "Allocated [%p,%p)\n", block,
-				( ( ( void * ) block ) + size ) );
-			ptr = block;
+			ptr = ( ( ( void * ) block ) + sub_offset );
+			DBGC2 ( &heap, "Allocated [%p,%p)\n", ptr,
+				( ptr + size ) );
 			VALGRIND_MAKE_MEM_UNDEFINED ( ptr, size );
 			goto done;
 		}
 
 		/* Try discarding some cached data to free up memory */
 		DBGC ( &heap, "Attempting discard for %#zx (aligned %#zx+%zx), "
-		       "used %zdkB\n", size, align, offset, ( usedmem >> 10 ) );
+		       "used %zdkB\n", size, align, ( offset + sub_offset ),
+		       ( usedmem >> 10 ) );
 		valgrind_make_blocks_noaccess();
 		discarded = discard_cache();
 		valgrind_make_blocks_defined();
@@ -404,10 +652,8 @@ void * alloc_memblock ( size_t size, size_t align, size_t offset ) {
 void free_memblock ( void *ptr, size_t size ) {
 	struct memory_block *freeing;
 	struct memory_block *block;
-	struct memory_block *tmp;
 	size_t actual_size;
-	ssize_t gap_before;
-	ssize_t gap_after = -1;
+	size_t sub_offset;
 
 	/* Allow for ptr==NULL */
 	if ( ! ptr )
@@ -418,81 +664,63 @@ void free_memblock ( void *ptr, size_t size ) {
 	valgrind_make_blocks_defined();
 	check_blocks();
 
-	/* Round up size to match actual size that alloc_memblock()
-	 * would have used.
+	/* Locate start of block and round up size to match actual
+	 * size that alloc_memblock() would have used.
 	 */
 	assert ( size != 0 );
-	actual_size = ( ( size + MIN_MEMBLOCK_SIZE - 1 ) &
+	sub_offset = ( virt_to_phys ( ptr ) & ( MIN_MEMBLOCK_SIZE - 1 ) );
+	freeing = ( ptr - sub_offset );
+	actual_size = ( ( size + sub_offset + MIN_MEMBLOCK_SIZE - 1 ) &
 			~( MIN_MEMBLOCK_SIZE - 1 ) );
-	freeing = ptr;
-	VALGRIND_MAKE_MEM_UNDEFINED ( freeing, sizeof ( *freeing ) );
-	DBGC2 ( &heap, "Freeing [%p,%p)\n",
-		freeing, ( ( ( void * ) freeing ) + size ) );
-
-	/* Check that this block does not overlap the free list */
-	if ( ASSERTING ) {
-		list_for_each_entry ( block, &free_blocks, list ) {
-			if ( ( ( ( void * ) block ) <
-			       ( ( void * ) freeing + actual_size ) ) &&
-			     ( ( void * ) freeing <
-			       ( ( void * ) block + block->size ) ) ) {
-				assert ( 0 );
-				DBGC ( &heap, "Double free of [%p,%p) "
-				       "overlapping [%p,%p) detected from %p\n",
-				       freeing,
-				       ( ( ( void * ) freeing ) + size ), block,
-				       ( ( void * ) block + block->size ),
-				       __builtin_return_address ( 0 ) );
-			}
-		}
-	}
+	DBGC2 ( &heap, "Freeing [%p,%p)\n", ptr, ( ptr + size ) );
 
-	/* Insert/merge into free list */
-	freeing->size = actual_size;
-	list_for_each_entry_safe ( block, tmp, &free_blocks, list ) {
-		/* Calculate gaps before and after the "freeing" block */
-		gap_before = ( ( ( void * ) freeing ) - 
-			       ( ( ( void * ) block ) + block->size ) );
-		gap_after = ( ( ( void * ) block ) - 
-			      ( ( ( void * ) freeing ) + freeing->size ) );
-		/* Merge with immediately preceding block, if possible */
-		if ( gap_before == 0 ) {
-			DBGC2 ( &heap, "[%p,%p) + [%p,%p) -> [%p,%p)\n", block,
-				( ( ( void * ) block ) + block->size ), freeing,
-				( ( ( void * ) freeing ) + freeing->size ),
-				block,
-				( ( ( void * ) freeing ) + freeing->size ) );
-			block->size += actual_size;
-			list_del ( &block->list );
-			VALGRIND_MAKE_MEM_NOACCESS ( freeing,
-						     sizeof ( *freeing ) );
-			freeing = block;
-		}
-		/* Stop processing as soon as we reach a following block */
-		if ( gap_after >= 0 )
-			break;
+	/* Check that this block does not overlap the start or end of
+	 * a free block.
+	 */
+	if ( heap_test ( free_starts, freeing ) ||
+	     heap_test ( free_ends, ( ( ( void * ) freeing ) + actual_size -
+				      MIN_MEMBLOCK_SIZE ) ) ) {
+		assert ( 0 );
+		DBGC ( &heap, "Double free of [%p,%p) detected from %p\n",
+		       ptr, ( ptr + size ), __builtin_return_address ( 0 ) );
 	}
 
-	/* Insert before the immediately following block.  If
-	 * possible, merge the following block into the "freeing"
-	 * block.
-	 */
-	DBGC2 ( &heap, "[%p,%p)\n",
-		freeing, ( ( ( void * ) freeing ) + freeing->size ) );
-	list_add_tail ( &freeing->list, &block->list );
-	if ( gap_after == 0 ) {
+	/* Update memory usage statistics */
+	freemem += actual_size;
+	usedmem -= actual_size;
+
+	/* Merge with immediately following free block, if any */
+	block = ( ( ( void * ) freeing ) + actual_size );
+	if ( heap_test ( free_starts, block ) ) {
 		DBGC2 ( &heap, "[%p,%p) + [%p,%p) -> [%p,%p)\n", freeing,
-			( ( ( void * ) freeing ) + freeing->size ), block,
+			( ( ( void * ) freeing ) + actual_size ), block,
 			( ( ( void * ) block ) + block->size ), freeing,
 			( ( ( void * ) block ) + block->size ) );
-		freeing->size += block->size;
-		list_del ( &block->list );
-		VALGRIND_MAKE_MEM_NOACCESS ( block, sizeof ( *block ) );
+		actual_size += block->size;
+		heap_remove ( block );
 	}
 
-	/* Update memory usage statistics */
-	freemem += actual_size;
-	usedmem -= actual_size;
+	/* Merge with immediately preceding free block, if any */
+	if ( heap_test ( free_ends, ( ( ( void * ) freeing ) -
+				      MIN_MEMBLOCK_SIZE ) ) ) {
+		block = ( ( ( void * ) freeing ) - MIN_MEMBLOCK_SIZE );
+		if ( ! heap_test ( free_starts, block ) ) {
+			block = ( ( ( void * ) freeing ) -
+				  *( ( ( size_t * ) freeing ) - 1 ) );
+		}
+		DBGC2 ( &heap, "[%p,%p) + [%p,%p) -> [%p,%p)\n", block,
+			( ( ( void * ) block ) + block->size ), freeing,
+			( ( ( void * ) freeing ) + actual_size ), block,
+			( ( ( void * ) freeing ) + actual_size ) );
+		actual_size += block->size;
+		heap_remove ( block );
+		freeing = block;
+	}
+
+	/* Add to free lists */
+	DBGC2 ( &heap, "[%p,%p)\n",
+		freeing, ( ( ( void * ) freeing ) + actual_size ) );
+	heap_insert ( freeing, actual_size );
 
 	check_blocks();
 	valgrind_make_blocks_noaccess();
@@ -643,14 +871,26 @@ void * zalloc ( size_t size ) {
  * Adds a block of memory [start,end) to the allocation pool.  This is
  * a one-way operation; there is no way to reclaim this memory.
  *
- * @c start must be aligned to at least a multiple of sizeof(void*).
+ * The memory must lie within the heap.
  */
 void mpopulate ( void *start, size_t len ) {
+	size_t skip;
+
+	/* Align start of block to a MIN_MEMBLOCK_SIZE boundary */
+	skip = ( -virt_to_phys ( start ) & ( MIN_MEMBLOCK_SIZE - 1 ) );
+	if ( len < skip )
+		return;
+	start += skip;
+	len -= skip;
 
 	/* Prevent free_memblock() from rounding up len beyond the end
 	 * of what we were actually given...
 	 */
 	len &= ~( MIN_MEMBLOCK_SIZE - 1 );
+	if ( ! len )
+		return;
+	assert ( start >= heap_start );
+	assert ( ( start + len ) <= heap_end );
 
 	/* Add to allocation pool */
 	free_memblock ( start, len );
@@ -664,8 +904,16 @@ void mpopulate ( void *start, size_t len ) {
  *
  */
 static void init_heap ( void ) {
+	size_t skip;
+
+	/* Calculate usable (aligned) portion of heap */
+	skip = ( -virt_to_phys ( heap ) & ( MIN_MEMBLOCK_SIZE - 1 ) );
+	heap_start = ( heap + skip );
+	heap_end = ( heap_start + ( ( sizeof ( heap ) - skip ) &
+				    ~( MIN_MEMBLOCK_SIZE - 1 ) ) );
+
 	VALGRIND_MAKE_MEM_NOACCESS ( heap, sizeof ( heap ) );
-	VALGRIND_MAKE_MEM_NOACCESS ( &free_blocks, sizeof ( free_blocks ) );
+	VALGRIND_MAKE_MEM_NOACCESS ( free_blocks, sizeof ( free_blocks ) );
 	mpopulate ( heap, sizeof ( heap ) );
 }
 
@@ -697,11 +945,17 @@ struct startup_fn heap_startup_fn __startup_fn ( STARTUP_EARLY ) = {
  */
 void mdumpfree ( void ) {
 	struct memory_block *block;
-
-	printf ( "Free block list:\n" );
-	list_for_each_entry ( block, &free_blocks, list ) {
-		printf ( "[%p,%p] (size %#zx)\n", block,
-			 ( ( ( void * ) block ) + block->size ), block->size );
+	unsigned int class;
+
+	printf ( "Free block lists:\n" );
+	for ( class = 0 ; class < HEAP_CLASSES ; class++ ) {
+		if ( ! ( free_classes & ( 1ULL << class ) ) )
+			continue;
+		list_for_each_entry ( block, &free_blocks[class], list ) {
+			printf ( "[%p,%p] (size %#zx, class %d)\n", block,
+				 ( ( ( void * ) block ) + block->size ),
+				 block->size, class );
+		}
 	}
 }
 #endif
@@ -25,6 +25,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 
 #include <ipxe/list.h>
 #include <ipxe/init.h>
+#include <ipxe/nap.h>
 #include <ipxe/process.h>
 
 /** @file
@@ -38,6 +39,9 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 /** Process run queue */
 static LIST_HEAD ( run_queue );
 
+/** Generic process profiler */
+static struct profiler process_profiler __profiler = { .name = "process" };
+
 /**
  * Get pointer to object containing process
  *
@@ -98,6 +102,7 @@ void process_del ( struct process *process ) {
 void step ( void ) {
 	struct process *process;
 	struct process_descriptor *desc;
+	struct profiler *profiler;
 	void *object;
 
 	if ( ( process = list_first_entry ( &run_queue, struct process,
@@ -113,13 +118,40 @@ void step ( void ) {
 		}
 		DBGC2 ( PROC_COL ( process ), "PROCESS " PROC_FMT
 			" executing\n", PROC_DBG ( process ) );
+		profiler = ( desc->profiler ?
+			     desc->profiler : &process_profiler );
+		profile_start ( profiler );
 		desc->step ( object );
+		profile_stop ( profiler );
 		DBGC2 ( PROC_COL ( process ), "PROCESS " PROC_FMT
 			" finished executing\n", PROC_DBG ( process ) );
 		ref_put ( process->refcnt ); /* Allow destruction */
 	}
 }
 
+/**
+ * Sleep until the next interrupt, unless background work is pending
+ *
+ * This should be called in place of cpu_nap() by loops that wait for
+ * an external event (such as a keypress) while single-stepping
+ * processes.  The CPU will not be halted while any background work
+ * (such as an expired timer or a recently active network device) is
+ * pending, so that such work is carried out in a single burst rather
+ * than one step per interrupt.
+ */
+void step_nap ( void ) {
+	struct process_busy *busy;
+
+	/* Do not sleep if any work is pending */
+	for_each_table_entry ( busy, PROCESS_BUSY ) {
+		if ( busy->busy() )
+			return;
+	}
+
+	/* Sleep until next interrupt */
+	cpu_nap();
+}
+
 /**
  * Initialise processes
  *
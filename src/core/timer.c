@@ -27,7 +27,6 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/process.h>
 #include <ipxe/console.h>
 #include <ipxe/keys.h>
-#include <ipxe/nap.h>
 #include <ipxe/init.h>
 #include <ipxe/timer.h>
 
@@ -106,7 +105,7 @@ static unsigned int sleep_interruptible ( unsigned int secs,
 			step();
 			if ( interrupted && interrupted() )
 				return secs;
-			cpu_nap();
+			step_nap();
 		}
 		start = now;
 	}
@@ -50,6 +50,45 @@ static struct profiler xferbuf_write_profiler __profiler =
 static struct profiler xferbuf_read_profiler __profiler =
 	{ .name = "xferbuf.read" };
 
+/** Data reallocation profiler */
+static struct profiler xferbuf_realloc_profiler __profiler =
+	{ .name = "xferbuf.realloc" };
+
+/** Total number of bytes potentially copied by reallocations */
+unsigned long xferbuf_realloc_copied;
+
+/**
+ * Reallocate data transfer buffer
+ *
+ * @v xferbuf		Data transfer buffer
+ * @v size		New allocated size (or zero to free buffer)
+ * @ret rc		Return status code
+ */
+static int xferbuf_realloc ( struct xfer_buffer *xferbuf, size_t size ) {
+	int rc;
+
+	/* Reallocate buffer */
+	profile_start ( &xferbuf_realloc_profiler );
+	rc = xferbuf->op->realloc ( xferbuf, size );
+	profile_stop ( &xferbuf_realloc_profiler );
+	if ( rc != 0 )
+		return rc;
+
+	/* Record reallocation.  The existing contents may have been
+	 * copied to the new location, so account for these bytes.
+	 */
+	if ( size && xferbuf->size ) {
+		xferbuf_realloc_copied += ( ( size < xferbuf->len ) ?
+					    size : xferbuf->len );
+		DBGC2 ( xferbuf, "XFERBUF %p reallocated %zd->%zd bytes (%lu "
+			"bytes copied in total)\n", xferbuf, xferbuf->size,
+			size, xferbuf_realloc_copied );
+	}
+	xferbuf->size = size;
+
+	return 0;
+}
+
 /**
  * Free data transfer buffer
  *
@@ -57,7 +96,7 @@ static struct profiler xferbuf_read_profiler __profiler =
  */
 void xferbuf_free ( struct xfer_buffer *xferbuf ) {
 
-	xferbuf->op->realloc ( xferbuf, 0 );
+	xferbuf_realloc ( xferbuf, 0 );
 	xferbuf->len = 0;
 	xferbuf->pos = 0;
 }
@@ -68,16 +107,36 @@ void xferbuf_free ( struct xfer_buffer *xferbuf ) {
  * @v xferbuf		Data transfer buffer
  * @v len		Required minimum size
  * @ret rc		Return status code
+ *
+ * The allocated size is grown geometrically, so that a transfer of
+ * unknown length does not trigger a reallocation (and hence a
+ * potential copy of the entire buffer) for every delivered block.
+ * The first allocation is always exact, so that a buffer presized
+ * using a known file length (e.g. via xfer_seek()) carries no slack.
  */
 static int xferbuf_ensure_size ( struct xfer_buffer *xferbuf, size_t len ) {
+	size_t size;
 	int rc;
 
 	/* If buffer is already large enough, do nothing */
 	if ( len <= xferbuf->len )
 		return 0;
 
-	/* Extend buffer */
-	if ( ( rc = xferbuf->op->realloc ( xferbuf, len ) ) != 0 ) {
+	/* If allocated space is already large enough, just extend */
+	if ( len <= xferbuf->size ) {
+		xferbuf->len = len;
+		return 0;
+	}
+
+	/* Calculate new allocated size, growing by at least 50% */
+	size = ( xferbuf->size + ( xferbuf->size / 2 ) );
+	if ( ( size < len ) || ( size < xferbuf->size ) /* overflow */ )
+		size = len;
+
+	/* Extend buffer, falling back to an exact allocation */
+	if ( ( ( rc = xferbuf_realloc ( xferbuf, size ) ) != 0 ) &&
+	     ( ( size == len ) ||
+	       ( ( rc = xferbuf_realloc ( xferbuf, len ) ) != 0 ) ) ) {
 		DBGC ( xferbuf, "XFERBUF %p could not extend buffer to "
 		       "%zd bytes: %s\n", xferbuf, len, strerror ( rc ) );
 		return rc;
@@ -87,6 +146,33 @@ static int xferbuf_ensure_size ( struct xfer_buffer *xferbuf, size_t len ) {
 	return 0;
 }
 
+/**
+ * Shrink data transfer buffer to fit its contents
+ *
+ * @v xferbuf		Data transfer buffer
+ * @ret rc		Return status code
+ *
+ * This should be called once the transfer is complete, to release
+ * any excess space allocated by geometric growth.
+ */
+int xferbuf_shrink ( struct xfer_buffer *xferbuf ) {
+	int rc;
+
+	/* Do nothing unless there is excess allocated space */
+	if ( ( xferbuf->len == 0 ) || ( xferbuf->len >= xferbuf->size ) )
+		return 0;
+
+	/* Shrink buffer */
+	if ( ( rc = xferbuf_realloc ( xferbuf, xferbuf->len ) ) != 0 ) {
+		DBGC ( xferbuf, "XFERBUF %p could not shrink buffer to "
+		       "%zd bytes: %s\n", xferbuf, xferbuf->len,
+		       strerror ( rc ) );
+		return rc;
+	}
+
+	return 0;
+}
+
 /**
  * Write to data transfer buffer
  *
@@ -80,6 +80,9 @@ void *vring_get_buf(struct vring_virtqueue *vq, unsigned int *len)
 
    vq->last_used_idx++;
 
+   if (vq->event)
+           vring_update_used_event(vq);
+
    return opaque;
 }
 
@@ -126,12 +129,19 @@ void vring_kick(struct virtio_pci_modern_device *vdev, unsigned int ioaddr,
                 struct vring_virtqueue *vq, int num_added)
 {
    struct vring *vr = &vq->vring;
+   u16 old = vr->avail->idx;
+   u16 new_idx = (old + num_added);
+   int notify;
 
    wmb();
-   vr->avail->idx += num_added;
+   vr->avail->idx = new_idx;
 
    mb();
-   if (!(vr->used->flags & VRING_USED_F_NO_NOTIFY)) {
+   if (vq->event)
+           notify = vring_need_event(vring_avail_event(vr), new_idx, old);
+   else
+           notify = !(vr->used->flags & VRING_USED_F_NO_NOTIFY);
+   if (notify) {
            if (vdev) {
                    /* virtio 1.0 */
                    vpm_notify(vdev, vq);
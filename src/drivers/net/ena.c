@@ -786,7 +786,7 @@ static void ena_refill_rx ( struct net_device *netdev ) {
 	while ( ( ena->rx.sq.prod - ena->rx.cq.cons ) < ena->rx.sq.fill ) {
 
 		/* Allocate I/O buffer */
-		iobuf = alloc_iob ( len );
+		iobuf = iob_pool_alloc ( &netdev->rx_pool, len );
 		if ( ! iobuf ) {
 			/* Wait for next refill */
 			break;
@@ -938,8 +938,9 @@ static int ena_transmit ( struct net_device *netdev, struct io_buffer *iobuf ) {
 	assert ( ena->tx_iobuf[id] == NULL );
 	ena->tx_iobuf[id] = iobuf;
 
-	/* Ring doorbell */
-	writel ( ena->tx.sq.prod, ( ena->regs + ena->tx.sq.doorbell ) );
+	/* Ring doorbell, unless deferred until the batch is flushed */
+	if ( ! netdev_tx_batching ( netdev ) )
+		writel ( ena->tx.sq.prod, ( ena->regs + ena->tx.sq.doorbell ) );
 
 	DBGC2 ( ena, "ENA %p TX %d at [%08llx,%08llx)\n", ena, id,
 		( ( unsigned long long ) address ),
@@ -947,6 +948,18 @@ static int ena_transmit ( struct net_device *netdev, struct io_buffer *iobuf ) {
 	return 0;
 }
 
+/**
+ * Flush batched transmissions
+ *
+ * @v netdev		Network device
+ */
+static void ena_flush ( struct net_device *netdev ) {
+	struct ena_nic *ena = netdev->priv;
+
+	/* Ring doorbell */
+	writel ( ena->tx.sq.prod, ( ena->regs + ena->tx.sq.doorbell ) );
+}
+
 /**
  * Poll for completed transmissions
  *
@@ -1060,6 +1073,7 @@ static struct net_device_operations ena_operations = {
 	.close		= ena_close,
 	.transmit	= ena_transmit,
 	.poll		= ena_poll,
+	.flush		= ena_flush,
 };
 
 /******************************************************************************
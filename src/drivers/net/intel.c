@@ -585,10 +585,11 @@ void intel_refill_rx ( struct intel_nic *intel ) {
 	unsigned int refilled = 0;
 
 	/* Refill ring */
-	while ( ( intel->rx.prod - intel->rx.cons ) < INTEL_RX_FILL ) {
+	while ( ( intel->rx.prod - intel->rx.cons ) < intel->rx_fill ) {
 
 		/* Allocate I/O buffer */
-		iobuf = alloc_rx_iob ( INTEL_RX_MAX_LEN, intel->dma );
+		iobuf = alloc_rx_iob_pool ( intel->rx_pool, INTEL_RX_MAX_LEN,
+					   intel->dma );
 		if ( ! iobuf ) {
 			/* Wait for next refill */
 			break;
@@ -650,6 +651,7 @@ static int intel_open ( struct net_device *netdev ) {
 	uint32_t fextnvm11;
 	uint32_t tctl;
 	uint32_t rctl;
+	uint32_t rxcsum;
 	int rc;
 
 	/* Set undocumented bit in FEXTNVM11 to work around an errata
@@ -671,6 +673,8 @@ static int intel_open ( struct net_device *netdev ) {
 	/* Create receive descriptor ring */
 	if ( ( rc = intel_create_ring ( intel, &intel->rx ) ) != 0 )
 		goto err_create_rx;
+	intel->rx_fill = netdev_rx_fill ( netdev, INTEL_RX_FILL,
+					  INTEL_RX_FILL_MAX );
 
 	/* Program MAC address */
 	memset ( &mac, 0, sizeof ( mac ) );
@@ -686,6 +690,12 @@ static int intel_open ( struct net_device *netdev ) {
 		  INTEL_TCTL_COLD_DEFAULT );
 	writel ( tctl, intel->regs + INTEL_TCTL );
 
+	/* Enable receive checksum offload */
+	rxcsum = readl ( intel->regs + INTEL_RXCSUM );
+	rxcsum |= ( INTEL_RXCSUM_IPOFL | INTEL_RXCSUM_TUOFL );
+	writel ( rxcsum, intel->regs + INTEL_RXCSUM );
+	intel->rx_csum = 1;
+
 	/* Enable receiver */
 	rctl = readl ( intel->regs + INTEL_RCTL );
 	rctl &= ~( INTEL_RCTL_BSIZE_BSEX_MASK );
@@ -770,11 +780,15 @@ int intel_transmit ( struct net_device *netdev, struct io_buffer *iobuf ) {
 	intel->tx.describe ( tx, iob_dma ( iobuf ), len );
 	wmb();
 
-	/* Notify card that there are packets ready to transmit */
-	profile_start ( &intel_vm_tx_profiler );
-	writel ( tx_tail, intel->regs + intel->tx.reg + INTEL_xDT );
-	profile_stop ( &intel_vm_tx_profiler );
-	profile_exclude ( &intel_vm_tx_profiler );
+	/* Notify card that there are packets ready to transmit, unless
+	 * the notification is being deferred until the batch is flushed
+	 */
+	if ( ! netdev_tx_batching ( netdev ) ) {
+		profile_start ( &intel_vm_tx_profiler );
+		writel ( tx_tail, intel->regs + intel->tx.reg + INTEL_xDT );
+		profile_stop ( &intel_vm_tx_profiler );
+		profile_exclude ( &intel_vm_tx_profiler );
+	}
 
 	DBGC2 ( intel, "INTEL %p TX %d is [%lx,%lx)\n",
 		intel, tx_idx, virt_to_phys ( iobuf->data ),
@@ -783,6 +797,23 @@ int intel_transmit ( struct net_device *netdev, struct io_buffer *iobuf ) {
 	return 0;
 }
 
+/**
+ * Flush batched transmissions
+ *
+ * @v netdev		Network device
+ */
+void intel_flush ( struct net_device *netdev ) {
+	struct intel_nic *intel = netdev->priv;
+	unsigned int tx_tail;
+
+	/* Notify card that there are packets ready to transmit */
+	tx_tail = ( intel->tx.prod % INTEL_NUM_TX_DESC );
+	profile_start ( &intel_vm_tx_profiler );
+	writel ( tx_tail, intel->regs + intel->tx.reg + INTEL_xDT );
+	profile_stop ( &intel_vm_tx_profiler );
+	profile_exclude ( &intel_vm_tx_profiler );
+}
+
 /**
  * Poll for completed packets
  *
@@ -812,6 +843,21 @@ void intel_poll_tx ( struct net_device *netdev ) {
 	}
 }
 
+/**
+ * Check if hardware has verified received packet's checksum
+ *
+ * @v rx		Receive descriptor
+ * @ret ok		Transport-layer checksum has been verified
+ */
+static inline int intel_rx_csum_ok ( struct intel_descriptor *rx ) {
+	uint32_t status = le32_to_cpu ( rx->status );
+
+	return ( ( status & ( INTEL_DESC_STATUS_TCPCS |
+			      INTEL_DESC_STATUS_UDPCS ) ) &&
+		 ! ( status & ( INTEL_DESC_STATUS_IXSM |
+				INTEL_DESC_STATUS_ERRORS ) ) );
+}
+
 /**
  * Poll for received packets
  *
@@ -850,6 +896,8 @@ void intel_poll_rx ( struct net_device *netdev ) {
 		} else {
 			DBGC2 ( intel, "INTEL %p RX %d complete (length %zd)\n",
 				intel, rx_idx, len );
+			if ( intel->rx_csum && intel_rx_csum_ok ( rx ) )
+				iobuf->flags |= IOB_FL_CSUM_OK;
 			netdev_rx ( netdev, iobuf );
 		}
 		intel->rx.cons++;
@@ -884,7 +932,7 @@ static void intel_poll ( struct net_device *netdev ) {
 
 	/* Report receive overruns */
 	if ( icr & INTEL_IRQ_RXO )
-		netdev_rx_err ( netdev, NULL, -ENOBUFS );
+		netdev_rx_err ( netdev, NULL, -ENOBUFS_RX_OVERRUN );
 
 	/* Check link state, if applicable */
 	if ( icr & INTEL_IRQ_LSC )
@@ -910,10 +958,15 @@ static void intel_poll ( struct net_device *netdev ) {
  */
 static void intel_irq ( struct net_device *netdev, int enable ) {
 	struct intel_nic *intel = netdev->priv;
+	uint32_t interval;
 	uint32_t mask;
 
 	mask = ( INTEL_IRQ_TXDW | INTEL_IRQ_LSC | INTEL_IRQ_RXT0 );
 	if ( enable ) {
+		interval = INTEL_ITR_INTERVAL ( netdev->irq_holdoff );
+		if ( interval > INTEL_ITR_MAX )
+			interval = INTEL_ITR_MAX;
+		writel ( interval, intel->regs + INTEL_ITR );
 		writel ( mask, intel->regs + INTEL_IMS );
 	} else {
 		writel ( mask, intel->regs + INTEL_IMC );
@@ -927,6 +980,7 @@ static struct net_device_operations intel_operations = {
 	.transmit	= intel_transmit,
 	.poll		= intel_poll,
 	.irq		= intel_irq,
+	.flush		= intel_flush,
 };
 
 /******************************************************************************
@@ -977,6 +1031,7 @@ static int intel_probe ( struct pci_device *pci ) {
 
 	/* Configure DMA */
 	intel->dma = &pci->dma;
+	intel->rx_pool = &netdev->rx_pool;
 	dma_set_mask_64bit ( intel->dma );
 	netdev->dma = intel->dma;
 
@@ -50,9 +50,21 @@ struct intel_descriptor {
 /** Descriptor done */
 #define INTEL_DESC_STATUS_DD 0x00000001UL
 
+/** Ignore checksum indication */
+#define INTEL_DESC_STATUS_IXSM 0x00000004UL
+
+/** UDP checksum calculated */
+#define INTEL_DESC_STATUS_UDPCS 0x00000010UL
+
+/** TCP (or TCP/UDP) checksum calculated */
+#define INTEL_DESC_STATUS_TCPCS 0x00000020UL
+
 /** Receive error */
 #define INTEL_DESC_STATUS_RXE 0x00000100UL
 
+/** Any receive error (including checksum errors) */
+#define INTEL_DESC_STATUS_ERRORS 0x0000ff00UL
+
 /** Payload length */
 #define INTEL_DESC_STATUS_PAYLEN( len ) ( (len) << 14 )
 
@@ -103,6 +115,11 @@ struct intel_descriptor {
 #define INTEL_IRQ_RXO		0x00000040UL	/**< Receive overrun */
 #define INTEL_IRQ_RXT0		0x00000080UL	/**< Receive timer */
 
+/** Interrupt Throttling Register */
+#define INTEL_ITR 0x000c4UL
+#define INTEL_ITR_INTERVAL(usec) ( ( (usec) * 1000 ) / 256 ) /**< 256ns units */
+#define INTEL_ITR_MAX 0x0000ffffUL	/**< Maximum interval */
+
 /** Interrupt Mask Set/Read Register */
 #define INTEL_IMS 0x000d0UL
 
@@ -150,11 +167,14 @@ struct intel_descriptor {
  * Minimum value is 8, since the descriptor ring length must be a
  * multiple of 128.
  */
-#define INTEL_NUM_RX_DESC 16
+#define INTEL_NUM_RX_DESC 64
 
-/** Receive descriptor ring fill level */
+/** Default receive descriptor ring fill level */
 #define INTEL_RX_FILL 8
 
+/** Maximum receive descriptor ring fill level */
+#define INTEL_RX_FILL_MAX ( INTEL_NUM_RX_DESC - 1 )
+
 /** Receive buffer length */
 #define INTEL_RX_MAX_LEN 2048
 
@@ -197,6 +217,11 @@ struct intel_descriptor {
 /** Maximum time to wait for queue disable, in milliseconds */
 #define INTEL_DISABLE_MAX_WAIT_MS 100
 
+/** Receive Checksum Control */
+#define INTEL_RXCSUM 0x05000UL
+#define INTEL_RXCSUM_IPOFL	0x00000100UL	/**< IP checksum offload */
+#define INTEL_RXCSUM_TUOFL	0x00000200UL	/**< TCP/UDP checksum offload */
+
 /** Receive Address Low */
 #define INTEL_RAL0 0x05400UL
 
@@ -290,6 +315,8 @@ struct intel_nic {
 	void *regs;
 	/** DMA device */
 	struct dma_device *dma;
+	/** Receive I/O buffer pool */
+	struct iob_pool *rx_pool;
 	/** Port number (for multi-port devices) */
 	unsigned int port;
 	/** Flags */
@@ -311,6 +338,10 @@ struct intel_nic {
 	struct intel_ring tx;
 	/** Receive descriptor ring */
 	struct intel_ring rx;
+	/** Receive descriptor ring fill level */
+	unsigned int rx_fill;
+	/** Receive checksum offload is enabled */
+	int rx_csum;
 	/** Receive I/O buffers */
 	struct io_buffer *rx_iobuf[INTEL_NUM_RX_DESC];
 };
@@ -368,6 +399,7 @@ extern void intel_refill_rx ( struct intel_nic *intel );
 extern void intel_empty_rx ( struct intel_nic *intel );
 extern int intel_transmit ( struct net_device *netdev,
 			    struct io_buffer *iobuf );
+extern void intel_flush ( struct net_device *netdev );
 extern void intel_poll_tx ( struct net_device *netdev );
 extern void intel_poll_rx ( struct net_device *netdev );
 
@@ -191,6 +191,8 @@ static int intelx_open ( struct net_device *netdev ) {
 	/* Create receive descriptor ring */
 	if ( ( rc = intel_create_ring ( intel, &intel->rx ) ) != 0 )
 		goto err_create_rx;
+	intel->rx_fill = netdev_rx_fill ( netdev, INTEL_RX_FILL,
+					  INTEL_RX_FILL_MAX );
 
 	/* Program MAC address */
 	memset ( &mac, 0, sizeof ( mac ) );
@@ -327,7 +329,7 @@ static void intelx_poll ( struct net_device *netdev ) {
 
 	/* Report receive overruns */
 	if ( eicr & INTELX_EIRQ_RXO )
-		netdev_rx_err ( netdev, NULL, -ENOBUFS );
+		netdev_rx_err ( netdev, NULL, -ENOBUFS_RX_OVERRUN );
 
 	/* Check link state, if applicable */
 	if ( eicr & INTELX_EIRQ_LSC )
@@ -345,11 +347,16 @@ static void intelx_poll ( struct net_device *netdev ) {
  */
 static void intelx_irq ( struct net_device *netdev, int enable ) {
 	struct intel_nic *intel = netdev->priv;
+	uint32_t interval;
 	uint32_t mask;
 
 	mask = ( INTELX_EIRQ_LSC | INTELX_EIRQ_RXO | INTELX_EIRQ_TX0 |
 		 INTELX_EIRQ_RX0 );
 	if ( enable ) {
+		interval = INTELX_EITR_INTERVAL ( netdev->irq_holdoff );
+		if ( interval > INTELX_EITR_MAX )
+			interval = INTELX_EITR_MAX;
+		writel ( interval, intel->regs + INTELX_EITR0 );
 		writel ( mask, intel->regs + INTELX_EIMS );
 	} else {
 		writel ( mask, intel->regs + INTELX_EIMC );
@@ -363,6 +370,7 @@ static struct net_device_operations intelx_operations = {
 	.transmit	= intel_transmit,
 	.poll		= intelx_poll,
 	.irq		= intelx_irq,
+	.flush		= intel_flush,
 };
 
 /******************************************************************************
@@ -412,6 +420,7 @@ static int intelx_probe ( struct pci_device *pci ) {
 
 	/* Configure DMA */
 	intel->dma = &pci->dma;
+	intel->rx_pool = &netdev->rx_pool;
 	dma_set_mask_64bit ( intel->dma );
 	netdev->dma = intel->dma;
 
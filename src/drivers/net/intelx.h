@@ -28,6 +28,11 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #define INTELX_EIRQ_RXO		0x00020000UL	/**< Receive overrun */
 #define INTELX_EIRQ_LSC		0x00100000UL	/**< Link status change */
 
+/** Interrupt Throttle Register (for interrupt vector 0) */
+#define INTELX_EITR0 0x00820UL
+#define INTELX_EITR_INTERVAL(usec) ( ( (usec) / 2 ) << 3 ) /**< 2us units */
+#define INTELX_EITR_MAX 0x00000ff8UL	/**< Maximum interval */
+
 /** Interrupt Mask Set/Read Register */
 #define INTELX_EIMS 0x00880UL
 
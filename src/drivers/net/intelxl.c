@@ -1328,6 +1328,23 @@ void intelxl_destroy_ring ( struct intelxl_nic *intelxl,
 	intelxl_free_ring ( intelxl, ring );
 }
 
+/**
+ * Get receive descriptor ring fill level
+ *
+ * @v netdev		Network device
+ * @ret fill		Receive descriptor ring fill level
+ */
+unsigned int intelxl_rx_fill ( struct net_device *netdev ) {
+	unsigned int fill;
+
+	/* Round configured fill level down to a multiple of 8 */
+	fill = netdev_rx_fill ( netdev, INTELXL_RX_FILL, INTELXL_RX_FILL_MAX );
+	fill &= ~( INTELXL_RX_FILL_ALIGN - 1 );
+	if ( fill < INTELXL_RX_FILL_MIN )
+		fill = INTELXL_RX_FILL_MIN;
+	return fill;
+}
+
 /**
  * Refill receive descriptor ring
  *
@@ -1341,10 +1358,11 @@ static void intelxl_refill_rx ( struct intelxl_nic *intelxl ) {
 	unsigned int refilled = 0;
 
 	/* Refill ring */
-	while ( ( intelxl->rx.prod - intelxl->rx.cons ) < INTELXL_RX_FILL ) {
+	while ( ( intelxl->rx.prod - intelxl->rx.cons ) < intelxl->rx_fill ) {
 
 		/* Allocate I/O buffer */
-		iobuf = alloc_rx_iob ( intelxl->mfs, intelxl->dma );
+		iobuf = alloc_rx_iob_pool ( intelxl->rx_pool, intelxl->mfs,
+					   intelxl->dma );
 		if ( ! iobuf ) {
 			/* Wait for next refill */
 			break;
@@ -1439,6 +1457,7 @@ static int intelxl_open ( struct net_device *netdev ) {
 	/* Create receive descriptor ring */
 	if ( ( rc = intelxl_create_ring ( intelxl, &intelxl->rx ) ) != 0 )
 		goto err_create_rx;
+	intelxl->rx_fill = intelxl_rx_fill ( netdev );
 
 	/* Create transmit descriptor ring */
 	if ( ( rc = intelxl_create_ring ( intelxl, &intelxl->tx ) ) != 0 )
@@ -1532,8 +1551,11 @@ int intelxl_transmit ( struct net_device *netdev, struct io_buffer *iobuf ) {
 				  INTELXL_TX_DATA_RS | INTELXL_TX_DATA_JFDI );
 	wmb();
 
-	/* Notify card that there are packets ready to transmit */
-	writel ( tx_tail, ( intelxl->regs + intelxl->tx.tail ) );
+	/* Notify card that there are packets ready to transmit, unless
+	 * the notification is being deferred until the batch is flushed
+	 */
+	if ( ! netdev_tx_batching ( netdev ) )
+		writel ( tx_tail, ( intelxl->regs + intelxl->tx.tail ) );
 
 	DBGC2 ( intelxl, "INTELXL %p TX %d is [%08lx,%08lx)\n",
 		intelxl, tx_idx, virt_to_phys ( iobuf->data ),
@@ -1541,6 +1563,20 @@ int intelxl_transmit ( struct net_device *netdev, struct io_buffer *iobuf ) {
 	return 0;
 }
 
+/**
+ * Flush batched transmissions
+ *
+ * @v netdev		Network device
+ */
+void intelxl_flush ( struct net_device *netdev ) {
+	struct intelxl_nic *intelxl = netdev->priv;
+	unsigned int tx_tail;
+
+	/* Notify card that there are packets ready to transmit */
+	tx_tail = ( intelxl->tx.prod % INTELXL_TX_NUM_DESC );
+	writel ( tx_tail, ( intelxl->regs + intelxl->tx.tail ) );
+}
+
 /**
  * Poll for completed packets
  *
@@ -1570,6 +1606,36 @@ static void intelxl_poll_tx ( struct net_device *netdev ) {
 	}
 }
 
+/**
+ * Check if hardware has verified received packet's checksum
+ *
+ * @v rx_wb		Receive writeback descriptor
+ * @ret ok		Transport-layer checksum has been verified
+ */
+static inline int
+intelxl_rx_csum_ok ( struct intelxl_rx_writeback_descriptor *rx_wb ) {
+	uint32_t flags = le32_to_cpu ( rx_wb->flags );
+	uint32_t len = le32_to_cpu ( rx_wb->len );
+
+	/* Check that checksums were processed without error */
+	if ( ! ( flags & INTELXL_RX_WB_FL_L3L4P ) )
+		return 0;
+	if ( flags & ( INTELXL_RX_WB_FL_IPE | INTELXL_RX_WB_FL_L4E |
+		       INTELXL_RX_WB_FL_EIPE ) )
+		return 0;
+
+	/* Check that packet is an unfragmented TCP or UDP packet */
+	switch ( INTELXL_RX_WB_PTYPE ( flags, len ) ) {
+	case INTELXL_RX_PTYPE_IPV4_UDP:
+	case INTELXL_RX_PTYPE_IPV4_TCP:
+	case INTELXL_RX_PTYPE_IPV6_UDP:
+	case INTELXL_RX_PTYPE_IPV6_TCP:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
 /**
  * Poll for received packets
  *
@@ -1616,6 +1682,8 @@ static void intelxl_poll_rx ( struct net_device *netdev ) {
 		} else {
 			DBGC2 ( intelxl, "INTELXL %p RX %d complete (length "
 				"%zd)\n", intelxl, rx_idx, len );
+			if ( intelxl_rx_csum_ok ( rx_wb ) )
+				iobuf->flags |= IOB_FL_CSUM_OK;
 			vlan_netdev_rx ( netdev, tag, iobuf );
 		}
 		intelxl->rx.cons++;
@@ -1666,6 +1734,7 @@ static struct net_device_operations intelxl_operations = {
 	.close		= intelxl_close,
 	.transmit	= intelxl_transmit,
 	.poll		= intelxl_poll,
+	.flush		= intelxl_flush,
 };
 
 /******************************************************************************
@@ -1726,6 +1795,7 @@ static int intelxl_probe ( struct pci_device *pci ) {
 
 	/* Configure DMA */
 	intelxl->dma = &pci->dma;
+	intelxl->rx_pool = &netdev->rx_pool;
 	dma_set_mask_64bit ( intelxl->dma );
 	netdev->dma = intelxl->dma;
 
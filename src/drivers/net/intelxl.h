@@ -732,12 +732,36 @@ struct intelxl_rx_writeback_descriptor {
 /** Receive writeback descriptor VLAN tag present */
 #define INTELXL_RX_WB_FL_VLAN 0x00000004UL
 
+/** Receive writeback descriptor L3/L4 checksums processed */
+#define INTELXL_RX_WB_FL_L3L4P 0x00000008UL
+
 /** Receive writeback descriptor error */
 #define INTELXL_RX_WB_FL_RXE 0x00080000UL
 
+/** Receive writeback descriptor IP checksum error */
+#define INTELXL_RX_WB_FL_IPE 0x00400000UL
+
+/** Receive writeback descriptor L4 checksum error */
+#define INTELXL_RX_WB_FL_L4E 0x00800000UL
+
+/** Receive writeback descriptor outer IP checksum error */
+#define INTELXL_RX_WB_FL_EIPE 0x01000000UL
+
 /** Receive writeback descriptor length */
 #define INTELXL_RX_WB_LEN(len) ( ( (len) >> 6 ) & 0x3fff )
 
+/** Receive writeback descriptor packet type */
+#define INTELXL_RX_WB_PTYPE( flags, len ) \
+	( ( (flags) >> 30 ) | ( ( (len) & 0x3f ) << 2 ) )
+
+/** Receive packet types for which an L4 checksum is verified */
+enum intelxl_rx_ptype {
+	INTELXL_RX_PTYPE_IPV4_UDP = 24,
+	INTELXL_RX_PTYPE_IPV4_TCP = 26,
+	INTELXL_RX_PTYPE_IPV6_UDP = 90,
+	INTELXL_RX_PTYPE_IPV6_TCP = 92,
+};
+
 /** Packet descriptor */
 union intelxl_rx_descriptor {
 	/** Receive data descriptor */
@@ -809,14 +833,23 @@ intelxl_init_ring ( struct intelxl_ring *ring, unsigned int count, size_t len,
  *
  * Must be a multiple of 32 and greater than or equal to 64.
  */
-#define INTELXL_RX_NUM_DESC 64
+#define INTELXL_RX_NUM_DESC 128
 
-/** Receive descriptor ring fill level
+/** Default receive descriptor ring fill level
  *
  * Must be a multiple of 8 and greater than 8.
  */
 #define INTELXL_RX_FILL 16
 
+/** Receive descriptor ring fill level alignment */
+#define INTELXL_RX_FILL_ALIGN 8
+
+/** Minimum receive descriptor ring fill level */
+#define INTELXL_RX_FILL_MIN 16
+
+/** Maximum receive descriptor ring fill level */
+#define INTELXL_RX_FILL_MAX ( INTELXL_RX_NUM_DESC - INTELXL_RX_FILL_ALIGN )
+
 /** Maximum packet length (excluding CRC) */
 #define INTELXL_MAX_PKT_LEN ( 9728 - 4 /* CRC */ )
 
@@ -910,6 +943,8 @@ struct intelxl_nic {
 	void *regs;
 	/** DMA device */
 	struct dma_device *dma;
+	/** Receive I/O buffer pool */
+	struct iob_pool *rx_pool;
 	/** Maximum frame size */
 	size_t mfs;
 
@@ -948,6 +983,8 @@ struct intelxl_nic {
 	struct intelxl_ring tx;
 	/** Receive descriptor ring */
 	struct intelxl_ring rx;
+	/** Receive descriptor ring fill level */
+	unsigned int rx_fill;
 	/** Receive I/O buffers */
 	struct io_buffer *rx_iobuf[INTELXL_RX_NUM_DESC];
 
@@ -990,9 +1027,11 @@ extern int intelxl_create_ring ( struct intelxl_nic *intelxl,
 				 struct intelxl_ring *ring );
 extern void intelxl_destroy_ring ( struct intelxl_nic *intelxl,
 				   struct intelxl_ring *ring );
+extern unsigned int intelxl_rx_fill ( struct net_device *netdev );
 extern void intelxl_empty_rx ( struct intelxl_nic *intelxl );
 extern int intelxl_transmit ( struct net_device *netdev,
 			      struct io_buffer *iobuf );
+extern void intelxl_flush ( struct net_device *netdev );
 extern void intelxl_poll ( struct net_device *netdev );
 
 #endif /* _INTELXL_H */
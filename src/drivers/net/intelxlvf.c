@@ -656,6 +656,7 @@ static int intelxlvf_open ( struct net_device *netdev ) {
 	/* Allocate receive descriptor ring */
 	if ( ( rc = intelxl_alloc_ring ( intelxl, &intelxl->rx ) ) != 0 )
 		goto err_alloc_rx;
+	intelxl->rx_fill = intelxl_rx_fill ( netdev );
 
 	/* Configure queues */
 	if ( ( rc = intelxlvf_admin_configure ( netdev ) ) != 0 )
@@ -726,6 +727,7 @@ static struct net_device_operations intelxlvf_operations = {
 	.close		= intelxlvf_close,
 	.transmit	= intelxl_transmit,
 	.poll		= intelxl_poll,
+	.flush		= intelxl_flush,
 };
 
 /******************************************************************************
@@ -782,6 +784,7 @@ static int intelxlvf_probe ( struct pci_device *pci ) {
 
 	/* Configure DMA */
 	intelxl->dma = &pci->dma;
+	intelxl->rx_pool = &netdev->rx_pool;
 	dma_set_mask_64bit ( intelxl->dma );
 	netdev->dma = intelxl->dma;
 
@@ -282,6 +282,8 @@ static int intelxvf_open ( struct net_device *netdev ) {
 	/* Create receive descriptor ring */
 	if ( ( rc = intel_create_ring ( intel, &intel->rx ) ) != 0 )
 		goto err_create_rx;
+	intel->rx_fill = netdev_rx_fill ( netdev, INTEL_RX_FILL,
+					  INTEL_RX_FILL_MAX );
 
 	/* Allocate interrupt vectors */
 	writel ( ( INTELXVF_IVAR_RX0_DEFAULT | INTELXVF_IVAR_RX0_VALID |
@@ -415,6 +417,7 @@ static struct net_device_operations intelxvf_operations = {
 	.transmit	= intel_transmit,
 	.poll		= intelxvf_poll,
 	.irq		= intelxvf_irq,
+	.flush		= intel_flush,
 };
 
 /******************************************************************************
@@ -464,6 +467,7 @@ static int intelxvf_probe ( struct pci_device *pci ) {
 
 	/* Configure DMA */
 	intel->dma = &pci->dma;
+	intel->rx_pool = &netdev->rx_pool;
 	dma_set_mask_64bit ( intel->dma );
 	netdev->dma = intel->dma;
 
@@ -56,6 +56,10 @@ static struct profiler ncm_in_datagram_profiler __profiler =
 static struct profiler ncm_out_profiler __profiler =
 	{ .name = "ncm.out" };
 
+/** Bulk OUT aggregation profiler */
+static struct profiler ncm_out_aggregate_profiler __profiler =
+	{ .name = "ncm.out_aggr" };
+
 /******************************************************************************
  *
  * CDC-NCM communications interface
@@ -394,6 +398,177 @@ static int ncm_out_transmit ( struct ncm_device *ncm,
 	return 0;
 }
 
+/**
+ * Calculate alignment padding for a transmitted datagram
+ *
+ * @v ncm		CDC-NCM device
+ * @v offset		Unpadded datagram offset
+ * @ret padding		Padding length
+ */
+static size_t ncm_out_padding ( struct ncm_device *ncm, size_t offset ) {
+
+	return ( ( ncm->remainder - offset - ETH_HLEN ) &
+		 ( ncm->divisor - 1 ) );
+}
+
+/**
+ * Transmit multiple packets within a single NTB
+ *
+ * @v ncm		CDC-NCM device
+ * @v pkts		Packets
+ * @v count		Number of packets
+ * @ret rc		Return status code
+ *
+ * The packets are copied into a newly allocated NTB, and remain on
+ * the network device's transmit queue until the NTB completes.
+ */
+static int ncm_out_aggregate ( struct ncm_device *ncm,
+			       struct io_buffer **pkts, unsigned int count ) {
+	struct ncm_transfer_header *nth;
+	struct ncm_datagram_pointer *ndp;
+	struct io_buffer *ntb;
+	size_t header_len;
+	size_t offset;
+	size_t len;
+	unsigned int i;
+	int rc;
+
+	/* Profile aggregated transmissions */
+	profile_start ( &ncm_out_aggregate_profiler );
+
+	/* Calculate NTB length */
+	header_len = ( sizeof ( *nth ) + sizeof ( *ndp ) +
+		       ( ( count + 1 ) * sizeof ( ndp->desc[0] ) ) );
+	len = header_len;
+	for ( i = 0 ; i < count ; i++ ) {
+		len += ncm_out_padding ( ncm, len );
+		len += iob_len ( pkts[i] );
+	}
+	assert ( len <= ncm->out_mtu );
+
+	/* Allocate NTB */
+	ntb = alloc_iob ( len );
+	if ( ! ntb ) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+	memset ( iob_put ( ntb, len ), 0, len );
+
+	/* Populate transfer header and datagram pointer */
+	nth = ntb->data;
+	nth->magic = cpu_to_le32 ( NCM_TRANSFER_HEADER_MAGIC );
+	nth->header_len = cpu_to_le16 ( sizeof ( *nth ) );
+	nth->sequence = cpu_to_le16 ( ncm->sequence );
+	nth->len = cpu_to_le16 ( len );
+	nth->offset = cpu_to_le16 ( sizeof ( *nth ) );
+	ndp = ( ntb->data + sizeof ( *nth ) );
+	ndp->magic = cpu_to_le32 ( NCM_DATAGRAM_POINTER_MAGIC );
+	ndp->header_len = cpu_to_le16 ( header_len - sizeof ( *nth ) );
+
+	/* Copy in datagrams.  The terminating descriptor has already
+	 * been zeroed.
+	 */
+	offset = header_len;
+	for ( i = 0 ; i < count ; i++ ) {
+		offset += ncm_out_padding ( ncm, offset );
+		ndp->desc[i].offset = cpu_to_le16 ( offset );
+		ndp->desc[i].len = cpu_to_le16 ( iob_len ( pkts[i] ) );
+		memcpy ( ( ntb->data + offset ), pkts[i]->data,
+			 iob_len ( pkts[i] ) );
+		offset += iob_len ( pkts[i] );
+	}
+	DBGC2 ( ncm, "NCM %p aggregated %d datagrams into %zd-byte NTB\n",
+		ncm, count, len );
+
+	/* Enqueue NTB */
+	if ( ( rc = usb_stream ( &ncm->usbnet.out, ntb, 0 ) ) != 0 )
+		goto err_stream;
+
+	/* Increment sequence number */
+	ncm->sequence++;
+
+	profile_stop ( &ncm_out_aggregate_profiler );
+	return 0;
+
+ err_stream:
+	free_iob ( ntb );
+ err_alloc:
+	profile_stop ( &ncm_out_aggregate_profiler );
+	return rc;
+}
+
+/**
+ * Transmit packets awaiting aggregation
+ *
+ * @v ncm		CDC-NCM device
+ */
+static void ncm_out_flush ( struct ncm_device *ncm ) {
+	struct net_device *netdev = ncm->netdev;
+	struct io_buffer *pkts[NCM_OUT_MAX_DATAGRAMS];
+	unsigned int count = ncm->pending_count;
+	unsigned int i;
+	int rc;
+
+	/* Do nothing unless packets are pending */
+	if ( ! count )
+		return;
+
+	/* Take ownership of pending packets, since any failed
+	 * transmission may cause deferred packets to be transmitted.
+	 */
+	memcpy ( pkts, ncm->pending, ( count * sizeof ( pkts[0] ) ) );
+	ncm->pending_count = 0;
+	ncm->pending_len = 0;
+
+	/* Transmit packets, avoiding a copy for a lone packet */
+	if ( count == 1 ) {
+		rc = ncm_out_transmit ( ncm, pkts[0] );
+	} else {
+		rc = ncm_out_aggregate ( ncm, pkts, count );
+	}
+
+	/* Fail all packets on error */
+	if ( rc != 0 ) {
+		DBGC ( ncm, "NCM %p could not transmit %d datagrams: %s\n",
+		       ncm, count, strerror ( rc ) );
+		for ( i = 0 ; i < count ; i++ )
+			netdev_tx_complete_err ( netdev, pkts[i], rc );
+	}
+}
+
+/**
+ * Queue packet for transmission
+ *
+ * @v ncm		CDC-NCM device
+ * @v iobuf		I/O buffer
+ *
+ * The packet will be aggregated with any other packets transmitted
+ * before the next poll, and will be transmitted immediately if no
+ * further packets can fit within the NTB.
+ */
+static void ncm_out_enqueue ( struct ncm_device *ncm,
+			      struct io_buffer *iobuf ) {
+	size_t len = ( iob_len ( iobuf ) + ncm->divisor - 1 );
+	size_t max_len;
+
+	/* Flush pending packets if this packet will not fit */
+	max_len = ( sizeof ( struct ncm_transfer_header ) +
+		    sizeof ( struct ncm_datagram_pointer ) +
+		    ( ( ncm->pending_count + 2 ) *
+		      sizeof ( struct ncm_datagram_descriptor ) ) +
+		    ncm->pending_len + len );
+	if ( max_len > ncm->out_mtu )
+		ncm_out_flush ( ncm );
+
+	/* Add to pending packets */
+	ncm->pending[ ncm->pending_count++ ] = iobuf;
+	ncm->pending_len += len;
+
+	/* Flush pending packets if NTB is now full */
+	if ( ncm->pending_count >= ncm->out_max )
+		ncm_out_flush ( ncm );
+}
+
 /**
  * Complete bulk OUT transfer
  *
@@ -406,9 +581,33 @@ static void ncm_out_complete ( struct usb_endpoint *ep, struct io_buffer *iobuf,
 	struct ncm_device *ncm = container_of ( ep, struct ncm_device,
 						usbnet.out );
 	struct net_device *netdev = ncm->netdev;
+	struct ncm_transfer_header *nth = iobuf->data;
+	struct ncm_datagram_pointer *ndp;
+	struct io_buffer *pkt;
+	unsigned int count;
 
-	/* Report TX completion */
-	netdev_tx_complete_err ( netdev, iobuf, rc );
+	/* Report TX completion for a lone (uncopied) packet */
+	if ( iobuf == list_first_entry ( &netdev->tx_queue, struct io_buffer,
+					 list ) ) {
+		netdev_tx_complete_err ( netdev, iobuf, rc );
+		return;
+	}
+
+	/* Otherwise, this is an NTB that we constructed.  Packets are
+	 * appended to the transmit queue as they are transmitted, and
+	 * NTBs complete in order, so the aggregated packets are those
+	 * at the head of the transmit queue.
+	 */
+	ndp = ( iobuf->data + le16_to_cpu ( nth->offset ) );
+	count = ( ( ( le16_to_cpu ( ndp->header_len ) - sizeof ( *ndp ) ) /
+		    sizeof ( ndp->desc[0] ) ) - 1 );
+	while ( count-- ) {
+		pkt = list_first_entry ( &netdev->tx_queue, struct io_buffer,
+					 list );
+		assert ( pkt != NULL );
+		netdev_tx_complete_err ( netdev, pkt, rc );
+	}
+	free_iob ( iobuf );
 }
 
 /** Bulk OUT endpoint operations */
@@ -435,8 +634,10 @@ static int ncm_open ( struct net_device *netdev ) {
 	struct ncm_set_ntb_input_size size;
 	int rc;
 
-	/* Reset sequence number */
+	/* Reset sequence number and pending packets */
 	ncm->sequence = 0;
+	ncm->pending_count = 0;
+	ncm->pending_len = 0;
 
 	/* Prefill I/O buffers */
 	if ( ( rc = ncm_in_prefill ( ncm ) ) != 0 )
@@ -489,6 +690,12 @@ static void ncm_close ( struct net_device *netdev ) {
 
 	/* Close USB network device */
 	usbnet_close ( &ncm->usbnet );
+
+	/* Discard pending packets (which will be cancelled by the
+	 * network device core).
+	 */
+	ncm->pending_count = 0;
+	ncm->pending_len = 0;
 }
 
 /**
@@ -501,15 +708,25 @@ static void ncm_close ( struct net_device *netdev ) {
 static int ncm_transmit ( struct net_device *netdev,
 			  struct io_buffer *iobuf ) {
 	struct ncm_device *ncm = netdev->priv;
-	int rc;
 
-	/* Transmit packet */
-	if ( ( rc = ncm_out_transmit ( ncm, iobuf ) ) != 0 )
-		return rc;
+	/* Queue packet for aggregation */
+	ncm_out_enqueue ( ncm, iobuf );
 
 	return 0;
 }
 
+/**
+ * Flush batched transmissions
+ *
+ * @v netdev		Network device
+ */
+static void ncm_flush ( struct net_device *netdev ) {
+	struct ncm_device *ncm = netdev->priv;
+
+	/* Transmit any packets awaiting aggregation */
+	ncm_out_flush ( ncm );
+}
+
 /**
  * Poll for completed and received packets
  *
@@ -522,6 +739,9 @@ static void ncm_poll ( struct net_device *netdev ) {
 	/* Poll USB bus */
 	usb_poll ( ncm->bus );
 
+	/* Transmit any packets awaiting aggregation */
+	ncm_out_flush ( ncm );
+
 	/* Refill endpoints */
 	if ( ( rc = usbnet_refill ( &ncm->usbnet ) ) != 0 )
 		netdev_rx_err ( netdev, NULL, rc );
@@ -534,6 +754,7 @@ static struct net_device_operations ncm_operations = {
 	.close		= ncm_close,
 	.transmit	= ncm_transmit,
 	.poll		= ncm_poll,
+	.flush		= ncm_flush,
 };
 
 /******************************************************************************
@@ -627,6 +848,18 @@ static int ncm_probe ( struct usb_function *func,
 		ncm, ncm->padding );
 	assert ( ( ( sizeof ( struct ncm_ntb_header ) + ncm->padding +
 		     ETH_HLEN ) % divisor ) == remainder );
+	ncm->divisor = divisor;
+	ncm->remainder = remainder;
+
+	/* Get transmit aggregation limits */
+	ncm->out_mtu = le32_to_cpu ( params.out.mtu );
+	if ( ( ! ncm->out_mtu ) || ( ncm->out_mtu > NCM_OUT_MAX_SIZE ) )
+		ncm->out_mtu = NCM_OUT_MAX_SIZE;
+	ncm->out_max = le16_to_cpu ( params.max );
+	if ( ( ! ncm->out_max ) || ( ncm->out_max > NCM_OUT_MAX_DATAGRAMS ) )
+		ncm->out_max = NCM_OUT_MAX_DATAGRAMS;
+	DBGC2 ( ncm, "NCM %p aggregating up to %d datagrams in %zd bytes\n",
+		ncm, ncm->out_max, ncm->out_mtu );
 
 	/* Register network device */
 	if ( ( rc = register_netdev ( netdev ) ) != 0 )
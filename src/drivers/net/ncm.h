@@ -132,6 +132,18 @@ struct ncm_ntb_header {
 	struct ncm_datagram_descriptor desc[2];
 } __attribute__ (( packed ));
 
+/** Maximum number of datagrams per transmitted NTB
+ *
+ * This is a policy decision.
+ */
+#define NCM_OUT_MAX_DATAGRAMS 8
+
+/** Maximum transmitted NTB size
+ *
+ * This is a policy decision.
+ */
+#define NCM_OUT_MAX_SIZE 16384
+
 /** A CDC-NCM network device */
 struct ncm_device {
 	/** USB device */
@@ -149,6 +161,21 @@ struct ncm_device {
 	uint16_t sequence;
 	/** Alignment padding required on transmitted packets */
 	size_t padding;
+	/** Transmitted datagram alignment divisor */
+	unsigned int divisor;
+	/** Transmitted datagram alignment remainder */
+	unsigned int remainder;
+	/** Maximum transmitted NTB size */
+	size_t out_mtu;
+	/** Maximum number of datagrams per transmitted NTB */
+	unsigned int out_max;
+
+	/** Packets awaiting aggregation into a transmitted NTB */
+	struct io_buffer *pending[NCM_OUT_MAX_DATAGRAMS];
+	/** Number of packets awaiting aggregation */
+	unsigned int pending_count;
+	/** Maximum total padded length of packets awaiting aggregation */
+	size_t pending_len;
 };
 
 /** Bulk IN ring minimum buffer count
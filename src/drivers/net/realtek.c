@@ -638,10 +638,11 @@ static void realtek_refill_rx ( struct realtek_nic *rtl ) {
 	if ( rtl->legacy )
 		return;
 
-	while ( ( rtl->rx.prod - rtl->rx.cons ) < RTL_NUM_RX_DESC ) {
+	while ( ( rtl->rx.prod - rtl->rx.cons ) < rtl->rx_fill ) {
 
 		/* Allocate I/O buffer */
-		iobuf = alloc_rx_iob ( RTL_RX_MAX_LEN, rtl->dma );
+		iobuf = alloc_rx_iob_pool ( rtl->rx_pool, RTL_RX_MAX_LEN,
+					   rtl->dma );
 		if ( ! iobuf ) {
 			/* Wait for next refill */
 			return;
@@ -689,6 +690,7 @@ static int realtek_open ( struct net_device *netdev ) {
 	/* Create receive descriptor ring */
 	if ( ( rc = realtek_create_ring ( rtl, &rtl->rx ) ) != 0 )
 		goto err_create_rx;
+	rtl->rx_fill = netdev_rx_fill ( netdev, RTL_RX_FILL, RTL_NUM_RX_DESC );
 
 	/* Create receive buffer */
 	if ( ( rc = realtek_create_buffer ( rtl ) ) != 0 )
@@ -1002,6 +1004,10 @@ static void realtek_poll ( struct net_device *netdev ) {
 	if ( isr & ( RTL_IRQ_RER | RTL_IRQ_ROK ) )
 		realtek_poll_rx ( netdev );
 
+	/* Report receive overruns */
+	if ( isr & RTL_IRQ_RDU )
+		netdev_rx_err ( netdev, NULL, -ENOBUFS_RX_OVERRUN );
+
 	/* Check link state, if applicable */
 	if ( isr & RTL_IRQ_PUN_LINKCHG )
 		realtek_check_link ( netdev );
@@ -1138,6 +1144,7 @@ static int realtek_probe ( struct pci_device *pci ) {
 
 	/* Configure DMA */
 	rtl->dma = &pci->dma;
+	rtl->rx_pool = &netdev->rx_pool;
 
 	/* Reset the NIC */
 	if ( ( rc = realtek_reset ( rtl ) ) != 0 )
@@ -124,6 +124,7 @@ enum realtek_legacy_status {
 /** Interrupt Mask Register (word) */
 #define RTL_IMR 0x3c
 #define RTL_IRQ_PUN_LINKCHG	0x0020	/**< Packet underrun / link change */
+#define RTL_IRQ_RDU		0x0010	/**< Receive descriptor unavailable */
 #define RTL_IRQ_TER		0x0008	/**< Transmit error */
 #define RTL_IRQ_TOK		0x0004	/**< Transmit OK */
 #define RTL_IRQ_RER		0x0002	/**< Receive error */
@@ -238,7 +239,10 @@ enum realtek_legacy_status {
 #define RTL_RDSAR 0xe4
 
 /** Number of receive descriptors */
-#define RTL_NUM_RX_DESC 4
+#define RTL_NUM_RX_DESC 16
+
+/** Default receive descriptor ring fill level */
+#define RTL_RX_FILL 4
 
 /** Receive buffer length */
 #define RTL_RX_MAX_LEN \
@@ -291,6 +295,8 @@ struct realtek_nic {
 	void *regs;
 	/** DMA device */
 	struct dma_device *dma;
+	/** Receive I/O buffer pool */
+	struct iob_pool *rx_pool;
 	/** SPI bit-bashing interface */
 	struct spi_bit_basher spibit;
 	/** EEPROM */
@@ -313,6 +319,8 @@ struct realtek_nic {
 	struct realtek_ring tx;
 	/** Receive descriptor ring */
 	struct realtek_ring rx;
+	/** Receive descriptor ring fill level */
+	unsigned int rx_fill;
 	/** Receive I/O buffers */
 	struct io_buffer *rx_iobuf[RTL_NUM_RX_DESC];
 	/** Receive buffer (legacy mode) */
@@ -24,6 +24,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <ipxe/list.h>
 #include <ipxe/iobuf.h>
@@ -32,6 +33,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/dma.h>
 #include <ipxe/if_ether.h>
 #include <ipxe/ethernet.h>
+#include <ipxe/tcpip.h>
 #include <ipxe/virtio-pci.h>
 #include <ipxe/virtio-ring.h>
 #include "virtio-net.h"
@@ -78,8 +80,19 @@ enum {
 	QUEUE_NB
 };
 
-/** Max number of pending rx packets */
-#define NUM_RX_BUF 8
+/** Max number of pending rx packets
+ *
+ * The receive ring is filled to the size of the receive virtqueue,
+ * up to this limit.
+ */
+#define NUM_RX_BUF 32
+
+/** Features supported by this driver */
+#define VIRTNET_FEATURES ( ( 1ULL << VIRTIO_NET_F_MAC ) |		\
+			   ( 1ULL << VIRTIO_NET_F_MTU ) |		\
+			   ( 1ULL << VIRTIO_NET_F_GUEST_CSUM ) |	\
+			   ( 1ULL << VIRTIO_NET_F_MRG_RXBUF ) |	\
+			   ( 1ULL << VIRTIO_RING_F_EVENT_IDX ) )
 
 struct virtnet_nic {
 	/** Base pio register address */
@@ -88,6 +101,9 @@ struct virtnet_nic {
 	/** 0 for legacy, 1 for virtio 1.0 */
 	int virtio_version;
 
+	/** Negotiated features */
+	u64 features;
+
 	/** Virtio 1.0 device data */
 	struct virtio_pci_modern_device vdev;
 
@@ -100,39 +116,111 @@ struct virtnet_nic {
 	/** Pending rx packet count */
 	unsigned int rx_num_iobufs;
 
+	/** Maximum pending rx packet count */
+	unsigned int rx_fill;
+
 	/** DMA device */
 	struct dma_device *dma;
 
 };
 
+/** Check if mergeable receive buffers are in use
+ *
+ * @v virtnet		Virtio-net device
+ * @ret mrg_rxbuf	Mergeable receive buffers are in use
+ */
+static inline int virtnet_mrg_rxbuf ( struct virtnet_nic *virtnet ) {
+
+	return ( virtnet->features & ( 1ULL << VIRTIO_NET_F_MRG_RXBUF ) );
+}
+
+/** Get length of virtio net header
+ *
+ * @v virtnet		Virtio-net device
+ * @ret len		Length of header
+ */
+static inline size_t virtnet_header_len ( struct virtnet_nic *virtnet ) {
+
+	return ( ( virtnet->virtio_version || virtnet_mrg_rxbuf ( virtnet ) ) ?
+		 sizeof ( struct virtio_net_hdr_modern ) :
+		 sizeof ( struct virtio_net_hdr ) );
+}
+
+/** Complete a partially checksummed received packet
+ *
+ * @v virtnet		Virtio-net device
+ * @v header		Virtio net header
+ * @v iobuf		I/O buffer (with header stripped)
+ * @ret rc		Return status code
+ *
+ * A packet marked as needing a checksum (e.g. one sent from the same
+ * host) carries only a partial checksum within its transport-layer
+ * header.  The packet may be passed unmodified to external network
+ * stacks (via SNP or UNDI), so calculate the full checksum here
+ * rather than merely skipping verification.
+ */
+static int virtnet_complete_csum ( struct virtnet_nic *virtnet,
+				   struct virtio_net_hdr *header,
+				   struct io_buffer *iobuf ) {
+	size_t start = le16_to_cpu ( header->csum_start );
+	size_t offset = le16_to_cpu ( header->csum_offset );
+	size_t len = iob_len ( iobuf );
+	uint16_t *csum;
+
+	/* Sanity check */
+	if ( ( start > len ) ||
+	     ( ( offset + sizeof ( *csum ) ) > ( len - start ) ) ) {
+		DBGC ( virtnet, "VIRTIO-NET %p rx invalid checksum location "
+		       "%zd+%zd (len %zd)\n", virtnet, start, offset, len );
+		return -EINVAL;
+	}
+
+	/* Calculate checksum */
+	csum = ( iobuf->data + start + offset );
+	*csum = tcpip_chksum ( ( iobuf->data + start ), ( len - start ) );
+
+	return 0;
+}
+
+/** Kick a virtqueue
+ *
+ * @v netdev		Network device
+ * @v vq_idx		Virtqueue index (RX_INDEX or TX_INDEX)
+ * @v num_added		Number of iobufs added since the last kick
+ */
+static void virtnet_kick ( struct net_device *netdev, int vq_idx,
+			   unsigned int num_added ) {
+	struct virtnet_nic *virtnet = netdev->priv;
+	struct vring_virtqueue *vq = &virtnet->virtqueue[vq_idx];
+
+	vring_kick ( virtnet->virtio_version ? &virtnet->vdev : NULL,
+		     virtnet->ioaddr, vq, num_added );
+}
+
 /** Add an iobuf to a virtqueue
  *
  * @v netdev		Network device
  * @v vq_idx		Virtqueue index (RX_INDEX or TX_INDEX)
  * @v iobuf		I/O buffer
+ * @v num_added		Number of iobufs already added since the last kick
  *
- * The virtqueue is kicked after the iobuf has been added.
+ * The virtqueue must subsequently be kicked using virtnet_kick().
  */
-static void virtnet_enqueue_iob ( struct net_device *netdev,
-				  int vq_idx, struct io_buffer *iobuf ) {
+static void virtnet_enqueue_iob ( struct net_device *netdev, int vq_idx,
+				  struct io_buffer *iobuf,
+				  unsigned int num_added ) {
 	struct virtnet_nic *virtnet = netdev->priv;
 	struct vring_virtqueue *vq = &virtnet->virtqueue[vq_idx];
 	struct virtio_net_hdr_modern *header = vq->empty_header;
 	unsigned int out = ( vq_idx == TX_INDEX ) ? 2 : 0;
 	unsigned int in = ( vq_idx == TX_INDEX ) ? 0 : 2;
-	size_t header_len = ( virtnet->virtio_version ?
-			      sizeof ( *header ) : sizeof ( header->legacy ) );
+	size_t header_len = virtnet_header_len ( virtnet );
 	struct vring_list list[] = {
 		{
 			/* Share a single zeroed virtio net header between all
-			 * packets in a ring.  This works because this driver
-			 * does not use any advanced features so none of the
-			 * header fields get used.
-			 *
-			 * Some host implementations (notably Google Compute
-			 * Platform) are known to unconditionally write back
-			 * to header->flags for received packets.  Work around
-			 * this by using separate RX and TX headers.
+			 * transmitted packets.  This works because this
+			 * driver does not use any advanced transmit features
+			 * so none of the header fields get used.
 			 */
 			.addr = dma ( &vq->map, header ),
 			.length = header_len,
@@ -143,12 +231,28 @@ static void virtnet_enqueue_iob ( struct net_device *netdev,
 		},
 	};
 
+	/* Received packets carry per-packet information (such as the
+	 * checksum validity flags) in the header, so receive each
+	 * header into the start of its own I/O buffer.
+	 */
+	if ( vq_idx == RX_INDEX ) {
+		list[0].addr = iob_dma ( iobuf );
+		list[1].addr = ( iob_dma ( iobuf ) + header_len );
+		list[1].length = ( iob_len ( iobuf ) - header_len );
+	}
+
+	/* Mergeable receive buffers must be usable for packet data
+	 * as well as for the header, so use a single descriptor.
+	 */
+	if ( ( vq_idx == RX_INDEX ) && virtnet_mrg_rxbuf ( virtnet ) ) {
+		list[0].length = iob_len ( iobuf );
+		in = 1;
+	}
+
 	DBGC2 ( virtnet, "VIRTIO-NET %p enqueuing iobuf %p on vq %d\n",
 		virtnet, iobuf, vq_idx );
 
-	vring_add_buf ( vq, list, out, in, iobuf, 0 );
-	vring_kick ( virtnet->virtio_version ? &virtnet->vdev : NULL,
-		     virtnet->ioaddr, vq, 1 );
+	vring_add_buf ( vq, list, out, in, iobuf, num_added );
 }
 
 /** Try to keep rx virtqueue filled with iobufs
@@ -157,9 +261,11 @@ static void virtnet_enqueue_iob ( struct net_device *netdev,
  */
 static void virtnet_refill_rx_virtqueue ( struct net_device *netdev ) {
 	struct virtnet_nic *virtnet = netdev->priv;
-	size_t len = ( netdev->max_pkt_len + 4 /* VLAN */ );
+	size_t len = ( virtnet_header_len ( virtnet ) +
+		       netdev->max_pkt_len + 4 /* VLAN */ );
+	unsigned int num_added = 0;
 
-	while ( virtnet->rx_num_iobufs < NUM_RX_BUF ) {
+	while ( virtnet->rx_num_iobufs < virtnet->rx_fill ) {
 		struct io_buffer *iobuf;
 
 		/* Try to allocate a buffer, stop for now if out of memory */
@@ -173,9 +279,44 @@ static void virtnet_refill_rx_virtqueue ( struct net_device *netdev ) {
 		/* Mark packet length until we know the actual size */
 		iob_put ( iobuf, len );
 
-		virtnet_enqueue_iob ( netdev, RX_INDEX, iobuf );
+		virtnet_enqueue_iob ( netdev, RX_INDEX, iobuf, num_added++ );
 		virtnet->rx_num_iobufs++;
 	}
+
+	/* Notify device of all new buffers at once */
+	if ( num_added )
+		virtnet_kick ( netdev, RX_INDEX, num_added );
+}
+
+/** Initialise rx/tx virtqueues for use
+ *
+ * @v netdev		Network device
+ */
+static void virtnet_init_virtqueues ( struct net_device *netdev ) {
+	struct virtnet_nic *virtnet = netdev->priv;
+	struct vring_virtqueue *rx_vq = &virtnet->virtqueue[RX_INDEX];
+	unsigned int descs;
+	int i;
+
+	/* Use event index notification suppression, if negotiated */
+	for ( i = 0; i < QUEUE_NB; i++ ) {
+		virtnet->virtqueue[i].event =
+			( !! ( virtnet->features &
+			       ( 1ULL << VIRTIO_RING_F_EVENT_IDX ) ) );
+	}
+
+	/* Size rx fill level to the rx virtqueue */
+	descs = ( virtnet_mrg_rxbuf ( virtnet ) ? 1 : 2 );
+	virtnet->rx_fill = ( rx_vq->vring.num / descs );
+	if ( virtnet->rx_fill > NUM_RX_BUF )
+		virtnet->rx_fill = NUM_RX_BUF;
+	DBGC ( virtnet, "VIRTIO-NET %p features %#08llx rx fill %d/%d\n",
+	       virtnet, ( ( unsigned long long ) virtnet->features ),
+	       virtnet->rx_fill, rx_vq->vring.num );
+
+	/* Initialize rx packets */
+	INIT_LIST_HEAD ( &virtnet->rx_iobufs );
+	virtnet->rx_num_iobufs = 0;
 }
 
 /** Helper to free all virtqueue memory
@@ -209,6 +350,11 @@ static int virtnet_open_legacy ( struct net_device *netdev ) {
 	/* Reset for sanity */
 	vp_reset ( ioaddr );
 
+	/* Negotiate features */
+	features = vp_get_features ( ioaddr );
+	virtnet->features = ( features & VIRTNET_FEATURES );
+	vp_set_features ( ioaddr, virtnet->features );
+
 	/* Allocate virtqueues */
 	virtnet->virtqueue = zalloc ( QUEUE_NB *
 				      sizeof ( *virtnet->virtqueue ) );
@@ -227,17 +373,13 @@ static int virtnet_open_legacy ( struct net_device *netdev ) {
 	}
 
 	/* Initialize rx packets */
-	INIT_LIST_HEAD ( &virtnet->rx_iobufs );
-	virtnet->rx_num_iobufs = 0;
+	virtnet_init_virtqueues ( netdev );
 	virtnet_refill_rx_virtqueue ( netdev );
 
 	/* Disable interrupts before starting */
 	netdev_irq ( netdev, 0 );
 
 	/* Driver is ready */
-	features = vp_get_features ( ioaddr );
-	vp_set_features ( ioaddr, features & ( ( 1 << VIRTIO_NET_F_MAC ) |
-					       ( 1 << VIRTIO_NET_F_MTU ) ) );
 	vp_set_status ( ioaddr, VIRTIO_CONFIG_S_DRIVER | VIRTIO_CONFIG_S_DRIVER_OK );
 	return 0;
 }
@@ -258,9 +400,8 @@ static int virtnet_open_modern ( struct net_device *netdev ) {
 		vpm_add_status ( &virtnet->vdev, VIRTIO_CONFIG_S_FAILED );
 		return -EINVAL;
 	}
-	vpm_set_features ( &virtnet->vdev, features & (
-		( 1ULL << VIRTIO_NET_F_MAC ) |
-		( 1ULL << VIRTIO_NET_F_MTU ) |
+	virtnet->features = ( features & VIRTNET_FEATURES );
+	vpm_set_features ( &virtnet->vdev, features & ( VIRTNET_FEATURES |
 		( 1ULL << VIRTIO_F_VERSION_1 ) |
 		( 1ULL << VIRTIO_F_ANY_LAYOUT ) |
 		( 1ULL << VIRTIO_F_IOMMU_PLATFORM ) ) );
@@ -292,14 +433,14 @@ static int virtnet_open_modern ( struct net_device *netdev ) {
 		return -ENOENT;
 	}
 
+	/* Initialize rx packets */
+	virtnet_init_virtqueues ( netdev );
+
 	/* Disable interrupts before starting */
 	netdev_irq ( netdev, 0 );
 
 	vpm_add_status ( &virtnet->vdev, VIRTIO_CONFIG_S_DRIVER_OK );
 
-	/* Initialize rx packets */
-	INIT_LIST_HEAD ( &virtnet->rx_iobufs );
-	virtnet->rx_num_iobufs = 0;
 	virtnet_refill_rx_virtqueue ( netdev );
 	return 0;
 }
@@ -353,7 +494,8 @@ static void virtnet_close ( struct net_device *netdev ) {
  */
 static int virtnet_transmit ( struct net_device *netdev,
 			      struct io_buffer *iobuf ) {
-	virtnet_enqueue_iob ( netdev, TX_INDEX, iobuf );
+	virtnet_enqueue_iob ( netdev, TX_INDEX, iobuf, 0 );
+	virtnet_kick ( netdev, TX_INDEX, 1 );
 	return 0;
 }
 
@@ -375,6 +517,81 @@ static void virtnet_process_tx_packets ( struct net_device *netdev ) {
 	}
 }
 
+/** Retrieve a filled rx iobuf
+ *
+ * @v netdev		Network device
+ * @ret iobuf		I/O buffer
+ */
+static struct io_buffer * virtnet_get_rx_iob ( struct net_device *netdev ) {
+	struct virtnet_nic *virtnet = netdev->priv;
+	struct vring_virtqueue *rx_vq = &virtnet->virtqueue[RX_INDEX];
+	struct io_buffer *iobuf;
+	unsigned int len;
+
+	/* Release ownership of iobuf */
+	iobuf = vring_get_buf ( rx_vq, &len );
+	list_del ( &iobuf->list );
+	virtnet->rx_num_iobufs--;
+
+	/* Update iobuf length */
+	iob_unput ( iobuf, iob_len ( iobuf ) );
+	iob_put ( iobuf, len );
+
+	return iobuf;
+}
+
+/** Merge a packet spread across multiple mergeable rx buffers
+ *
+ * @v netdev		Network device
+ * @v iobuf		First I/O buffer (with header stripped)
+ * @v count		Number of remaining buffers
+ * @ret iobuf		Merged I/O buffer, or NULL on error
+ *
+ * This function takes ownership of the first I/O buffer.
+ */
+static struct io_buffer * virtnet_merge_rx ( struct net_device *netdev,
+					     struct io_buffer *iobuf,
+					     unsigned int count ) {
+	struct virtnet_nic *virtnet = netdev->priv;
+	struct vring_virtqueue *rx_vq = &virtnet->virtqueue[RX_INDEX];
+	struct io_buffer *tmp;
+	struct io_buffer *merged;
+	LIST_HEAD ( list );
+	int rc;
+
+	/* Gather remaining buffers */
+	iob_unmap ( iobuf );
+	list_add_tail ( &iobuf->list, &list );
+	while ( count-- ) {
+		if ( ! vring_more_used ( rx_vq ) ) {
+			DBGC ( virtnet, "VIRTIO-NET %p rx missing %d merged "
+			       "buffers\n", virtnet, ( count + 1 ) );
+			rc = -EINVAL;
+			goto err;
+		}
+		iobuf = virtnet_get_rx_iob ( netdev );
+		iob_unmap ( iobuf );
+		list_add_tail ( &iobuf->list, &list );
+	}
+
+	/* Concatenate buffers */
+	merged = iob_concatenate ( &list );
+	if ( ! merged ) {
+		rc = -ENOMEM;
+		goto err;
+	}
+
+	return merged;
+
+ err:
+	list_for_each_entry_safe ( iobuf, tmp, &list, list ) {
+		list_del ( &iobuf->list );
+		free_iob ( iobuf );
+	}
+	netdev_rx_err ( netdev, NULL, rc );
+	return NULL;
+}
+
 /** Complete packet reception
  *
  * @v netdev	Network device
@@ -382,21 +599,55 @@ static void virtnet_process_tx_packets ( struct net_device *netdev ) {
 static void virtnet_process_rx_packets ( struct net_device *netdev ) {
 	struct virtnet_nic *virtnet = netdev->priv;
 	struct vring_virtqueue *rx_vq = &virtnet->virtqueue[RX_INDEX];
+	size_t header_len = virtnet_header_len ( virtnet );
 
 	while ( vring_more_used ( rx_vq ) ) {
-		unsigned int len;
-		struct io_buffer *iobuf = vring_get_buf ( rx_vq, &len );
+		struct io_buffer *iobuf = virtnet_get_rx_iob ( netdev );
+		struct virtio_net_hdr_modern header;
+		unsigned int num_buffers;
+		int rc;
+
+		/* Discard packets too short to contain a header */
+		if ( iob_len ( iobuf ) < header_len ) {
+			DBGC ( virtnet, "VIRTIO-NET %p rx underlength iobuf "
+			       "%p len %zd\n", virtnet, iobuf,
+			       iob_len ( iobuf ) );
+			netdev_rx_err ( netdev, iobuf, -EINVAL );
+			continue;
+		}
 
-		/* Release ownership of iobuf */
-		list_del ( &iobuf->list );
-		virtnet->rx_num_iobufs--;
+		/* Strip header */
+		memcpy ( &header, iobuf->data, header_len );
+		iob_pull ( iobuf, header_len );
+
+		/* Merge any packet spread across multiple buffers */
+		num_buffers = ( virtnet_mrg_rxbuf ( virtnet ) ?
+				le16_to_cpu ( header.num_buffers ) : 1 );
+		if ( num_buffers > 1 ) {
+			iobuf = virtnet_merge_rx ( netdev, iobuf,
+						   ( num_buffers - 1 ) );
+			if ( ! iobuf )
+				continue;
+		}
 
-		/* Update iobuf length */
-		iob_unput ( iobuf, iob_len ( iobuf ) );
-		iob_put ( iobuf, len - sizeof ( struct virtio_net_hdr ) );
+		/* Complete any partial checksum, and note any checksum
+		 * already verified.
+		 */
+		if ( header.legacy.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM ) {
+			if ( ( rc = virtnet_complete_csum ( virtnet,
+							    &header.legacy,
+							    iobuf ) ) != 0 ) {
+				netdev_rx_err ( netdev, iobuf, rc );
+				continue;
+			}
+			iobuf->flags |= IOB_FL_CSUM_OK;
+		} else if ( header.legacy.flags & VIRTIO_NET_HDR_F_DATA_VALID ) {
+			iobuf->flags |= IOB_FL_CSUM_OK;
+		}
 
-		DBGC2 ( virtnet, "VIRTIO-NET %p rx complete iobuf %p len %zd\n",
-			virtnet, iobuf, iob_len ( iobuf ) );
+		DBGC2 ( virtnet, "VIRTIO-NET %p rx complete iobuf %p len %zd "
+			"(%d buffers)\n", virtnet, iobuf, iob_len ( iobuf ),
+			num_buffers );
 
 		/* Pass completed packet to the network stack */
 		netdev_rx ( netdev, iobuf );
@@ -122,15 +122,35 @@ static int vmxnet3_transmit ( struct net_device *netdev,
 	tx_desc->flags[0] = ( generation | cpu_to_le32 ( iob_len ( iobuf ) ) );
 	tx_desc->flags[1] = cpu_to_le32 ( VMXNET3_TXF_CQ | VMXNET3_TXF_EOP );
 
-	/* Hand over descriptor to NIC */
+	/* Hand over descriptor to NIC, unless the notification is
+	 * being deferred until the batch is flushed
+	 */
 	wmb();
+	if ( ! netdev_tx_batching ( netdev ) ) {
+		profile_start ( &vmxnet3_vm_tx_profiler );
+		writel ( ( vmxnet->count.tx_prod % VMXNET3_NUM_TX_DESC ),
+			 ( vmxnet->pt + VMXNET3_PT_TXPROD ) );
+		profile_stop ( &vmxnet3_vm_tx_profiler );
+		profile_exclude ( &vmxnet3_vm_tx_profiler );
+	}
+
+	return 0;
+}
+
+/**
+ * Flush batched transmissions
+ *
+ * @v netdev		Network device
+ */
+static void vmxnet3_flush ( struct net_device *netdev ) {
+	struct vmxnet3_nic *vmxnet = netdev->priv;
+
+	/* Hand over all queued descriptors to NIC */
 	profile_start ( &vmxnet3_vm_tx_profiler );
 	writel ( ( vmxnet->count.tx_prod % VMXNET3_NUM_TX_DESC ),
 		 ( vmxnet->pt + VMXNET3_PT_TXPROD ) );
 	profile_stop ( &vmxnet3_vm_tx_profiler );
 	profile_exclude ( &vmxnet3_vm_tx_profiler );
-
-	return 0;
 }
 
 /**
@@ -214,7 +234,7 @@ static void vmxnet3_refill_rx ( struct net_device *netdev ) {
 	unsigned int generation;
 
 	/* Fill receive ring to specified fill level */
-	while ( vmxnet->count.rx_fill < VMXNET3_RX_FILL ) {
+	while ( vmxnet->count.rx_fill < vmxnet->rx_fill ) {
 
 		/* Locate receive descriptor */
 		desc_idx = ( vmxnet->count.rx_prod % VMXNET3_NUM_RX_DESC );
@@ -255,6 +275,22 @@ static void vmxnet3_refill_rx ( struct net_device *netdev ) {
 	}
 }
 
+/**
+ * Check if hardware has verified received packet's checksum
+ *
+ * @v rx_comp		Receive completion
+ * @ret ok		Transport-layer checksum has been verified
+ */
+static inline int vmxnet3_rx_csum_ok ( struct vmxnet3_rx_comp *rx_comp ) {
+	uint32_t index = le32_to_cpu ( rx_comp->index );
+	uint32_t flags = le32_to_cpu ( rx_comp->flags );
+
+	return ( ( ! ( index & VMXNET3_RXCI_CNC ) ) &&
+		 ( ! ( flags & VMXNET3_RXCF_FRG ) ) &&
+		 ( flags & ( VMXNET3_RXCF_TCP | VMXNET3_RXCF_UDP ) ) &&
+		 ( flags & VMXNET3_RXCF_TUC ) );
+}
+
 /**
  * Poll for received packets
  *
@@ -305,6 +341,8 @@ static void vmxnet3_poll_rx ( struct net_device *netdev ) {
 		DBGC2 ( vmxnet, "VMXNET3 %p completed RX %#x/%#x (len %#zx)\n",
 			vmxnet, comp_idx, desc_idx, len );
 		iob_put ( iobuf, len );
+		if ( vmxnet3_rx_csum_ok ( rx_comp ) )
+			iobuf->flags |= IOB_FL_CSUM_OK;
 		netdev_rx ( netdev, iobuf );
 	}
 }
@@ -500,6 +538,7 @@ static int vmxnet3_open ( struct net_device *netdev ) {
 	shared->misc.version_support = cpu_to_le32 ( VMXNET3_VERSION_SELECT );
 	shared->misc.upt_version_support =
 		cpu_to_le32 ( VMXNET3_UPT_VERSION_SELECT );
+	shared->misc.upt_features = cpu_to_le64 ( VMXNET3_UPT_F_RXCSUM );
 	shared->misc.queue_desc_address = cpu_to_le64 ( queues_bus );
 	shared->misc.queue_desc_len = cpu_to_le32 ( sizeof ( *queues ) );
 	shared->misc.mtu = cpu_to_le32 ( VMXNET3_MTU );
@@ -517,6 +556,10 @@ static int vmxnet3_open ( struct net_device *netdev ) {
 	/* Zero counters */
 	memset ( &vmxnet->count, 0, sizeof ( vmxnet->count ) );
 
+	/* Determine receive ring fill level */
+	vmxnet->rx_fill = netdev_rx_fill ( netdev, VMXNET3_RX_FILL,
+					   VMXNET3_NUM_RX_DESC );
+
 	/* Set MAC address */
 	vmxnet3_set_ll_addr ( vmxnet, &netdev->ll_addr );
 
@@ -570,6 +613,7 @@ static struct net_device_operations vmxnet3_operations = {
 	.transmit	= vmxnet3_transmit,
 	.poll		= vmxnet3_poll,
 	.irq		= vmxnet3_irq,
+	.flush		= vmxnet3_flush,
 };
 
 /**
@@ -336,6 +336,21 @@ struct vmxnet3_rx_comp {
 	uint32_t flags;
 } __attribute__ (( packed ));
 
+/** Receive completion checksum not calculated */
+#define VMXNET3_RXCI_CNC 0x40000000UL
+
+/** Receive completion TCP/UDP checksum is correct */
+#define VMXNET3_RXCF_TUC 0x00010000UL
+
+/** Receive completion is UDP */
+#define VMXNET3_RXCF_UDP 0x00020000UL
+
+/** Receive completion is TCP */
+#define VMXNET3_RXCF_TCP 0x00040000UL
+
+/** Receive completion is an IP fragment */
+#define VMXNET3_RXCF_FRG 0x00400000UL
+
 /** Receive completion generation flag */
 #define VMXNET3_RXCF_GEN 0x80000000UL
 
@@ -424,10 +439,10 @@ struct vmxnet3_queues {
 #define VMXNET3_NUM_TX_COMP 32
 
 /** Number of RX descriptors */
-#define VMXNET3_NUM_RX_DESC 32
+#define VMXNET3_NUM_RX_DESC 64
 
 /** Number of RX completion descriptors */
-#define VMXNET3_NUM_RX_COMP 32
+#define VMXNET3_NUM_RX_COMP 64
 
 /**
  * DMA areas
@@ -478,6 +493,8 @@ struct vmxnet3_nic {
 	struct vmxnet3_dma *dma;
 	/** Producer and consumer counters */
 	struct vmxnet3_counters count;
+	/** Receive ring fill level */
+	unsigned int rx_fill;
 	/** Transmit I/O buffers */
 	struct io_buffer *tx_iobuf[VMXNET3_NUM_TX_DESC];
 	/** Receive I/O buffers */
@@ -490,13 +507,16 @@ struct vmxnet3_nic {
 /** UPT version that we support */
 #define VMXNET3_UPT_VERSION_SELECT 1
 
+/** UPT receive checksum offload feature */
+#define VMXNET3_UPT_F_RXCSUM 0x0001ULL
+
 /** MTU size */
 #define VMXNET3_MTU ( ETH_FRAME_LEN + 4 /* VLAN */ + 4 /* FCS */ )
 
 /** Transmit ring maximum fill level */
 #define VMXNET3_TX_FILL ( VMXNET3_NUM_TX_DESC - 1 )
 
-/** Receive ring maximum fill level */
+/** Receive ring default fill level */
 #define VMXNET3_RX_FILL 8
 
 /** Received packet alignment padding */
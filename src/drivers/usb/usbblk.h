@@ -108,14 +108,19 @@ struct usbblk_device {
 
 /** Maximum length of USB data block
  *
- * This is a policy decision.
+ * This is a policy decision.  Larger blocks reduce the per-transfer
+ * overhead, which dominates throughput on mass storage devices.  A
+ * 16kB block fits within a single xHCI normal TRB or a single EHCI
+ * transfer descriptor with arbitrary alignment.
  */
-#define USBBLK_MAX_LEN 2048
+#define USBBLK_MAX_LEN 16384
 
 /** Maximum endpoint fill level
  *
- * This is a policy decision.
+ * This is a policy decision.  Bulk IN refills are limited to the
+ * number of blocks required by the current command, so this limits
+ * the heap usage only for large transfers.
  */
-#define USBBLK_MAX_FILL 4
+#define USBBLK_MAX_FILL 8
 
 #endif /* _USBBLK_H */
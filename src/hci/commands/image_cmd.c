@@ -50,18 +50,22 @@ struct imgsingle_options {
 	int replace;
 	/** Free image after execution */
 	int autofree;
+	/** Download in background */
+	int background;
 };
 
 /** "img{single}" option list */
 static union {
-	/* "imgexec" takes all three options */
+	/* "imgfetch" takes all options (--replace has no effect) */
+	struct option_descriptor imgfetch[5];
+	/* "imgexec" takes all options except --background */
 	struct option_descriptor imgexec[4];
 	/* Other "img{single}" commands take only --name, --timeout,
 	 * and --autofree
 	 */
 	struct option_descriptor imgsingle[3];
 } opts = {
-	.imgexec = {
+	.imgfetch = {
 		OPTION_DESC ( "name", 'n', required_argument,
 			      struct imgsingle_options, name, parse_string ),
 		OPTION_DESC ( "timeout", 't', required_argument,
@@ -70,6 +74,8 @@ static union {
 			      struct imgsingle_options, autofree, parse_flag ),
 		OPTION_DESC ( "replace", 'r', no_argument,
 			      struct imgsingle_options, replace, parse_flag ),
+		OPTION_DESC ( "background", 'b', no_argument,
+			      struct imgsingle_options, background, parse_flag ),
 	},
 };
 
@@ -102,6 +108,8 @@ struct imgsingle_descriptor {
 static int imgsingle_exec ( int argc, char **argv,
 			    struct imgsingle_descriptor *desc ) {
 	struct imgsingle_options opts;
+	int ( * acquire ) ( const char *name, unsigned long timeout,
+			    struct image **image );
 	char *name_uri = NULL;
 	char *cmdline = NULL;
 	struct image *image;
@@ -123,10 +131,13 @@ static int imgsingle_exec ( int argc, char **argv,
 		}
 	}
 
-	/* Acquire the image */
+	/* Acquire the image, starting a background download if
+	 * requested.  The image will be registered by "imgwait".
+	 */
 	if ( name_uri ) {
-		if ( ( rc = desc->acquire ( name_uri, opts.timeout,
-					    &image ) ) != 0 )
+		acquire = ( opts.background ? imgdownload_background_string :
+			    desc->acquire );
+		if ( ( rc = acquire ( name_uri, opts.timeout, &image ) ) != 0 )
 			goto err_acquire;
 	} else {
 		image = find_image_tag ( &selected_image );
@@ -186,7 +197,7 @@ static int imgsingle_exec ( int argc, char **argv,
 
 /** "imgfetch" command descriptor */
 static struct command_descriptor imgfetch_cmd =
-	COMMAND_DESC ( struct imgsingle_options, opts.imgsingle,
+	COMMAND_DESC ( struct imgsingle_options, opts.imgfetch,
 		       1, MAX_ARGUMENTS, "<uri> [<arguments>...]" );
 
 /** "imgfetch" family command descriptor */
@@ -392,6 +403,44 @@ static int imgfree_exec ( int argc, char **argv ) {
 	return imgmulti_exec ( argc, argv, unregister_image );
 }
 
+/** "imgwait" options */
+struct imgwait_options {
+	/** Download timeout */
+	unsigned long timeout;
+};
+
+/** "imgwait" option list */
+static struct option_descriptor imgwait_opts[] = {
+	OPTION_DESC ( "timeout", 't', required_argument,
+		      struct imgwait_options, timeout, parse_timeout ),
+};
+
+/** "imgwait" command descriptor */
+static struct command_descriptor imgwait_cmd =
+	COMMAND_DESC ( struct imgwait_options, imgwait_opts, 0, 0, NULL );
+
+/**
+ * The "imgwait" command
+ *
+ * @v argc		Argument count
+ * @v argv		Argument list
+ * @ret rc		Return status code
+ */
+static int imgwait_exec ( int argc, char **argv ) {
+	struct imgwait_options opts;
+	int rc;
+
+	/* Parse options */
+	if ( ( rc = parse_options ( argc, argv, &imgwait_cmd, &opts ) ) != 0 )
+		return rc;
+
+	/* Wait for background downloads */
+	if ( ( rc = imgwait ( opts.timeout ) ) != 0 )
+		return rc;
+
+	return 0;
+}
+
 /** Image management commands */
 struct command image_commands[] __command = {
 	{
@@ -442,4 +491,8 @@ struct command image_commands[] __command = {
 		.name = "imgfree",
 		.exec = imgfree_exec,
 	},
+	{
+		.name = "imgwait",
+		.exec = imgwait_exec,
+	},
 };
@@ -267,6 +267,14 @@ struct dhcp_client_id {
 /** User class identifier */
 #define DHCP_USER_CLASS_ID 77
 
+/** Rapid commit
+ *
+ * This zero-length option (defined in RFC 4039) is included in a
+ * DHCPDISCOVER to request a two-message exchange, and in the
+ * resulting DHCPACK to indicate that the lease has been committed.
+ */
+#define DHCP_RAPID_COMMIT 80
+
 /** Client system architecture */
 #define DHCP_CLIENT_ARCHITECTURE 93
 
@@ -86,6 +86,44 @@ struct http_connection {
 	struct interface xfer;
 	/** Pooled connection */
 	struct pooled_connection pool;
+	/** List of open connections */
+	struct list_head list;
+	/** Flags */
+	unsigned int flags;
+	/** Pipelined transactions awaiting their turn
+	 *
+	 * Each transaction within this list has (or will have) sent
+	 * its request on this connection, and will be attached to the
+	 * data transfer interface once all preceding responses have
+	 * been received.
+	 */
+	struct list_head pipeline;
+	/** Received data not consumed by the previous transaction */
+	struct io_buffer *pushback;
+};
+
+/** HTTP connection flags */
+enum http_connection_flags {
+	/** Current transaction permits further requests to be pipelined */
+	HTTP_CONN_PIPELINE = 0x0001,
+	/** Current transaction has sent its request */
+	HTTP_CONN_SENT = 0x0002,
+	/** Response stream is no longer synchronised with requests */
+	HTTP_CONN_DESYNC = 0x0004,
+};
+
+/** An HTTP transaction pipelined on a busy connection */
+struct http_pipelined {
+	/** Reference count */
+	struct refcnt refcnt;
+	/** HTTP connection */
+	struct http_connection *conn;
+	/** List of pipelined transactions */
+	struct list_head list;
+	/** Data transfer interface */
+	struct interface xfer;
+	/** Request has been sent */
+	int sent;
 };
 
 /******************************************************************************
@@ -439,6 +477,8 @@ struct http_transaction {
 
 	/** Transaction state */
 	struct http_state *state;
+	/** Received data being processed, if any */
+	struct io_buffer **rx;
 	/** Accumulated transfer-decoded length */
 	size_t len;
 	/** Chunk length remaining */
@@ -555,7 +595,11 @@ struct http_authentication {
  */
 
 extern char * http_token ( char **line, char **value );
-extern int http_connect ( struct interface *xfer, struct uri *uri );
+extern int http_connect ( struct interface *xfer, struct uri *uri,
+			  int pipeline );
+extern void http_pushback ( struct interface *intf, struct io_buffer *iobuf );
+#define http_pushback_TYPE( object_type ) \
+	typeof ( void ( object_type, struct io_buffer *iobuf ) )
 extern int http_open ( struct interface *xfer, struct http_method *method,
 		       struct uri *uri, struct http_request_range *range,
 		       struct http_request_content *content );
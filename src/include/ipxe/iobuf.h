@@ -12,6 +12,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <stdint.h>
 #include <assert.h>
 #include <ipxe/list.h>
+#include <ipxe/refcnt.h>
 #include <ipxe/dma.h>
 
 /**
@@ -50,8 +51,69 @@ struct io_buffer {
 	void *tail;
 	/** End of the buffer */
         void *end;
+
+	/** Flags
+	 *
+	 * This is the bitwise-OR of zero or more IOB_FL_XXX
+	 * constants.
+	 */
+	unsigned int flags;
+
+	/** Recycling pool to which this buffer belongs, if any */
+	struct iob_pool *pool;
+};
+
+/** Transport-layer checksum has already been verified (e.g. by hardware)
+ *
+ * A network device driver may set this flag on a received packet if
+ * the hardware has verified the TCP or UDP checksum, in which case
+ * the network stack will not verify the checksum again.
+ */
+#define IOB_FL_CSUM_OK 0x0001
+
+/**
+ * A recycling pool of I/O buffers
+ *
+ * I/O buffers allocated from a pool are returned to the pool (rather
+ * than to the heap) when freed, allowing a network device's receive
+ * path to reach a steady state in which no heap allocations are
+ * required.  Each outstanding I/O buffer holds a reference to the
+ * object containing the pool.
+ */
+struct iob_pool {
+	/** Free I/O buffers */
+	struct list_head free;
+	/** Reference counter for containing object */
+	struct refcnt *refcnt;
+	/** Length of each I/O buffer */
+	size_t len;
+	/** Number of free I/O buffers */
+	unsigned int count;
+	/** Maximum number of free I/O buffers to retain */
+	unsigned int max;
+	/** Number of allocations satisfied from the pool */
+	unsigned long hits;
+	/** Number of allocations requiring a new I/O buffer */
+	unsigned long misses;
 };
 
+/** Maximum number of free I/O buffers retained by a network device */
+#define IOB_POOL_MAX 32
+
+/**
+ * Initialise I/O buffer pool
+ *
+ * @v pool		I/O buffer pool
+ * @v max		Maximum number of free I/O buffers to retain
+ * @v refcnt		Containing object reference counter, or NULL
+ */
+static inline void iob_pool_init ( struct iob_pool *pool, unsigned int max,
+				   struct refcnt *refcnt ) {
+	INIT_LIST_HEAD ( &pool->free );
+	pool->refcnt = refcnt;
+	pool->max = max;
+}
+
 /**
  * Reserve space at start of I/O buffer
  *
@@ -192,6 +254,8 @@ static inline void iob_populate ( struct io_buffer *iobuf,
 	iobuf->head = iobuf->data = data;
 	iobuf->tail = ( data + len );
 	iobuf->end = ( data + max_len );
+	iobuf->flags = 0;
+	iobuf->pool = NULL;
 }
 
 /**
@@ -283,6 +347,12 @@ extern void free_iob ( struct io_buffer *iobuf );
 extern struct io_buffer * __malloc alloc_rx_iob ( size_t len,
 						  struct dma_device *dma );
 extern void free_rx_iob ( struct io_buffer *iobuf );
+extern struct io_buffer * iob_pool_alloc ( struct iob_pool *pool,
+					   size_t len );
+extern struct io_buffer * alloc_rx_iob_pool ( struct iob_pool *pool,
+					      size_t len,
+					      struct dma_device *dma );
+extern void iob_pool_flush ( struct iob_pool *pool );
 extern void iob_pad ( struct io_buffer *iobuf, size_t min_len );
 extern int iob_ensure_headroom ( struct io_buffer *iobuf, size_t len );
 extern struct io_buffer * iob_concatenate ( struct list_head *list );
@@ -31,6 +31,12 @@ struct io_buffer;
 #define IP_TOS		0
 #define IP_TTL		64
 
+/** Maximum length of a coalesced received IPv4 packet
+ *
+ * This is a policy decision.
+ */
+#define IPV4_COALESCE_MAX_LEN 16384
+
 /** An IPv4 packet header */
 struct iphdr {
 	uint8_t  verhdrlen;
@@ -13,6 +13,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/list.h>
 #include <ipxe/tables.h>
 #include <ipxe/refcnt.h>
+#include <ipxe/iobuf.h>
 #include <ipxe/settings.h>
 #include <ipxe/interface.h>
 #include <ipxe/retry.h>
@@ -79,6 +80,23 @@ struct net_protocol {
 	int ( * rx ) ( struct io_buffer *iobuf, struct net_device *netdev,
 		       const void *ll_dest, const void *ll_source,
 		       unsigned int flags );
+	/**
+	 * Coalesce received packets
+	 *
+	 * @v iobuf		I/O buffer
+	 * @v next		Next received I/O buffer
+	 * @ret merged		Coalesced I/O buffer, or NULL if not coalesced
+	 *
+	 * This method is optional.  It may be used to merge
+	 * consecutive received packets (from the same network device
+	 * and link-layer source) into a single packet, in order to
+	 * reduce per-packet processing overhead.  If the packets are
+	 * coalesced, then this method takes ownership of both I/O
+	 * buffers.  If the packets are not coalesced, then both I/O
+	 * buffers must be left unmodified.
+	 */
+	struct io_buffer * ( * coalesce ) ( struct io_buffer *iobuf,
+					    struct io_buffer *next );
 	/**
 	 * Transcribe network-layer address
 	 *
@@ -274,6 +292,21 @@ struct net_device_operations {
 	 * supported.
 	 */
 	void ( * irq ) ( struct net_device *netdev, int enable );
+	/** Flush batched transmissions
+	 *
+	 * @v netdev	Network device
+	 *
+	 * While a transmit batch is in progress (as indicated by
+	 * netdev_tx_batching()), the transmit() method may defer
+	 * notifying the hardware of newly queued descriptors.  This
+	 * method must then notify the hardware of all descriptors
+	 * queued since the last notification.
+	 *
+	 * This method may be NULL to indicate that transmit batching
+	 * is not supported, in which case transmit() will never be
+	 * called while batching.
+	 */
+	void ( * flush ) ( struct net_device *netdev );
 };
 
 /** Network device error */
@@ -423,6 +456,21 @@ struct net_device {
 	struct net_device_stats tx_stats;
 	/** RX statistics */
 	struct net_device_stats rx_stats;
+	/** RX I/O buffer pool */
+	struct iob_pool rx_pool;
+	/** Time of most recent activity (in ticks) */
+	unsigned long poll_active;
+	/** Time of most recent poll (in ticks) */
+	unsigned long poll_last;
+	/** Receive ring fill level, or zero to use driver default */
+	unsigned int rx_fill;
+	/** Interrupt holdoff time (in microseconds)
+	 *
+	 * Drivers supporting interrupt moderation will delay raising
+	 * an interrupt by up to this time, to allow several events to
+	 * be coalesced into a single interrupt.
+	 */
+	unsigned int irq_holdoff;
 
 	/** Configuration settings applicable to this device */
 	struct generic_settings settings;
@@ -440,6 +488,19 @@ struct net_device {
 /** Network device interrupts are enabled */
 #define NETDEV_IRQ_ENABLED 0x0002
 
+/** Default interrupt holdoff time (in microseconds) */
+#define NETDEV_IRQ_HOLDOFF 100
+
+/** Receive ring overrun
+ *
+ * Drivers should report packets dropped by the hardware due to a lack
+ * of available receive descriptors using this error, so that ring
+ * overruns can be distinguished from other receive errors.
+ */
+#define ENOBUFS_RX_OVERRUN __einfo_error ( EINFO_ENOBUFS_RX_OVERRUN )
+#define EINFO_ENOBUFS_RX_OVERRUN \
+	__einfo_uniqify ( EINFO_ENOBUFS, 0x01, "Receive ring overrun" )
+
 /** Network device receive queue processing is frozen */
 #define NETDEV_RX_FROZEN 0x0004
 
@@ -457,6 +518,9 @@ struct net_device {
 /** Network device poll is in progress */
 #define NETDEV_POLL_IN_PROGRESS 0x0020
 
+/** Network device has transmissions awaiting a batch flush */
+#define NETDEV_TX_BATCH 0x0040
+
 /** Link-layer protocol table */
 #define LL_PROTOCOLS __table ( struct ll_protocol, "ll_protocols" )
 
@@ -659,6 +723,26 @@ netdev_is_open ( struct net_device *netdev ) {
 	return ( netdev->state & NETDEV_OPEN );
 }
 
+/**
+ * Get receive ring fill level
+ *
+ * @v netdev		Network device
+ * @v fill		Driver default fill level
+ * @v max		Driver maximum fill level
+ * @ret fill		Receive ring fill level
+ */
+static inline __attribute__ (( always_inline )) unsigned int
+netdev_rx_fill ( struct net_device *netdev, unsigned int fill,
+		 unsigned int max ) {
+
+	/* Use configured fill level, if any, up to the driver maximum */
+	if ( netdev->rx_fill )
+		fill = netdev->rx_fill;
+	if ( fill > max )
+		fill = max;
+	return fill;
+}
+
 /**
  * Check whether or not network device supports interrupts
  *
@@ -693,6 +777,17 @@ netdev_rx_frozen ( struct net_device *netdev ) {
 	return ( netdev->state & NETDEV_RX_FROZEN );
 }
 
+/**
+ * Check whether or not network device transmissions are being batched
+ *
+ * @v netdev		Network device
+ * @ret batching	Hardware notification may be deferred until flush
+ */
+static inline __attribute__ (( always_inline )) int
+netdev_tx_batching ( struct net_device *netdev ) {
+	return ( netdev->state & NETDEV_TX_BATCH );
+}
+
 extern void * netdev_priv ( struct net_device *netdev,
 			    struct net_driver *driver );
 extern void netdev_rx_freeze ( struct net_device *netdev );
@@ -732,6 +827,8 @@ extern int net_tx ( struct io_buffer *iobuf, struct net_device *netdev,
 extern int net_rx ( struct io_buffer *iobuf, struct net_device *netdev,
 		    uint16_t net_proto, const void *ll_dest,
 		    const void *ll_source, unsigned int flags );
+extern void net_tx_batch_start ( void );
+extern void net_tx_batch_end ( void );
 extern void net_poll ( void );
 extern struct net_device_configurator *
 find_netdev_configurator ( const char *name );
@@ -122,6 +122,19 @@ struct nfs_read_reply {
 	void                 *data;
 };
 
+/**
+ * A NFS FSINFO reply
+ *
+ */
+struct nfs_fsinfo_reply {
+	/** Reply status */
+	uint32_t             status;
+	/** Maximum READ request size */
+	uint32_t             rtmax;
+	/** Preferred READ request size */
+	uint32_t             rtpref;
+};
+
 size_t nfs_iob_get_fh ( struct io_buffer *io_buf, struct nfs_fh *fh );
 size_t nfs_iob_add_fh ( struct io_buffer *io_buf, const struct nfs_fh *fh );
 
@@ -146,6 +159,8 @@ int nfs_readlink ( struct interface *intf, struct oncrpc_session *session,
                    const struct nfs_fh *fh );
 int nfs_read ( struct interface *intf, struct oncrpc_session *session,
                const struct nfs_fh *fh, uint64_t offset, uint32_t count );
+int nfs_fsinfo ( struct interface *intf, struct oncrpc_session *session,
+                 const struct nfs_fh *fh );
 
 int nfs_get_lookup_reply ( struct nfs_lookup_reply *lookup_reply,
                            struct oncrpc_reply *reply );
@@ -153,5 +168,7 @@ int nfs_get_readlink_reply ( struct nfs_readlink_reply *readlink_reply,
                              struct oncrpc_reply *reply );
 int nfs_get_read_reply ( struct nfs_read_reply *read_reply,
                          struct oncrpc_reply *reply );
+int nfs_get_fsinfo_reply ( struct nfs_fsinfo_reply *fsinfo_reply,
+                           struct oncrpc_reply *reply );
 
 #endif /* _IPXE_NFS_H */
@@ -25,6 +25,10 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 /** Size of an ONC RPC header */
 #define ONCRPC_HEADER_SIZE ( 11 * sizeof ( uint32_t ) )
 
+/** Set most significant bit to 1. */
+#define SET_LAST_FRAME( x ) ( (x) | 1 << 31 )
+#define GET_FRAME_SIZE( x ) ( (x) & ~( 1 << 31 ) )
+
 #define ONCRPC_FIELD( type, value ) { oncrpc_ ## type, { .type = value } }
 #define ONCRPC_SUBFIELD( type, args... ) \
 	{ oncrpc_ ## type, { .type = { args } } }
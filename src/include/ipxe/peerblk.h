@@ -11,6 +11,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 
 #include <stdint.h>
 #include <ipxe/refcnt.h>
+#include <ipxe/uaccess.h>
 #include <ipxe/interface.h>
 #include <ipxe/crypto.h>
 #include <ipxe/aes.h>
@@ -42,6 +43,24 @@ enum peerdist_block_decrypt_index {
 	PEERBLK_NUM_BUFFERS
 };
 
+/** A cached PeerDist block */
+struct peerdist_cached_block {
+	/** Reference count */
+	struct refcnt refcnt;
+	/** List of cached blocks */
+	struct list_head list;
+	/** Segment identifier */
+	uint8_t id[PEERDIST_DIGEST_MAX_SIZE];
+	/** Block hash */
+	uint8_t hash[PEERDIST_DIGEST_MAX_SIZE];
+	/** Digest size */
+	size_t digestsize;
+	/** Cached range (relative to start of block) */
+	struct peerdist_range range;
+	/** Cached data (in external memory) */
+	userptr_t data;
+};
+
 /** A PeerDist block download */
 struct peerdist_block {
 	/** Reference count */
@@ -88,6 +107,8 @@ struct peerdist_block {
 	unsigned int block;
 	/** Block hash */
 	uint8_t hash[PEERDIST_DIGEST_MAX_SIZE];
+	/** Cached block, if available */
+	struct peerdist_cached_block *cached;
 
 	/** Current position (relative to incoming data stream) */
 	size_t pos;
@@ -111,6 +132,8 @@ struct peerdist_block {
 	struct peerdisc_client discovery;
 	/** Current position in discovered peer list */
 	struct peerdisc_peer *peer;
+	/** Preference rank of current peer when chosen */
+	unsigned long rank;
 	/** Block download queue */
 	struct peerdist_block_queue *queue;
 	/** List of queued block downloads */
@@ -139,6 +162,8 @@ struct peerdist_block_queue {
 	unsigned int count;
 	/** Maximum number of open downloads */
 	unsigned int max;
+	/** Number of consecutive successful downloads */
+	unsigned int successes;
 
 	/** Open block download
 	 *
@@ -58,7 +58,9 @@ struct peerdisc_segment {
 	 * the discovery segment.  Discovered peers will not be
 	 * removed from the list until the last discovery has been
 	 * closed; this allows users to safely maintain a pointer to a
-	 * current position within the list.
+	 * current position within the list.  Peers are never
+	 * reordered within the list; use peerdisc_next() to iterate
+	 * over peers in order of preference.
 	 */
 	struct list_head peers;
 	/** List of active clients */
@@ -71,6 +73,10 @@ struct peerdisc_segment {
 struct peerdisc_peer {
 	/** List of peers */
 	struct list_head list;
+	/** Smoothed block retrieval time (in ticks), or zero if unknown */
+	unsigned long latency;
+	/** Position within list of peers */
+	unsigned int index;
 	/** Peer location */
 	char location[0];
 };
@@ -109,8 +115,26 @@ peerdisc_init ( struct peerdisc_client *peerdisc,
 
 extern unsigned int peerdisc_timeout_secs;
 
+/**
+ * Get PeerDist peer preference rank
+ *
+ * @v peer		Peer
+ * @ret rank		Preference rank (lower is preferred)
+ *
+ * Peers with no measured retrieval time are ranked after all
+ * measured peers.
+ */
+static inline unsigned long peerdisc_rank ( struct peerdisc_peer *peer ) {
+	return ( peer->latency ? peer->latency : ~0UL );
+}
+
 extern void peerdisc_stat ( struct interface *intf, struct peerdisc_peer *peer,
 			    struct list_head *peers );
+extern void peerdisc_rate ( struct peerdisc_segment *segment,
+			    struct peerdisc_peer *peer, unsigned long elapsed );
+extern struct peerdisc_peer * peerdisc_next ( struct peerdisc_segment *segment,
+					      struct peerdisc_peer *prev,
+					      unsigned long rank );
 #define peerdisc_stat_TYPE( object_type )				\
 	typeof ( void ( object_type, struct peerdisc_peer *peer,	\
 			struct list_head *peers ) )
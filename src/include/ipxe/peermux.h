@@ -19,7 +19,10 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/pccrc.h>
 
 /** Maximum number of concurrent block downloads */
-#define PEERMUX_MAX_BLOCKS 32
+#define PEERMUX_MAX_BLOCKS 64
+
+/** Default number of concurrent block downloads */
+#define PEERMUX_WINDOW 32
 
 /** PeerDist download content information cache */
 struct peerdist_info_cache {
@@ -39,6 +42,8 @@ struct peerdist_multiplexed_block {
 	struct list_head list;
 	/** Data transfer interface */
 	struct interface xfer;
+	/** Length of current block download (within trimmed range) */
+	size_t len;
 };
 
 /** PeerDist statistics */
@@ -49,6 +54,12 @@ struct peerdist_statistics {
 	unsigned int total;
 	/** Number of blocks downloaded from peers */
 	unsigned int local;
+	/** Number of bytes downloaded in total */
+	size_t total_len;
+	/** Number of bytes downloaded from peers */
+	size_t peer_len;
+	/** Number of bytes retrieved from the local block cache */
+	size_t cached_len;
 };
 
 /** A PeerDist download multiplexer */
@@ -12,6 +12,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/list.h>
 #include <ipxe/refcnt.h>
 #include <ipxe/tables.h>
+#include <ipxe/profile.h>
 
 /** A process */
 struct process {
@@ -43,6 +44,8 @@ struct process_descriptor {
 	void ( * step ) ( void *object );
 	/** Automatically reschedule the process */
 	int reschedule;
+	/** Profiler, or NULL to use the generic process profiler */
+	struct profiler *profiler;
 };
 
 /**
@@ -116,11 +119,28 @@ struct process_descriptor {
 		.reschedule = 1,					      \
 	}
 
+/** A source of pending background work */
+struct process_busy {
+	/**
+	 * Check for pending work
+	 *
+	 * @ret busy		Work is pending
+	 */
+	int ( * busy ) ( void );
+};
+
+/** Pending background work source table */
+#define PROCESS_BUSY __table ( struct process_busy, "process_busy" )
+
+/** Declare a pending background work source */
+#define __process_busy __table_entry ( PROCESS_BUSY, 01 )
+
 extern void * __attribute__ (( pure ))
 process_object ( struct process *process );
 extern void process_add ( struct process *process );
 extern void process_del ( struct process *process );
 extern void step ( void );
+extern void step_nap ( void );
 
 /**
  * Initialise a static process
@@ -190,9 +210,18 @@ process_running ( struct process *process ) {
 /** Define a permanent process
  *
  */
-#define PERMANENT_PROCESS( name, step )					      \
-static struct process_descriptor name ## _desc = PROC_DESC_PURE ( step );     \
-struct process name __permanent_process = PROC_INIT ( name, & name ## _desc );
+#define PERMANENT_PROCESS( _name, _step )				      \
+static struct profiler _name ## _profiler __profiler =			      \
+	{ .name = "process." #_name };					      \
+static struct process_descriptor _name ## _desc = {			      \
+	.name = #_step,							      \
+	.offset = 0,							      \
+	.step = PROC_STEP ( struct process, _step ),			      \
+	.reschedule = 1,						      \
+	.profiler = & _name ## _profiler,				      \
+};									      \
+struct process _name __permanent_process =				      \
+	PROC_INIT ( _name, & _name ## _desc );
 
 /**
  * Find debugging colourisation for a process
@@ -119,6 +119,25 @@ struct tcpip_protocol {
         int ( * rx ) ( struct io_buffer *iobuf, struct net_device *netdev,
 		       struct sockaddr_tcpip *st_src,
 		       struct sockaddr_tcpip *st_dest, uint16_t pshdr_csum );
+	/**
+	 * Check whether or not received packets may be coalesced
+	 *
+	 * @v iobuf		I/O buffer
+	 * @v next		Next received I/O buffer
+	 * @v pshdr_csum	Pseudo-header checksum for I/O buffer
+	 * @v next_pshdr_csum	Pseudo-header checksum for next I/O buffer
+	 * @ret hlen		Length of header to strip from next I/O buffer
+	 *			before appending, or negative error
+	 *
+	 * This method is optional.  If the packets may be coalesced,
+	 * then the caller may append the payload of the next packet
+	 * to the first packet, and mark the first packet as having a
+	 * verified checksum.  This method must verify the checksums
+	 * of both packets (unless already verified), and must not
+	 * modify either I/O buffer.
+	 */
+	int ( * coalesce ) ( struct io_buffer *iobuf, struct io_buffer *next,
+			     uint16_t pshdr_csum, uint16_t next_pshdr_csum );
 	/** Preferred zero checksum value
 	 *
 	 * The checksum is a one's complement value: zero may be
@@ -191,6 +210,9 @@ extern int tcpip_rx ( struct io_buffer *iobuf, struct net_device *netdev,
 		      uint8_t tcpip_proto, struct sockaddr_tcpip *st_src,
 		      struct sockaddr_tcpip *st_dest, uint16_t pshdr_csum,
 		      struct ip_statistics *stats );
+extern int tcpip_coalesce ( struct io_buffer *iobuf, struct io_buffer *next,
+			    uint8_t tcpip_proto, uint16_t pshdr_csum,
+			    uint16_t next_pshdr_csum );
 extern int tcpip_tx ( struct io_buffer *iobuf, struct tcpip_protocol *tcpip,
 		      struct sockaddr_tcpip *st_src,
 		      struct sockaddr_tcpip *st_dest,
@@ -14,6 +14,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #define TFTP_PORT	       69 /**< Default TFTP server port */
 #define	TFTP_DEFAULT_BLKSIZE  512 /**< Default TFTP data block size */
 #define	TFTP_MAX_BLKSIZE     1432
+#define TFTP_WINDOWSIZE	       16 /**< Requested TFTP window size */
 
 #define TFTP_RRQ		1 /**< Read request opcode */
 #define TFTP_WRQ		2 /**< Write request opcode */
@@ -80,4 +81,31 @@ union tftp_any {
 	struct tftp_oack	oack;
 };
 
+/**
+ * Calculate block index for a unicast DATA packet
+ *
+ * @v expected		Index of first block not yet received
+ * @v windowsize	Window size
+ * @v number		Block number within DATA packet
+ * @v block		Block index to fill in
+ * @ret ok		Block lies within the current window
+ *
+ * DATA packets carry only the low 16 bits of the (one-based) block
+ * number.  The server may send blocks up to one window beyond the
+ * first missing block, and may resend up to one window preceding it
+ * (if an acknowledgement was lost), so the full block index is
+ * reconstructed relative to the first missing block.
+ */
+static inline int tftp_block ( unsigned int expected, unsigned int windowsize,
+			       unsigned int number, unsigned int *block ) {
+	int16_t delta = ( number - ( expected + 1 ) );
+
+	if ( ( delta >= ( int ) windowsize ) ||
+	     ( delta < -( ( int ) windowsize ) ) ||
+	     ( delta < -( ( int ) expected ) ) )
+		return 0;
+	*block = ( expected + delta );
+	return 1;
+}
+
 #endif /* _IPXE_TFTP_H */
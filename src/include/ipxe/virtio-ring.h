@@ -19,6 +19,11 @@
 /* Virtio feature flags used to negotiate device and driver features. */
 /* Can the device handle any descriptor layout? */
 #define VIRTIO_F_ANY_LAYOUT             27
+/* The Guest publishes the used index for which it expects an interrupt
+ * at the end of the avail ring. Host should ignore the avail->flags field. */
+/* The Host publishes the avail index for which it expects a kick
+ * at the end of the used ring. Guest should ignore the used->flags field. */
+#define VIRTIO_RING_F_EVENT_IDX         29
 /* v1.0 compliant. */
 #define VIRTIO_F_VERSION_1              32
 #define VIRTIO_F_IOMMU_PLATFORM         33
@@ -67,11 +72,28 @@ struct vring {
    struct vring_used *used;
 };
 
+/* The used_event and avail_event fields follow the avail and used rings */
 #define vring_size(num) \
    (((((sizeof(struct vring_desc) * num) + \
-      (sizeof(struct vring_avail) + sizeof(u16) * num)) \
+      (sizeof(struct vring_avail) + sizeof(u16) * (num + 1))) \
          + PAGE_MASK) & ~PAGE_MASK) + \
-         (sizeof(struct vring_used) + sizeof(struct vring_used_elem) * num))
+         (sizeof(struct vring_used) + sizeof(struct vring_used_elem) * num) + \
+         sizeof(u16))
+
+/* Only valid if VIRTIO_RING_F_EVENT_IDX has been negotiated */
+#define vring_used_event(vr) ((vr)->avail->ring[(vr)->num])
+#define vring_avail_event(vr) \
+   (*(u16 *)((void *)(vr)->used + sizeof(struct vring_used) + \
+             sizeof(struct vring_used_elem) * (vr)->num))
+
+/* The following is used with VIRTIO_RING_F_EVENT_IDX.
+ * Assuming a given event_idx value from the other side, if
+ * we have just incremented index from old to new_idx,
+ * should we trigger an event? */
+static inline int vring_need_event(u16 event_idx, u16 new_idx, u16 old)
+{
+   return (u16)(new_idx - event_idx - 1) < (u16)(new_idx - old);
+}
 
 struct vring_virtqueue {
    unsigned char *queue;
@@ -81,6 +103,10 @@ struct vring_virtqueue {
    struct vring vring;
    u16 free_head;
    u16 last_used_idx;
+   /* VIRTIO_RING_F_EVENT_IDX negotiated */
+   int event;
+   /* Callbacks (interrupts) disabled */
+   int no_cb;
    void **vdata;
    struct virtio_net_hdr_modern *empty_header;
    /* PCI */
@@ -120,14 +146,37 @@ static inline void vring_init(struct vring *vr,
    vr->desc[i].next = 0;
 }
 
+/*
+ * vring_update_used_event
+ *
+ * ask for an interrupt on the next used buffer, or (with callbacks
+ * disabled) keep the used event index just behind the used index so
+ * that no interrupt is ever requested
+ *
+ */
+
+static inline void vring_update_used_event(struct vring_virtqueue *vq)
+{
+   vring_used_event(&vq->vring) = (vq->last_used_idx - vq->no_cb);
+   mb();
+}
+
 static inline void vring_enable_cb(struct vring_virtqueue *vq)
 {
-   vq->vring.avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+   vq->no_cb = 0;
+   if (vq->event)
+           vring_update_used_event(vq);
+   else
+           vq->vring.avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
 }
 
 static inline void vring_disable_cb(struct vring_virtqueue *vq)
 {
-   vq->vring.avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+   vq->no_cb = 1;
+   if (vq->event)
+           vring_update_used_event(vq);
+   else
+           vq->vring.avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
 }
 
 
@@ -21,6 +21,8 @@ struct xfer_buffer {
 	void *data;
 	/** Size of data */
 	size_t len;
+	/** Allocated size of data (may exceed size of data) */
+	size_t size;
 	/** Current offset within data */
 	size_t pos;
 	/** Data transfer buffer operations */
@@ -67,6 +69,8 @@ struct xfer_buffer_operations {
 extern struct xfer_buffer_operations xferbuf_malloc_operations;
 extern struct xfer_buffer_operations xferbuf_umalloc_operations;
 
+extern unsigned long xferbuf_realloc_copied;
+
 /**
  * Initialise malloc()-based data transfer buffer
  *
@@ -97,6 +101,7 @@ extern int xferbuf_read ( struct xfer_buffer *xferbuf, size_t offset,
 extern int xferbuf_deliver ( struct xfer_buffer *xferbuf,
 			     struct io_buffer *iobuf,
 			     struct xfer_metadata *meta );
+extern int xferbuf_shrink ( struct xfer_buffer *xferbuf );
 
 extern struct xfer_buffer * xfer_buffer ( struct interface *intf );
 #define xfer_buffer_TYPE( object_type ) \
@@ -98,6 +98,11 @@ struct io_buffer * fragment_reassemble ( struct fragment_reassembler *fragments,
 	/* Update statistics */
 	fragments->stats->reasm_reqds++;
 
+	/* Any hardware checksum verification cannot apply to the
+	 * reassembled packet.
+	 */
+	iobuf->flags &= ~IOB_FL_CSUM_OK;
+
 	/* Find matching fragment reassembly buffer, if any */
 	fragment = fragment_find ( fragments, iobuf, *hdrlen );
 
@@ -72,6 +72,10 @@ static struct profiler ipv4_tx_profiler __profiler = { .name = "ipv4.tx" };
 /** Receive profiler */
 static struct profiler ipv4_rx_profiler __profiler = { .name = "ipv4.rx" };
 
+/** Receive coalescing profiler */
+static struct profiler ipv4_coalesce_profiler __profiler =
+	{ .name = "ipv4.coalesce" };
+
 /**
  * Add IPv4 minirouting table entry
  *
@@ -601,6 +605,100 @@ static int ipv4_rx ( struct io_buffer *iobuf,
 	return -EINVAL;
 }
 
+/**
+ * Coalesce received IPv4 packets
+ *
+ * @v iobuf		I/O buffer
+ * @v next		Next received I/O buffer
+ * @ret merged		Coalesced I/O buffer, or NULL if not coalesced
+ */
+static struct io_buffer * ipv4_coalesce ( struct io_buffer *iobuf,
+					  struct io_buffer *next ) {
+	struct iphdr *iphdr = iobuf->data;
+	struct iphdr *next_iphdr = next->data;
+	struct io_buffer *merged;
+	size_t len = iob_len ( iobuf );
+	size_t next_len = iob_len ( next );
+	size_t payload;
+	uint16_t pshdr_csum;
+	uint16_t next_pshdr_csum;
+	int hlen;
+
+	/* Check for unfragmented packets without options between the
+	 * same pair of hosts, which will fit within the maximum
+	 * coalesced length even before the transport-layer header is
+	 * stripped from the next packet.
+	 */
+	if ( ( len < sizeof ( *iphdr ) ) ||
+	     ( next_len < sizeof ( *next_iphdr ) ) ||
+	     ( iphdr->verhdrlen != ( IP_VER | ( sizeof ( *iphdr ) / 4 ) ) ) ||
+	     ( next_iphdr->verhdrlen != iphdr->verhdrlen ) ||
+	     ( ntohs ( iphdr->len ) != len ) ||
+	     ( ntohs ( next_iphdr->len ) != next_len ) ||
+	     ( ( iphdr->frags | next_iphdr->frags ) &
+	       htons ( IP_MASK_OFFSET | IP_MASK_MOREFRAGS ) ) ||
+	     ( iphdr->service != next_iphdr->service ) ||
+	     ( iphdr->protocol != next_iphdr->protocol ) ||
+	     ( iphdr->src.s_addr != next_iphdr->src.s_addr ) ||
+	     ( iphdr->dest.s_addr != next_iphdr->dest.s_addr ) ||
+	     ( ( len + next_len - sizeof ( *next_iphdr ) ) >
+	       IPV4_COALESCE_MAX_LEN ) ||
+	     ( tcpip_chksum ( iphdr, sizeof ( *iphdr ) ) != 0 ) ||
+	     ( tcpip_chksum ( next_iphdr, sizeof ( *next_iphdr ) ) != 0 ) ) {
+		return NULL;
+	}
+
+	/* Start profiling */
+	profile_start ( &ipv4_coalesce_profiler );
+
+	/* Check with transport layer */
+	pshdr_csum = ipv4_pshdr_chksum ( iobuf, TCPIP_EMPTY_CSUM );
+	next_pshdr_csum = ipv4_pshdr_chksum ( next, TCPIP_EMPTY_CSUM );
+	iob_pull ( iobuf, sizeof ( *iphdr ) );
+	iob_pull ( next, sizeof ( *next_iphdr ) );
+	hlen = tcpip_coalesce ( iobuf, next, iphdr->protocol, pshdr_csum,
+				next_pshdr_csum );
+	iob_push ( iobuf, sizeof ( *iphdr ) );
+	iob_push ( next, sizeof ( *next_iphdr ) );
+	if ( hlen < 0 )
+		goto not_coalesced;
+	payload = ( next_len - sizeof ( *next_iphdr ) - hlen );
+
+	/* Move to a larger buffer if necessary */
+	if ( iob_tailroom ( iobuf ) < payload ) {
+		merged = alloc_iob ( IPV4_COALESCE_MAX_LEN );
+		if ( ! merged )
+			goto not_coalesced;
+		memcpy ( iob_put ( merged, len ), iobuf->data, len );
+		free_iob ( iobuf );
+		iobuf = merged;
+		iphdr = iobuf->data;
+	}
+
+	/* Append payload and update header */
+	memcpy ( iob_put ( iobuf, payload ),
+		 ( next->data + next_len - payload ), payload );
+	iphdr->len = htons ( iob_len ( iobuf ) );
+	iphdr->chksum = 0;
+	iphdr->chksum = tcpip_chksum ( iphdr, sizeof ( *iphdr ) );
+	iobuf->flags |= IOB_FL_CSUM_OK;
+	DBGC2 ( iphdr->src, "IPv4 RX %s<-", inet_ntoa ( iphdr->dest ) );
+	DBGC2 ( iphdr->src, "%s coalesced %zd bytes (total %zd bytes)\n",
+		inet_ntoa ( iphdr->src ), payload, iob_len ( iobuf ) );
+
+	/* Account for the absorbed packet's headers */
+	ipv4_stats.in_receives++;
+	ipv4_stats.in_octets += ( next_len - payload );
+	free_iob ( next );
+
+	profile_stop ( &ipv4_coalesce_profiler );
+	return iobuf;
+
+ not_coalesced:
+	profile_stop ( &ipv4_coalesce_profiler );
+	return NULL;
+}
+
 /** 
  * Check existence of IPv4 address for ARP
  *
@@ -710,6 +808,7 @@ struct net_protocol ipv4_protocol __net_protocol = {
 	.net_proto = htons ( ETH_P_IP ),
 	.net_addr_len = sizeof ( struct in_addr ),
 	.rx = ipv4_rx,
+	.coalesce = ipv4_coalesce,
 	.ntoa = ipv4_ntoa,
 };
 
@@ -81,6 +81,17 @@ const struct setting mtu_setting __setting ( SETTING_NETDEV, mtu ) = {
 	.type = &setting_type_int16,
 	.tag = DHCP_MTU,
 };
+const struct setting rx_fill_setting __setting ( SETTING_NETDEV, rx_fill ) = {
+	.name = "rx-fill",
+	.description = "Receive ring fill level",
+	.type = &setting_type_uint16,
+};
+const struct setting irq_holdoff_setting __setting ( SETTING_NETDEV,
+						      irq_holdoff ) = {
+	.name = "irq-holdoff",
+	.description = "Interrupt holdoff time (in microseconds)",
+	.type = &setting_type_uint16,
+};
 
 /**
  * Store link-layer address setting
@@ -274,6 +285,137 @@ struct netdev_setting_operation {
 	int ( * fetch ) ( struct net_device *netdev, void *data, size_t len );
 };
 
+/**
+ * Parse 16-bit unsigned integer setting
+ *
+ * @v data		Setting data
+ * @v len		Length of setting data
+ * @v value		Value to fill in
+ * @ret rc		Return status code
+ */
+static int netdev_parse_uint16 ( const void *data, size_t len,
+				 unsigned int *value ) {
+	const uint8_t *byte = data;
+
+	/* Parse big-endian value */
+	if ( len > sizeof ( uint16_t ) )
+		return -ERANGE;
+	*value = 0;
+	while ( len-- )
+		*value = ( ( *value << 8 ) | *(byte++) );
+
+	return 0;
+}
+
+/**
+ * Fetch 16-bit unsigned integer setting
+ *
+ * @v value		Value
+ * @v data		Buffer to fill with setting data
+ * @v len		Length of buffer
+ * @ret len		Length of setting data, or negative error
+ */
+static int netdev_fetch_uint16 ( unsigned int value, void *data,
+				 size_t len ) {
+	uint16_t raw;
+
+	raw = cpu_to_be16 ( value );
+	if ( len > sizeof ( raw ) )
+		len = sizeof ( raw );
+	memcpy ( data, &raw, len );
+	return sizeof ( raw );
+}
+
+/**
+ * Store receive ring fill level setting
+ *
+ * @v netdev		Network device
+ * @v data		Setting data, or NULL to clear setting
+ * @v len		Length of setting data
+ * @ret rc		Return status code
+ *
+ * The new fill level will take effect when the device is next opened.
+ */
+static int netdev_store_rx_fill ( struct net_device *netdev,
+				  const void *data, size_t len ) {
+	int rc;
+
+	/* Reset to driver default if clearing setting */
+	if ( ! data ) {
+		netdev->rx_fill = 0;
+		return 0;
+	}
+
+	/* Record fill level */
+	if ( ( rc = netdev_parse_uint16 ( data, len,
+					  &netdev->rx_fill ) ) != 0 )
+		return rc;
+	DBGC ( netdev, "NETDEV %s receive ring fill level is %d\n",
+	       netdev->name, netdev->rx_fill );
+
+	return 0;
+}
+
+/**
+ * Fetch receive ring fill level setting
+ *
+ * @v netdev		Network device
+ * @v data		Buffer to fill with setting data
+ * @v len		Length of buffer
+ * @ret len		Length of setting data, or negative error
+ */
+static int netdev_fetch_rx_fill ( struct net_device *netdev, void *data,
+				  size_t len ) {
+
+	/* Report nothing if using driver default */
+	if ( ! netdev->rx_fill )
+		return -ENOENT;
+
+	return netdev_fetch_uint16 ( netdev->rx_fill, data, len );
+}
+
+/**
+ * Store interrupt holdoff time setting
+ *
+ * @v netdev		Network device
+ * @v data		Setting data, or NULL to clear setting
+ * @v len		Length of setting data
+ * @ret rc		Return status code
+ */
+static int netdev_store_irq_holdoff ( struct net_device *netdev,
+				      const void *data, size_t len ) {
+	int rc;
+
+	/* Reset to default if clearing setting */
+	if ( ! data ) {
+		netdev->irq_holdoff = NETDEV_IRQ_HOLDOFF;
+		return 0;
+	}
+
+	/* Record holdoff time */
+	if ( ( rc = netdev_parse_uint16 ( data, len,
+					  &netdev->irq_holdoff ) ) != 0 )
+		return rc;
+	DBGC ( netdev, "NETDEV %s interrupt holdoff is %dus\n",
+	       netdev->name, netdev->irq_holdoff );
+
+	return 0;
+}
+
+/**
+ * Fetch interrupt holdoff time setting
+ *
+ * @v netdev		Network device
+ * @v data		Buffer to fill with setting data
+ * @v len		Length of buffer
+ * @ret len		Length of setting data, or negative error
+ */
+static int netdev_fetch_irq_holdoff ( struct net_device *netdev, void *data,
+				      size_t len ) {
+
+	return netdev_fetch_uint16 ( netdev->irq_holdoff, data, len );
+}
+
 /** Network device settings */
 static struct netdev_setting_operation netdev_setting_operations[] = {
 	{ &mac_setting, netdev_store_mac, netdev_fetch_mac },
@@ -283,6 +425,9 @@ static struct netdev_setting_operation netdev_setting_operations[] = {
 	{ &busid_setting, NULL, netdev_fetch_busid },
 	{ &chip_setting, NULL, netdev_fetch_chip },
 	{ &ifname_setting, NULL, netdev_fetch_ifname },
+	{ &rx_fill_setting, netdev_store_rx_fill, netdev_fetch_rx_fill },
+	{ &irq_holdoff_setting, netdev_store_irq_holdoff,
+	  netdev_fetch_irq_holdoff },
 };
 
 /**
@@ -29,6 +29,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <byteswap.h>
 #include <string.h>
 #include <errno.h>
+#include <assert.h>
 #include <config/general.h>
 #include <ipxe/if_ether.h>
 #include <ipxe/iobuf.h>
@@ -39,6 +40,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/device.h>
 #include <ipxe/errortab.h>
 #include <ipxe/profile.h>
+#include <ipxe/timer.h>
 #include <ipxe/fault.h>
 #include <ipxe/vlan.h>
 #include <ipxe/netdevice.h>
@@ -64,6 +66,46 @@ static struct profiler net_rx_profiler __profiler = { .name = "net.rx" };
 /** Network transmit profiler */
 static struct profiler net_tx_profiler __profiler = { .name = "net.tx" };
 
+/** Transmit batch nesting depth */
+static unsigned int net_tx_batch_depth;
+
+/** Time without activity after which polling is backed off
+ *
+ * This is a policy decision.
+ */
+#define NETDEV_POLL_IDLE_TIMEOUT ( 100 * TICKS_PER_MS )
+
+/** Maximum interval between polls of an idle network device
+ *
+ * This is a policy decision.  It is kept short since some drivers
+ * rely on being polled to refill their receive rings.
+ */
+#define NETDEV_POLL_IDLE_INTERVAL ( 1 * TICKS_PER_MS )
+
+/**
+ * Mark network device as active
+ *
+ * @v netdev		Network device
+ *
+ * The device will be polled on every network poll until it has once
+ * again been idle for some time.
+ */
+static inline void netdev_poll_active ( struct net_device *netdev ) {
+	netdev->poll_active = currticks();
+}
+
+/**
+ * Check if network device has recently been active
+ *
+ * @v netdev		Network device
+ * @v now		Current time
+ * @ret active		Network device has recently been active
+ */
+static inline int netdev_poll_is_active ( struct net_device *netdev,
+					  unsigned long now ) {
+	return ( ( now - netdev->poll_active ) < NETDEV_POLL_IDLE_TIMEOUT );
+}
+
 /** Default unknown link status code */
 #define EUNKNOWN_LINK_STATUS __einfo_error ( EINFO_EUNKNOWN_LINK_STATUS )
 #define EINFO_EUNKNOWN_LINK_STATUS \
@@ -348,6 +390,9 @@ int netdev_tx ( struct net_device *netdev, struct io_buffer *iobuf ) {
 	}
 	netdev->state |= NETDEV_TX_IN_PROGRESS;
 
+	/* Ensure that any response is picked up promptly */
+	netdev_poll_active ( netdev );
+
 	/* Avoid calling transmit() on unopened network devices */
 	if ( ! netdev_is_open ( netdev ) ) {
 		rc = -ENETUNREACH;
@@ -364,6 +409,10 @@ int netdev_tx ( struct net_device *netdev, struct io_buffer *iobuf ) {
 			goto err_map;
 	}
 
+	/* Allow hardware notification to be deferred, if applicable */
+	if ( net_tx_batch_depth && netdev->op->flush )
+		netdev->state |= NETDEV_TX_BATCH;
+
 	/* Transmit packet */
 	if ( ( rc = netdev->op->transmit ( netdev, iobuf ) ) != 0 )
 		goto err_transmit;
@@ -384,6 +433,22 @@ int netdev_tx ( struct net_device *netdev, struct io_buffer *iobuf ) {
 	return rc;
 }
 
+/**
+ * Flush batched transmissions
+ *
+ * @v netdev		Network device
+ */
+static void netdev_tx_batch_flush ( struct net_device *netdev ) {
+
+	/* Do nothing unless transmissions are awaiting a flush */
+	if ( ! netdev_tx_batching ( netdev ) )
+		return;
+
+	/* Notify hardware */
+	netdev->state &= ~NETDEV_TX_BATCH;
+	netdev->op->flush ( netdev );
+}
+
 /**
  * Defer transmitted packet
  *
@@ -619,6 +684,9 @@ void netdev_poll ( struct net_device *netdev ) {
 	if ( netdev->state & NETDEV_POLL_IN_PROGRESS )
 		return;
 
+	/* Ensure that any batched transmissions are not left stranded */
+	netdev_tx_batch_flush ( netdev );
+
 	/* Poll device */
 	netdev->state |= NETDEV_POLL_IN_PROGRESS;
 	netdev->op->poll ( netdev );
@@ -706,6 +774,7 @@ static void free_netdev ( struct refcnt *refcnt ) {
 	assert ( ! timer_running ( &netdev->link_block ) );
 	netdev_tx_flush ( netdev );
 	netdev_rx_flush ( netdev );
+	iob_pool_flush ( &netdev->rx_pool );
 	clear_settings ( netdev_settings ( netdev ) );
 	free ( netdev );
 }
@@ -732,6 +801,9 @@ struct net_device * alloc_netdev ( size_t priv_len ) {
 		INIT_LIST_HEAD ( &netdev->tx_queue );
 		INIT_LIST_HEAD ( &netdev->tx_deferred );
 		INIT_LIST_HEAD ( &netdev->rx_queue );
+		iob_pool_init ( &netdev->rx_pool, IOB_POOL_MAX,
+				&netdev->refcnt );
+		netdev->irq_holdoff = NETDEV_IRQ_HOLDOFF;
 		netdev_settings_init ( netdev );
 		config = netdev->configs;
 		for_each_table_entry ( configurator, NET_DEVICE_CONFIGURATORS ){
@@ -869,6 +941,7 @@ int netdev_open ( struct net_device *netdev ) {
 
 	/* Mark as opened */
 	netdev->state |= NETDEV_OPEN;
+	netdev_poll_active ( netdev );
 
 	/* Open the device */
 	if ( ( rc = netdev->op->open ( netdev ) ) != 0 )
@@ -915,7 +988,7 @@ void netdev_close ( struct net_device *netdev ) {
 	list_del ( &netdev->open_list );
 
 	/* Mark as closed */
-	netdev->state &= ~NETDEV_OPEN;
+	netdev->state &= ~( NETDEV_OPEN | NETDEV_TX_BATCH );
 
 	/* Notify drivers of device state change */
 	netdev_notify ( netdev );
@@ -929,6 +1002,11 @@ void netdev_close ( struct net_device *netdev ) {
 	/* Flush TX and RX queues */
 	netdev_tx_flush ( netdev );
 	netdev_rx_flush ( netdev );
+
+	/* Release free receive buffers */
+	DBGC ( netdev, "NETDEV %s RX pool %lu hits, %lu misses\n",
+	       netdev->name, netdev->rx_pool.hits, netdev->rx_pool.misses );
+	iob_pool_flush ( &netdev->rx_pool );
 }
 
 /**
@@ -1117,6 +1195,101 @@ int net_rx ( struct io_buffer *iobuf, struct net_device *netdev,
 	return -ENOTSUP;
 }
 
+/**
+ * Coalesce received packets
+ *
+ * @v iobuf		I/O buffer
+ * @v next		Next received I/O buffer
+ * @v net_proto		Network-layer protocol, in network-byte order
+ * @ret merged		Coalesced I/O buffer, or NULL if not coalesced
+ */
+static struct io_buffer * net_coalesce ( struct io_buffer *iobuf,
+					 struct io_buffer *next,
+					 uint16_t net_proto ) {
+	struct net_protocol *net_protocol;
+
+	/* Hand off to network-layer protocol, if applicable */
+	for_each_table_entry ( net_protocol, NET_PROTOCOLS ) {
+		if ( net_protocol->net_proto == net_proto ) {
+			if ( ! net_protocol->coalesce )
+				return NULL;
+			return net_protocol->coalesce ( iobuf, next );
+		}
+	}
+
+	return NULL;
+}
+
+/** A received packet held back for possible coalescing */
+struct net_held_packet {
+	/** I/O buffer (with link-layer header removed), or NULL */
+	struct io_buffer *iobuf;
+	/** Network-layer protocol, in network-byte order */
+	uint16_t net_proto;
+	/** Packet flags */
+	unsigned int flags;
+	/** Link-layer destination address */
+	uint8_t ll_dest[MAX_LL_ADDR_LEN];
+	/** Link-layer source address */
+	uint8_t ll_source[MAX_LL_ADDR_LEN];
+};
+
+/**
+ * Hand held packet to network layer
+ *
+ * @v netdev		Network device
+ * @v held		Held packet
+ */
+static void net_held_rx ( struct net_device *netdev,
+			  struct net_held_packet *held ) {
+	struct io_buffer *iobuf = held->iobuf;
+	int rc;
+
+	/* Do nothing unless a packet is held */
+	if ( ! iobuf )
+		return;
+	held->iobuf = NULL;
+
+	/* Hand packet to network layer */
+	profile_start ( &net_rx_profiler );
+	if ( ( rc = net_rx ( iobuf, netdev, held->net_proto, held->ll_dest,
+			     held->ll_source, held->flags ) ) != 0 ) {
+		/* Record error for diagnosis */
+		netdev_rx_err ( netdev, NULL, rc );
+	}
+	profile_stop ( &net_rx_profiler );
+}
+
+/**
+ * Start batching transmissions
+ *
+ * Packets transmitted until the matching call to net_tx_batch_end()
+ * may be queued to the hardware without individual notification, so
+ * that a burst of transmissions costs only a single doorbell write.
+ * Batches may be nested.
+ */
+void net_tx_batch_start ( void ) {
+
+	net_tx_batch_depth++;
+}
+
+/**
+ * Finish batching transmissions
+ *
+ */
+void net_tx_batch_end ( void ) {
+	struct net_device *netdev;
+
+	/* Do nothing until outermost batch is complete */
+	assert ( net_tx_batch_depth > 0 );
+	if ( --net_tx_batch_depth )
+		return;
+
+	/* Notify hardware of all batched transmissions */
+	list_for_each_entry ( netdev, &open_net_devices, open_list )
+		netdev_tx_batch_flush ( netdev );
+}
+
 /**
  * Poll the network stack
  *
@@ -1125,22 +1298,44 @@ int net_rx ( struct io_buffer *iobuf, struct net_device *netdev,
  */
 void net_poll ( void ) {
 	struct net_device *netdev;
+	struct net_held_packet held;
 	struct io_buffer *iobuf;
+	struct io_buffer *merged;
 	struct ll_protocol *ll_protocol;
 	const void *ll_dest;
 	const void *ll_source;
 	uint16_t net_proto;
 	unsigned int flags;
+	size_t ll_addr_len;
+	unsigned long now;
 	int rc;
 
 	/* Poll and process each network device */
 	list_for_each_entry ( netdev, &net_devices, list ) {
 
+		/* Poll network devices that have been idle for a
+		 * while at most once per interval, to avoid spending
+		 * time polling ports that are not in use.
+		 */
+		now = currticks();
+		if ( ( ! netdev_poll_is_active ( netdev, now ) ) &&
+		     ( ( now - netdev->poll_last ) <
+		       NETDEV_POLL_IDLE_INTERVAL ) ) {
+			continue;
+		}
+		netdev->poll_last = now;
+
 		/* Poll for new packets */
 		profile_start ( &net_poll_profiler );
 		netdev_poll ( netdev );
 		profile_stop ( &net_poll_profiler );
 
+		/* Record activity */
+		if ( ! ( list_empty ( &netdev->rx_queue ) &&
+			 list_empty ( &netdev->tx_queue ) ) ) {
+			netdev->poll_active = now;
+		}
+
 		/* Leave received packets on the queue if receive
 		 * queue processing is currently frozen.  This will
 		 * happen when the raw packets are to be manually
@@ -1150,16 +1345,25 @@ void net_poll ( void ) {
 		if ( netdev_rx_frozen ( netdev ) )
 			continue;
 
-		/* Process all received packets */
+		/* Process all received packets.  Any responses (e.g.
+		 * acknowledgements) generated while processing a
+		 * burst of packets are batched so that the hardware
+		 * is notified only once.  Each packet is held
+		 * back until the following packet has been examined,
+		 * so that consecutive packets belonging to the same
+		 * flow may be coalesced into a single packet.
+		 */
+		net_tx_batch_start();
+		held.iobuf = NULL;
+		ll_protocol = netdev->ll_protocol;
+		ll_addr_len = ll_protocol->ll_addr_len;
 		while ( ( iobuf = netdev_rx_dequeue ( netdev ) ) ) {
 
 			DBGC2 ( netdev, "NETDEV %s processing %p (%p+%zx)\n",
 				netdev->name, iobuf, iobuf->data,
 				iob_len ( iobuf ) );
-			profile_start ( &net_rx_profiler );
 
 			/* Remove link-layer header */
-			ll_protocol = netdev->ll_protocol;
 			if ( ( rc = ll_protocol->pull ( netdev, iobuf,
 							&ll_dest, &ll_source,
 							&net_proto,
@@ -1168,15 +1372,33 @@ void net_poll ( void ) {
 				continue;
 			}
 
-			/* Hand packet to network layer */
-			if ( ( rc = net_rx ( iob_disown ( iobuf ), netdev,
-					     net_proto, ll_dest,
-					     ll_source, flags ) ) != 0 ) {
-				/* Record error for diagnosis */
-				netdev_rx_err ( netdev, NULL, rc );
+			/* Coalesce with held packet, if possible */
+			if ( held.iobuf && ( held.net_proto == net_proto ) &&
+			     ( held.flags == flags ) &&
+			     ( memcmp ( held.ll_dest, ll_dest,
+					ll_addr_len ) == 0 ) &&
+			     ( memcmp ( held.ll_source, ll_source,
+					ll_addr_len ) == 0 ) &&
+			     ( ( merged = net_coalesce ( held.iobuf, iobuf,
+							 net_proto ) ) ) ) {
+				held.iobuf = merged;
+				continue;
 			}
-			profile_stop ( &net_rx_profiler );
+
+			/* Hand any previously held packet to network layer */
+			net_held_rx ( netdev, &held );
+
+			/* Hold this packet */
+			held.iobuf = iobuf;
+			held.net_proto = net_proto;
+			held.flags = flags;
+			memcpy ( held.ll_dest, ll_dest, ll_addr_len );
+			memcpy ( held.ll_source, ll_source, ll_addr_len );
 		}
+
+		/* Hand final held packet to network layer */
+		net_held_rx ( netdev, &held );
+		net_tx_batch_end();
 	}
 }
 
@@ -1189,6 +1411,30 @@ static void net_step ( struct process *process __unused ) {
 	net_poll();
 }
 
+/**
+ * Check for recent network activity
+ *
+ * @ret busy		Network activity is pending
+ */
+static int net_busy ( void ) {
+	struct net_device *netdev;
+	unsigned long now = currticks();
+
+	/* Treat any open network device that has not yet backed off
+	 * its polling as busy.
+	 */
+	list_for_each_entry ( netdev, &open_net_devices, open_list ) {
+		if ( netdev_poll_is_active ( netdev, now ) )
+			return 1;
+	}
+	return 0;
+}
+
+/** Network activity source */
+struct process_busy net_process_busy __process_busy = {
+	.busy = net_busy,
+};
+
 /**
  * Get the VLAN tag control information (when VLAN support is not present)
  *
@@ -1244,6 +1490,16 @@ static unsigned int net_discard ( void ) {
 	struct io_buffer *iobuf;
 	unsigned int discarded = 0;
 
+	/* Release any free pooled receive buffers, since these can be
+	 * discarded without losing any data.
+	 */
+	for_each_netdev ( netdev ) {
+		discarded += netdev->rx_pool.count;
+		iob_pool_flush ( &netdev->rx_pool );
+	}
+	if ( discarded )
+		return discarded;
+
 	/* Try to drop one deferred TX packet from each network device */
 	for_each_netdev ( netdev ) {
 		if ( ( iobuf = list_first_entry ( &netdev->tx_deferred,
@@ -28,6 +28,7 @@
 #include <ipxe/time.h>
 #include <ipxe/socket.h>
 #include <ipxe/tcpip.h>
+#include <ipxe/tcp.h>
 #include <ipxe/in.h>
 #include <ipxe/iobuf.h>
 #include <ipxe/xfer.h>
@@ -50,8 +51,18 @@
 
 FEATURE ( FEATURE_PROTOCOL, "NFS", DHCP_EB_FEATURE_NFS, 1 );
 
+/** Default READ size, used if the server does not report a preference */
 #define NFS_RSIZE 100000
 
+/** Maximum READ size */
+#define NFS_MAX_RSIZE ( 1024 * 1024 )
+
+/** Maximum number of concurrent READ calls */
+#define NFS_MAX_READS 8
+
+/** Maximum length of a reassembled reply header */
+#define NFS_REPLY_HEADER_MAX 2048
+
 enum nfs_pm_state {
 	NFS_PORTMAP_NONE = 0,
 	NFS_PORTMAP_MOUNTPORT,
@@ -68,15 +79,31 @@ enum nfs_mount_state {
 
 enum nfs_state {
 	NFS_NONE = 0,
+	NFS_FSINFO,
+	NFS_FSINFO_SENT,
 	NFS_LOOKUP,
 	NFS_LOOKUP_SENT,
 	NFS_READLINK,
 	NFS_READLINK_SENT,
 	NFS_READ,
-	NFS_READ_SENT,
 	NFS_CLOSED,
 };
 
+/**
+ * A NFS READ call
+ *
+ */
+struct nfs_read {
+	/** ONC RPC call identifier */
+	uint32_t                rpc_id;
+	/** File offset */
+	uint64_t                offset;
+	/** Length, or zero if this call is not in use */
+	uint32_t                len;
+	/** Call has been sent */
+	int                     sent;
+};
+
 /**
  * A NFS request
  *
@@ -107,8 +134,23 @@ struct nfs_request {
 	struct nfs_fh           readlink_fh;
 	struct nfs_fh           current_fh;
 	uint64_t                file_offset;
-
+	uint64_t                filesize;
+
+	/** READ size */
+	uint32_t                rsize;
+	/** Maximum number of concurrent READ calls */
+	unsigned int            max_reads;
+	/** READ calls */
+	struct nfs_read         reads[NFS_MAX_READS];
+
+	/** Partially received reply header */
+	struct io_buffer        *reply;
+	/** File offset of the next data byte in the current READ reply */
+	uint64_t                read_offset;
+	/** Remaining data bytes in the current READ reply */
 	size_t                  remaining;
+	/** Remaining bytes to discard from the current reply */
+	size_t                  skip;
 	int                     eof;
 };
 
@@ -127,6 +169,7 @@ static void nfs_free ( struct refcnt *refcnt ) {
 
 	nfs_uri_free ( &nfs->uri );
 
+	free_iob ( nfs->reply );
 	free ( nfs->hostname );
 	free ( nfs->auth_sys.hostname );
 	free ( nfs );
@@ -343,7 +386,7 @@ static int nfs_mount_deliver ( struct nfs_request *nfs,
 		}
 
 		nfs->current_fh = mnt_reply.fh;
-		nfs->nfs_state = NFS_LOOKUP;
+		nfs->nfs_state = NFS_FSINFO;
 		nfs_step ( nfs );
 
 		goto done;
@@ -364,6 +407,109 @@ done:
 	return 0;
 }
 
+/**
+ * Set READ size
+ *
+ * @v nfs		NFS request
+ * @v rsize		READ size
+ *
+ * Enough READ calls are kept in flight to fill the TCP receive
+ * window, up to a maximum of NFS_MAX_READS.
+ */
+static void nfs_set_rsize ( struct nfs_request *nfs, uint32_t rsize ) {
+
+	if ( rsize > NFS_MAX_RSIZE )
+		rsize = NFS_MAX_RSIZE;
+	nfs->rsize = rsize;
+	nfs->max_reads = ( TCP_MAX_WINDOW_SIZE / rsize );
+	if ( nfs->max_reads > NFS_MAX_READS )
+		nfs->max_reads = NFS_MAX_READS;
+	if ( ! nfs->max_reads )
+		nfs->max_reads = 1;
+
+	DBGC ( nfs, "NFS_OPEN %p using rsize %d with up to %d READs in "
+	       "flight\n", nfs, nfs->rsize, nfs->max_reads );
+}
+
+/**
+ * Check for outstanding READ calls
+ *
+ * @v nfs		NFS request
+ * @ret busy		READ calls are outstanding
+ */
+static int nfs_read_busy ( struct nfs_request *nfs ) {
+	unsigned int i;
+
+	for ( i = 0 ; i < nfs->max_reads ; i++ ) {
+		if ( nfs->reads[i].len )
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Check for further file data to be requested
+ *
+ * @v nfs		NFS request
+ * @ret more		Further data remains to be requested
+ *
+ * Until the file size is known (from the attributes in the first
+ * READ reply), only a single READ call is issued at a time.
+ */
+static int nfs_read_more ( struct nfs_request *nfs ) {
+
+	if ( nfs->eof )
+		return 0;
+	if ( nfs->filesize )
+		return ( nfs->file_offset < nfs->filesize );
+	return ( ! nfs_read_busy ( nfs ) );
+}
+
+/**
+ * Issue READ calls
+ *
+ * @v nfs		NFS request
+ * @ret rc		Return status code
+ */
+static int nfs_read_step ( struct nfs_request *nfs ) {
+	struct nfs_read *read;
+	unsigned int i;
+	int rc;
+
+	for ( i = 0 ; i < nfs->max_reads ; i++ ) {
+		read = &nfs->reads[i];
+
+		/* Start a new READ, if applicable */
+		if ( ! read->len ) {
+			if ( ! nfs_read_more ( nfs ) )
+				continue;
+			read->offset = nfs->file_offset;
+			read->len = nfs->rsize;
+			read->sent = 0;
+			nfs->file_offset += nfs->rsize;
+		}
+
+		/* Send READ call, if not already sent */
+		if ( read->sent )
+			continue;
+		if ( ! xfer_window ( &nfs->nfs_intf ) )
+			return 0;
+
+		DBGC ( nfs, "NFS_OPEN %p READ call (%#llx+%#x)\n", nfs,
+		       ( ( unsigned long long ) read->offset ), read->len );
+
+		rc = nfs_read ( &nfs->nfs_intf, &nfs->nfs_session,
+		                &nfs->current_fh, read->offset, read->len );
+		if ( rc != 0 )
+			return rc;
+
+		read->rpc_id = nfs->nfs_session.rpc_id;
+		read->sent = 1;
+	}
+
+	return 0;
+}
+
 static void nfs_step ( struct nfs_request *nfs ) {
 	int     rc;
 	char    *path_component;
@@ -371,6 +517,18 @@ static void nfs_step ( struct nfs_request *nfs ) {
 	if ( ! xfer_window ( &nfs->nfs_intf ) )
 		return;
 
+	if ( nfs->nfs_state == NFS_FSINFO ) {
+		DBGC ( nfs, "NFS_OPEN %p FSINFO call\n", nfs );
+
+		rc = nfs_fsinfo ( &nfs->nfs_intf, &nfs->nfs_session,
+		                  &nfs->current_fh );
+		if ( rc != 0 )
+			goto err;
+
+		nfs->nfs_state++;
+		return;
+	}
+
 	if ( nfs->nfs_state == NFS_LOOKUP ) {
 		path_component = nfs_uri_next_path_component ( &nfs->uri );
 
@@ -400,15 +558,10 @@ static void nfs_step ( struct nfs_request *nfs ) {
 	}
 
 	if ( nfs->nfs_state == NFS_READ ) {
-		DBGC ( nfs, "NFS_OPEN %p READ call\n", nfs );
-
-		rc = nfs_read ( &nfs->nfs_intf, &nfs->nfs_session,
-		                &nfs->current_fh, nfs->file_offset,
-		                NFS_RSIZE );
+		rc = nfs_read_step ( nfs );
 		if ( rc != 0 )
 			goto err;
 
-		nfs->nfs_state++;
 		return;
 	}
 
@@ -417,18 +570,184 @@ err:
 	nfs_done ( nfs, rc );
 }
 
-static int nfs_deliver ( struct nfs_request *nfs,
-                         struct io_buffer *io_buf,
-                         struct xfer_metadata *meta __unused ) {
+/**
+ * Continue or complete file data transfer
+ *
+ * @v nfs		NFS request
+ */
+static void nfs_read_continue ( struct nfs_request *nfs ) {
+
+	/* Wait until current reply data has been received */
+	if ( nfs->remaining )
+		return;
+
+	/* Issue further READ calls, if applicable */
+	if ( nfs_read_busy ( nfs ) || nfs_read_more ( nfs ) ) {
+		nfs_step ( nfs );
+		return;
+	}
+
+	/* Transfer is complete */
+	DBGC ( nfs, "NFS_OPEN %p finished reading\n", nfs );
+	intf_shutdown ( &nfs->nfs_intf, 0 );
+	nfs->nfs_state = NFS_CLOSED;
+	nfs->mount_state++;
+	nfs_mount_step ( nfs );
+}
+
+/**
+ * Deliver READ reply data
+ *
+ * @v nfs		NFS request
+ * @v io_buf		I/O buffer
+ * @v len		Length of data to deliver
+ * @ret rc		Return status code
+ *
+ * The data is delivered at its absolute file offset, since replies
+ * to concurrent READ calls may arrive in any order.  The I/O buffer
+ * is passed on directly if it contains only file data; otherwise the
+ * data is copied.
+ */
+static int nfs_read_data ( struct nfs_request *nfs,
+                           struct io_buffer **io_buf, size_t len ) {
+	struct xfer_metadata    meta;
+	int                     rc;
+
+	memset ( &meta, 0, sizeof ( meta ) );
+	meta.flags = XFER_FL_ABS_OFFSET;
+	meta.offset = nfs->read_offset;
+
+	DBGC2 ( nfs, "NFS_OPEN %p got %zd bytes at %#llx\n", nfs, len,
+	        ( ( unsigned long long ) nfs->read_offset ) );
+
+	if ( len == iob_len ( *io_buf ) ) {
+		rc = xfer_deliver ( &nfs->xfer, iob_disown ( *io_buf ),
+		                    &meta );
+	} else {
+		rc = xfer_deliver_raw_meta ( &nfs->xfer, ( *io_buf )->data,
+		                             len, &meta );
+		iob_pull ( *io_buf, len );
+	}
+	if ( rc != 0 )
+		return rc;
+
+	nfs->read_offset += len;
+	nfs->remaining -= len;
+
+	return 0;
+}
+
+/**
+ * Process READ reply
+ *
+ * @v nfs		NFS request
+ * @v reply		ONC RPC reply
+ * @ret rc		Return status code
+ */
+static int nfs_read_reply ( struct nfs_request *nfs,
+                            struct oncrpc_reply *reply ) {
+	struct nfs_read_reply   read_reply;
+	struct nfs_read         *read = NULL;
+	unsigned int            i;
+	int                     rc;
+
+	/* Identify READ call */
+	for ( i = 0 ; i < nfs->max_reads ; i++ ) {
+		if ( nfs->reads[i].len && nfs->reads[i].sent &&
+		     ( nfs->reads[i].rpc_id == reply->rpc_id ) ) {
+			read = &nfs->reads[i];
+			break;
+		}
+	}
+	if ( ! read ) {
+		DBGC ( nfs, "NFS_OPEN %p got unexpected READ reply %#08x\n",
+		       nfs, reply->rpc_id );
+		return -EPROTO;
+	}
+
+	memset ( &read_reply, 0, sizeof ( read_reply ) );
+	rc = nfs_get_read_reply ( &read_reply, reply );
+	if ( rc != 0 )
+		return rc;
+
+	DBGC ( nfs, "NFS_OPEN %p got READ reply (%#llx+%#x)%s\n", nfs,
+	       ( ( unsigned long long ) read->offset ), read_reply.count,
+	       ( read_reply.eof ? " EOF" : "" ) );
+
+	/* Record file size, if not already known */
+	if ( read_reply.filesize && ! nfs->filesize ) {
+		DBGC2 ( nfs, "NFS_OPEN %p size: %llu bytes\n",
+		        nfs, read_reply.filesize );
+		nfs->filesize = read_reply.filesize;
+		xfer_seek ( &nfs->xfer, read_reply.filesize );
+		xfer_seek ( &nfs->xfer, 0 );
+	}
+
+	/* Prepare to receive data */
+	nfs->read_offset = read->offset;
+	nfs->remaining = read_reply.count;
+	if ( read_reply.eof )
+		nfs->eof = 1;
+
+	/* Release READ call, or reissue for any unread remainder */
+	if ( read_reply.eof || ( read_reply.count >= read->len ) ) {
+		read->len = 0;
+	} else if ( read_reply.count ) {
+		read->offset += read_reply.count;
+		read->len -= read_reply.count;
+		read->sent = 0;
+	} else {
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+/**
+ * Process a complete reply header
+ *
+ * @v nfs		NFS request
+ * @v io_buf		Reassembled reply header
+ * @v record_len	Total length of reply record
+ * @ret rc		Return status code
+ *
+ * Any READ data within the reply header buffer is delivered,
+ * possibly by passing on the buffer itself (in which case the
+ * buffer pointer will be cleared).
+ */
+static int nfs_reply ( struct nfs_request *nfs, struct io_buffer **io_buf,
+                       size_t record_len ) {
 	int                     rc;
 	struct oncrpc_reply     reply;
+	size_t                  unreceived;
+	size_t                  len;
 
-	if ( nfs->remaining == 0 ) {
-		oncrpc_get_reply ( &nfs->nfs_session, &reply, io_buf );
-		if ( reply.accept_state != 0 ) {
-			rc = -EPROTO;
-			goto err;
+	unreceived = ( record_len - iob_len ( *io_buf ) );
+
+	oncrpc_get_reply ( &nfs->nfs_session, &reply, *io_buf );
+	if ( reply.accept_state != 0 )
+		return -EPROTO;
+
+	if ( nfs->nfs_state == NFS_FSINFO_SENT ) {
+		struct nfs_fsinfo_reply fsinfo_reply;
+
+		DBGC ( nfs, "NFS_OPEN %p got FSINFO reply\n", nfs );
+
+		/* Failure is non-fatal; keep the default READ size */
+		rc = nfs_get_fsinfo_reply ( &fsinfo_reply, &reply );
+		if ( rc == 0 ) {
+			DBGC ( nfs, "NFS_OPEN %p rtmax %d rtpref %d\n", nfs,
+			       fsinfo_reply.rtmax, fsinfo_reply.rtpref );
+			if ( fsinfo_reply.rtpref )
+				nfs_set_rsize ( nfs, fsinfo_reply.rtpref );
+			else if ( fsinfo_reply.rtmax )
+				nfs_set_rsize ( nfs, fsinfo_reply.rtmax );
 		}
+
+		nfs->skip = unreceived;
+		nfs->nfs_state = NFS_LOOKUP;
+		nfs_step ( nfs );
+		return 0;
 	}
 
 	if ( nfs->nfs_state == NFS_LOOKUP_SENT ) {
@@ -438,7 +757,7 @@ static int nfs_deliver ( struct nfs_request *nfs,
 
 		rc = nfs_get_lookup_reply ( &lookup_reply, &reply );
 		if ( rc != 0 )
-			goto err;
+			return rc;
 
 		if ( lookup_reply.ent_type == NFS_ATTR_SYMLINK ) {
 			nfs->readlink_fh = lookup_reply.fh;
@@ -452,8 +771,9 @@ static int nfs_deliver ( struct nfs_request *nfs,
 				nfs->nfs_state--;
 		}
 
+		nfs->skip = unreceived;
 		nfs_step ( nfs );
-		goto done;
+		return 0;
 	}
 
 	if ( nfs->nfs_state == NFS_READLINK_SENT ) {
@@ -464,20 +784,14 @@ static int nfs_deliver ( struct nfs_request *nfs,
 
 		rc = nfs_get_readlink_reply ( &readlink_reply, &reply );
 		if ( rc != 0 )
-			goto err;
+			return rc;
 
 		if ( readlink_reply.path_len == 0 )
-		{
-			rc = -EINVAL;
-			goto err;
-		}
+			return -EINVAL;
 
 		if ( ! ( path = strndup ( readlink_reply.path,
 		                          readlink_reply.path_len ) ) )
-		{
-			rc = -ENOMEM;
-			goto err;
-		}
+			return -ENOMEM;
 
 		nfs_uri_symlink ( &nfs->uri, path );
 		free ( path );
@@ -485,66 +799,132 @@ static int nfs_deliver ( struct nfs_request *nfs,
 		DBGC ( nfs, "NFS_OPEN %p new path: %s\n", nfs,
 		       nfs->uri.path );
 
+		nfs->skip = unreceived;
 		nfs->nfs_state = NFS_LOOKUP;
 		nfs_step ( nfs );
-		goto done;
+		return 0;
 	}
 
-	if ( nfs->nfs_state == NFS_READ_SENT ) {
-		if ( nfs->remaining == 0 ) {
-			DBGC ( nfs, "NFS_OPEN %p got READ reply\n", nfs );
-
-			struct nfs_read_reply read_reply;
+	if ( nfs->nfs_state == NFS_READ ) {
+		rc = nfs_read_reply ( nfs, &reply );
+		if ( rc != 0 )
+			return rc;
 
-			rc = nfs_get_read_reply ( &read_reply, &reply );
+		/* Deliver any data already received with the header */
+		len = iob_len ( *io_buf );
+		if ( len > nfs->remaining )
+			len = nfs->remaining;
+		if ( ( nfs->remaining - len ) > unreceived )
+			return -EPROTO;
+		nfs->skip = ( unreceived - ( nfs->remaining - len ) );
+		if ( len ) {
+			rc = nfs_read_data ( nfs, io_buf, len );
 			if ( rc != 0 )
-				goto err;
-
-			if ( nfs->file_offset == 0 ) {
-				DBGC2 ( nfs, "NFS_OPEN %p size: %llu bytes\n",
-				        nfs, read_reply.filesize );
+				return rc;
+		}
 
-				xfer_seek ( &nfs->xfer, read_reply.filesize );
-				xfer_seek ( &nfs->xfer, 0 );
-			}
+		nfs_read_continue ( nfs );
+		return 0;
+	}
 
-			nfs->file_offset += read_reply.count;
-			nfs->remaining    = read_reply.count;
-			nfs->eof          = read_reply.eof;
-		}
+	return -EPROTO;
+}
 
-		size_t len = iob_len ( io_buf );
-		if ( len > nfs->remaining )
-			iob_unput ( io_buf, len - nfs->remaining );
+/**
+ * Receive data from NFS server
+ *
+ * @v nfs		NFS request
+ * @v io_buf		I/O buffer
+ * @v meta		Data transfer metadata
+ * @ret rc		Return status code
+ *
+ * Several replies may be outstanding at any time, so reply
+ * boundaries may fall anywhere within a received I/O buffer.  Each
+ * reply header is reassembled before being parsed; any READ data
+ * following the header is then passed through as it arrives.
+ */
+static int nfs_deliver ( struct nfs_request *nfs,
+                         struct io_buffer *io_buf,
+                         struct xfer_metadata *meta __unused ) {
+	struct io_buffer        *reply;
+	size_t                  record_len;
+	size_t                  want;
+	size_t                  len;
+	int                     rc;
 
-		nfs->remaining -= iob_len ( io_buf );
+	while ( io_buf && iob_len ( io_buf ) &&
+	        ( nfs->nfs_state != NFS_CLOSED ) ) {
 
-		DBGC ( nfs, "NFS_OPEN %p got %zd bytes\n", nfs,
-		       iob_len ( io_buf ) );
+		/* Pass through READ data, if applicable */
+		if ( nfs->remaining ) {
+			len = iob_len ( io_buf );
+			if ( len > nfs->remaining )
+				len = nfs->remaining;
+			rc = nfs_read_data ( nfs, &io_buf, len );
+			if ( rc != 0 )
+				goto err;
+			nfs_read_continue ( nfs );
+			continue;
+		}
 
-		rc = xfer_deliver_iob ( &nfs->xfer, iob_disown ( io_buf ) );
-		if ( rc != 0 )
-			goto err;
+		/* Discard any unused remainder of the previous reply */
+		if ( nfs->skip ) {
+			len = iob_len ( io_buf );
+			if ( len > nfs->skip )
+				len = nfs->skip;
+			iob_pull ( io_buf, len );
+			nfs->skip -= len;
+			continue;
+		}
 
-		if ( nfs->remaining == 0 ) {
-			if ( ! nfs->eof ) {
-				nfs->nfs_state--;
-				nfs_step ( nfs );
-			} else {
-				intf_shutdown ( &nfs->nfs_intf, 0 );
-				nfs->nfs_state++;
-				nfs->mount_state++;
-				nfs_mount_step ( nfs );
+		/* Allocate reply header buffer, if necessary */
+		if ( ! nfs->reply ) {
+			nfs->reply = alloc_iob ( NFS_REPLY_HEADER_MAX );
+			if ( ! nfs->reply ) {
+				rc = -ENOMEM;
+				goto err;
 			}
 		}
-
-		return 0;
+		reply = nfs->reply;
+
+		/* Determine length of reply header to reassemble */
+		record_len = sizeof ( uint32_t );
+		if ( iob_len ( reply ) >= sizeof ( uint32_t ) ) {
+			len = GET_FRAME_SIZE (
+				ntohl ( *( ( uint32_t * ) reply->data ) ) );
+			if ( ! len ) {
+				rc = -EPROTO;
+				goto err;
+			}
+			record_len += len;
+		}
+		want = record_len;
+		if ( want > NFS_REPLY_HEADER_MAX )
+			want = NFS_REPLY_HEADER_MAX;
+
+		/* Append to reply header */
+		len = ( want - iob_len ( reply ) );
+		if ( len > iob_len ( io_buf ) )
+			len = iob_len ( io_buf );
+		memcpy ( iob_put ( reply, len ), io_buf->data, len );
+		iob_pull ( io_buf, len );
+		if ( ( iob_len ( reply ) < want ) ||
+		     ( want == sizeof ( uint32_t ) ) )
+			continue;
+
+		/* Process complete reply header */
+		nfs->reply = NULL;
+		rc = nfs_reply ( nfs, &reply, record_len );
+		free_iob ( reply );
+		if ( rc != 0 )
+			goto err;
 	}
 
-	rc = -EPROTO;
+	free_iob ( io_buf );
+	return 0;
+
 err:
 	nfs_done ( nfs, rc );
-done:
 	free_iob ( io_buf );
 	return 0;
 }
@@ -653,6 +1033,8 @@ static int nfs_open ( struct interface *xfer, struct uri *uri ) {
 	mount_init_session ( &nfs->mount_session, &nfs->auth_sys.credential );
 	nfs_init_session ( &nfs->nfs_session, &nfs->auth_sys.credential );
 
+	nfs_set_rsize ( nfs, NFS_RSIZE );
+
 	DBGC ( nfs, "NFS_OPEN %p connecting to port mapper (%s:%d)...\n", nfs,
 	       nfs->hostname, PORTMAP_PORT );
 
@@ -33,6 +33,9 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/timer.h>
 #include <ipxe/profile.h>
 #include <ipxe/fault.h>
+#include <ipxe/malloc.h>
+#include <ipxe/umalloc.h>
+#include <ipxe/settings.h>
 #include <ipxe/pccrr.h>
 #include <ipxe/peerblk.h>
 
@@ -43,12 +46,17 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  */
 
 /** PeerDist decryption chunksize
+ *
+ * Larger chunks amortise the per-chunk overhead of the decryption
+ * process (including a temporary buffer allocation and two copies
+ * through the data transfer buffers) at the cost of holding off
+ * other processes for longer.
  *
  * This is a policy decision.
  */
-#define PEERBLK_DECRYPT_CHUNKSIZE 2048
+#define PEERBLK_DECRYPT_CHUNKSIZE 16384
 
-/** PeerDist maximum number of concurrent raw block downloads
+/** PeerDist initial maximum number of concurrent raw block downloads
  *
  * Raw block downloads are expensive if the origin server uses HTTPS,
  * since each concurrent download will require local TLS resources
@@ -61,12 +69,21 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  * connection to go through the full client certificate verification.
  *
  * Limit the total number of concurrent raw block downloads to
- * ameliorate these problems.
+ * ameliorate these problems.  The limit is raised by one after each
+ * full window of consecutive successful raw block downloads, and
+ * halved after any failure, up to the ceiling defined below (or as
+ * overridden via the "peerorigin" setting).
  *
  * This is a policy decision.
  */
 #define PEERBLK_RAW_MAX 2
 
+/** PeerDist default ceiling for concurrent raw block downloads
+ *
+ * This is a policy decision.
+ */
+#define PEERBLK_RAW_LIMIT 8
+
 /** PeerDist raw block download attempt initial progress timeout
  *
  * This is a policy decision.
@@ -102,6 +119,27 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  */
 #define PEERBLK_MAX_ATTEMPT_CYCLES 4
 
+/** PeerDist block cache maximum size
+ *
+ * Successfully downloaded blocks are retained (subject to this limit
+ * and to memory pressure) so that subsequent downloads of the same
+ * content within this session do not need to fetch them again.  The
+ * cached data is held in external memory, since this limit is far
+ * larger than the internal heap.
+ *
+ * This is a policy decision.
+ */
+#define PEERBLK_CACHE_MAX ( 16 * 1024 * 1024 )
+
+/** PeerDist ceiling for concurrent raw block downloads */
+static unsigned int peerblk_raw_limit = PEERBLK_RAW_LIMIT;
+
+/** PeerDist block cache, most recently used first */
+static LIST_HEAD ( peerblk_cache );
+
+/** Total length of data within PeerDist block cache */
+static size_t peerblk_cache_len;
+
 /** PeerDist block download profiler */
 static struct profiler peerblk_download_profiler __profiler =
 	{ .name = "peerblk.download" };
@@ -127,6 +165,8 @@ static struct profiler peerblk_discovery_timeout_profiler __profiler =
 	{ .name = "peerblk.discovery.timeout" };
 
 static void peerblk_dequeue ( struct peerdist_block *peerblk );
+static void peerblk_cache_add ( struct peerdist_block *peerblk );
+static void peerblk_raw_adapt ( int rc );
 
 /**
  * Get profiling timestamp
@@ -153,6 +193,7 @@ static void peerblk_free ( struct refcnt *refcnt ) {
 		container_of ( refcnt, struct peerdist_block, refcnt );
 
 	uri_put ( peerblk->uri );
+	ref_put ( &peerblk->cached->refcnt );
 	free ( peerblk->cipherctx );
 	free ( peerblk );
 }
@@ -287,6 +328,28 @@ static int peerblk_deliver ( struct peerdist_block *peerblk,
 	return 0;
 }
 
+/**
+ * Penalise failed PeerDist block download attempt
+ *
+ * @v peerblk		PeerDist block download
+ * @v peer		Peer (or NULL for a raw download attempt)
+ * @v rc		Reason for failure
+ */
+static void peerblk_penalise ( struct peerdist_block *peerblk,
+			       struct peerdisc_peer *peer, int rc ) {
+
+	/* Treat a failed peer as having taken the maximum time, so
+	 * that a peer which fails quickly is not preferred.
+	 */
+	if ( peer ) {
+		DBGC2 ( peerblk, "PEERBLK %p %d.%d penalising %s\n", peerblk,
+			peerblk->segment, peerblk->block, peer->location );
+		peer->latency = PEERBLK_RETRIEVAL_RX_TIMEOUT;
+	} else {
+		peerblk_raw_adapt ( rc );
+	}
+}
+
 /**
  * Finish PeerDist block download attempt
  *
@@ -300,6 +363,11 @@ static void peerblk_done ( struct peerdist_block *peerblk, int rc ) {
 	struct peerdisc_peer *peer;
 	uint8_t hash[digest->digestsize];
 	unsigned long now = peerblk_timestamp();
+	unsigned long elapsed = ( currticks() - peerblk->attempted );
+
+	/* Identify peer (or NULL for a raw download attempt) */
+	head = list_entry ( &segment->peers, struct peerdisc_peer, list );
+	peer = ( ( peerblk->peer == head ) ? NULL : peerblk->peer );
 
 	/* Check for errors on completion */
 	if ( rc != 0 ) {
@@ -324,9 +392,17 @@ static void peerblk_done ( struct peerdist_block *peerblk, int rc ) {
 	profile_custom ( &peerblk_attempt_success_profiler,
 			 ( now - peerblk->attempted ) );
 
+	/* Add block to cache */
+	peerblk_cache_add ( peerblk );
+
+	/* Record peer retrieval time, or adapt raw download limit */
+	if ( peer ) {
+		peerdisc_rate ( segment, peer, elapsed );
+	} else {
+		peerblk_raw_adapt ( 0 );
+	}
+
 	/* Report peer statistics */
-	head = list_entry ( &segment->peers, struct peerdisc_peer, list );
-	peer = ( ( peerblk->peer == head ) ? NULL : peerblk->peer );
 	peerdisc_stat ( &peerblk->xfer, peer, &segment->peers );
 
 	/* Close download */
@@ -334,6 +410,9 @@ static void peerblk_done ( struct peerdist_block *peerblk, int rc ) {
 	return;
 
  err:
+	/* Penalise the peer, or the raw download limit */
+	peerblk_penalise ( peerblk, peer, rc );
+
 	/* Record failure reason and schedule a retry attempt */
 	profile_custom ( &peerblk_attempt_failure_profiler,
 			 ( now - peerblk->attempted ) );
@@ -567,6 +646,32 @@ static struct peerdist_block_queue peerblk_raw_queue = {
 	.open = peerblk_raw_open,
 };
 
+/**
+ * Adapt raw block download limit
+ *
+ * @v rc		Raw block download attempt status code
+ */
+static void peerblk_raw_adapt ( int rc ) {
+	struct peerdist_block_queue *queue = &peerblk_raw_queue;
+
+	if ( rc == 0 ) {
+		/* Raise limit after a full window of successes */
+		if ( ( ++queue->successes >= queue->max ) &&
+		     ( queue->max < peerblk_raw_limit ) ) {
+			queue->max++;
+			queue->successes = 0;
+			DBGC2 ( queue, "PEERBLK raw limit raised to %d\n",
+				queue->max );
+		}
+	} else {
+		/* Halve limit on any failure */
+		queue->max = ( ( queue->max + 1 ) / 2 );
+		queue->successes = 0;
+		DBGC2 ( queue, "PEERBLK raw limit reduced to %d\n",
+			queue->max );
+	}
+}
+
 /******************************************************************************
  *
  * Retrieval protocol block download attempts (using HTTP POST)
@@ -1262,6 +1367,197 @@ static void peerblk_retrieval_close ( struct peerdist_block *peerblk, int rc ) {
 	peerblk_done ( peerblk, rc );
 }
 
+/******************************************************************************
+ *
+ * Block cache
+ *
+ ******************************************************************************
+ */
+
+/**
+ * Calculate cached range of PeerDist block
+ *
+ * @v peerblk		PeerDist block download
+ * @v range		Range relative to start of block to fill in
+ */
+static void peerblk_cache_range ( struct peerdist_block *peerblk,
+				  struct peerdist_range *range ) {
+
+	range->start = ( peerblk->trim.start - peerblk->range.start );
+	range->end = ( peerblk->trim.end - peerblk->range.start );
+}
+
+/**
+ * Find PeerDist block in cache
+ *
+ * @v peerblk		PeerDist block download
+ * @ret cached		Cached block, or NULL if not found
+ */
+static struct peerdist_cached_block *
+peerblk_cache_find ( struct peerdist_block *peerblk ) {
+	struct peerdist_cached_block *cached;
+	struct peerdist_range range;
+
+	/* Search for a matching block */
+	peerblk_cache_range ( peerblk, &range );
+	list_for_each_entry ( cached, &peerblk_cache, list ) {
+		if ( ( cached->digestsize == peerblk->digestsize ) &&
+		     ( memcmp ( cached->id, peerblk->id,
+				peerblk->digestsize ) == 0 ) &&
+		     ( memcmp ( cached->hash, peerblk->hash,
+				peerblk->digestsize ) == 0 ) &&
+		     ( cached->range.start == range.start ) &&
+		     ( cached->range.end == range.end ) ) {
+
+			/* Move to head of cache */
+			list_del ( &cached->list );
+			list_add ( &cached->list, &peerblk_cache );
+			return cached;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Free cached PeerDist block
+ *
+ * @v refcnt		Reference count
+ */
+static void peerblk_cache_free ( struct refcnt *refcnt ) {
+	struct peerdist_cached_block *cached =
+		container_of ( refcnt, struct peerdist_cached_block, refcnt );
+
+	ufree ( cached->data );
+	free ( cached );
+}
+
+/**
+ * Remove cached PeerDist block
+ *
+ * @v cached		Cached block
+ */
+static void peerblk_cache_del ( struct peerdist_cached_block *cached ) {
+
+	list_del ( &cached->list );
+	peerblk_cache_len -= ( cached->range.end - cached->range.start );
+	ref_put ( &cached->refcnt );
+}
+
+/**
+ * Add PeerDist block to cache
+ *
+ * @v peerblk		PeerDist block download
+ */
+static void peerblk_cache_add ( struct peerdist_block *peerblk ) {
+	struct peerdist_cached_block *cached;
+	struct xfer_buffer *xferbuf;
+	size_t len;
+	int rc;
+
+	/* Do nothing if block is already cached */
+	if ( peerblk->cached || peerblk_cache_find ( peerblk ) )
+		return;
+
+	/* Do nothing if block is too large to cache */
+	len = ( peerblk->trim.end - peerblk->trim.start );
+	if ( ( len == 0 ) || ( len > PEERBLK_CACHE_MAX ) )
+		return;
+
+	/* Do nothing if we cannot read back the delivered data */
+	xferbuf = xfer_buffer ( &peerblk->xfer );
+	if ( ! xferbuf )
+		return;
+
+	/* Allocate and populate cached block */
+	cached = zalloc ( sizeof ( *cached ) );
+	if ( ! cached )
+		return;
+	ref_init ( &cached->refcnt, peerblk_cache_free );
+	memcpy ( cached->id, peerblk->id, sizeof ( cached->id ) );
+	memcpy ( cached->hash, peerblk->hash, sizeof ( cached->hash ) );
+	cached->digestsize = peerblk->digestsize;
+	peerblk_cache_range ( peerblk, &cached->range );
+	cached->data = umalloc ( len );
+	if ( ! cached->data ) {
+		ref_put ( &cached->refcnt );
+		return;
+	}
+	if ( ( rc = xferbuf_read ( xferbuf, peerblk->offset,
+				   user_to_virt ( cached->data, 0 ),
+				   len ) ) != 0 ) {
+		DBGC ( peerblk, "PEERBLK %p %d.%d could not read back data: "
+		       "%s\n", peerblk, peerblk->segment, peerblk->block,
+		       strerror ( rc ) );
+		ref_put ( &cached->refcnt );
+		return;
+	}
+
+	/* Discard least recently used blocks to make room */
+	while ( ( peerblk_cache_len + len ) > PEERBLK_CACHE_MAX ) {
+		peerblk_cache_del ( list_last_entry ( &peerblk_cache,
+						      struct peerdist_cached_block,
+						      list ) );
+	}
+
+	/* Add to head of cache */
+	list_add ( &cached->list, &peerblk_cache );
+	peerblk_cache_len += len;
+	DBGC2 ( peerblk, "PEERBLK %p %d.%d cached (%zd bytes in cache)\n",
+		peerblk, peerblk->segment, peerblk->block, peerblk_cache_len );
+}
+
+/**
+ * Deliver PeerDist block from cache
+ *
+ * @v peerblk		PeerDist block download
+ * @ret rc		Return status code
+ */
+static int peerblk_cache_deliver ( struct peerdist_block *peerblk ) {
+	struct peerdist_cached_block *cached = peerblk->cached;
+	struct xfer_metadata meta;
+	struct io_buffer *iobuf;
+	size_t len = ( cached->range.end - cached->range.start );
+
+	DBGC2 ( peerblk, "PEERBLK %p %d.%d delivering from cache\n",
+		peerblk, peerblk->segment, peerblk->block );
+
+	/* Construct I/O buffer */
+	iobuf = xfer_alloc_iob ( &peerblk->xfer, len );
+	if ( ! iobuf )
+		return -ENOMEM;
+	copy_from_user ( iob_put ( iobuf, len ), cached->data, 0, len );
+
+	/* Deliver data */
+	memset ( &meta, 0, sizeof ( meta ) );
+	meta.flags = XFER_FL_ABS_OFFSET;
+	meta.offset = peerblk->offset;
+	return xfer_deliver ( &peerblk->xfer, iob_disown ( iobuf ), &meta );
+}
+
+/**
+ * Discard some cached PeerDist blocks
+ *
+ * @ret discarded	Number of cached items discarded
+ */
+static unsigned int peerblk_discard ( void ) {
+	struct peerdist_cached_block *cached;
+
+	/* Discard least recently used block */
+	cached = list_last_entry ( &peerblk_cache, struct peerdist_cached_block,
+				   list );
+	if ( ! cached )
+		return 0;
+	peerblk_cache_del ( cached );
+
+	return 1;
+}
+
+/** PeerDist block cache discarder */
+struct cache_discarder peerblk_discarder __cache_discarder ( CACHE_NORMAL ) = {
+	.discard = peerblk_discard,
+};
+
 /******************************************************************************
  *
  * Retry policy
@@ -1280,10 +1576,19 @@ static void peerblk_expired ( struct retry_timer *timer, int over __unused ) {
 		container_of ( timer, struct peerdist_block, timer );
 	struct peerdisc_segment *segment = peerblk->discovery.segment;
 	struct peerdisc_peer *head;
+	struct peerdisc_peer *prev;
+	struct peerdisc_peer *peer;
 	unsigned long now = peerblk_timestamp();
-	const char *location;
 	int rc;
 
+	/* Deliver from cache, if applicable */
+	if ( peerblk->cached ) {
+		if ( ( rc = peerblk_cache_deliver ( peerblk ) ) == 0 )
+			peerdisc_stat ( &peerblk->xfer, NULL, NULL );
+		peerblk_close ( peerblk, rc );
+		return;
+	}
+
 	/* Profile discovery timeout, if applicable */
 	if ( ( peerblk->peer == NULL ) && ( timer->timeout != 0 ) ) {
 		profile_custom ( &peerblk_discovery_timeout_profiler,
@@ -1300,13 +1605,22 @@ static void peerblk_expired ( struct retry_timer *timer, int over __unused ) {
 		DBGC ( peerblk, "PEERBLK %p %d.%d timed out after %ld ticks\n",
 		       peerblk, peerblk->segment, peerblk->block,
 		       timer->timeout );
+
+		/* Penalise the peer, or the raw download limit */
+		head = list_entry ( &segment->peers, struct peerdisc_peer,
+				    list );
+		peerblk_penalise ( peerblk, ( ( peerblk->peer == head ) ?
+					      NULL : peerblk->peer ),
+				   -ETIMEDOUT );
 	}
 
 	/* Abort any current download attempt */
 	peerblk_reset ( peerblk, -ETIMEDOUT );
 
-	/* Record attempt start time */
-	peerblk->attempted = now;
+	/* Record attempt start time (also used for peer selection, so
+	 * not dependent upon profiling being enabled).
+	 */
+	peerblk->attempted = currticks();
 
 	/* If we have exceeded our maximum number of attempt cycles
 	 * (each cycle comprising a retrieval protocol download from
@@ -1327,14 +1641,19 @@ static void peerblk_expired ( struct retry_timer *timer, int over __unused ) {
 	if ( peerblk->peer == NULL )
 		peerblk->peer = head;
 
-	/* Attempt retrieval protocol download from next usable peer */
-	list_for_each_entry_continue ( peerblk->peer, &segment->peers, list ) {
+	/* Attempt retrieval protocol download from next usable peer,
+	 * in order of preference.
+	 */
+	prev = ( ( peerblk->peer == head ) ? NULL : peerblk->peer );
+	while ( ( peer = peerdisc_next ( segment, prev, peerblk->rank ) ) ) {
 
 		/* Attempt retrieval protocol download from this peer */
-		location = peerblk->peer->location;
+		peerblk->peer = peer;
+		peerblk->rank = peerdisc_rank ( peer );
 		if ( ( rc = peerblk_retrieval_open ( peerblk,
-						     location ) ) != 0 ) {
+						     peer->location ) ) != 0 ) {
 			/* Non-fatal: continue to try next peer */
+			prev = peer;
 			continue;
 		}
 
@@ -1343,6 +1662,7 @@ static void peerblk_expired ( struct retry_timer *timer, int over __unused ) {
 	}
 
 	/* Add to raw download queue */
+	peerblk->peer = head;
 	peerblk_enqueue ( peerblk, &peerblk_raw_queue );
 
 	return;
@@ -1481,6 +1801,17 @@ int peerblk_open ( struct interface *xfer, struct uri *uri,
 	}
 	DBGC2 ( peerblk, "\n" );
 
+	/* Record start time */
+	peerblk->started = peerblk_timestamp();
+
+	/* Use cached block, if available, without performing discovery */
+	peerblk->cached = peerblk_cache_find ( peerblk );
+	if ( peerblk->cached ) {
+		ref_get ( &peerblk->cached->refcnt );
+		start_timer_nodelay ( &peerblk->timer );
+		goto done;
+	}
+
 	/* Open discovery */
 	if ( ( rc = peerdisc_open ( &peerblk->discovery, peerblk->id,
 				    peerblk->digestsize ) ) != 0 )
@@ -1493,9 +1824,7 @@ int peerblk_open ( struct interface *xfer, struct uri *uri,
 		    ( peerdisc_timeout_secs * TICKS_PER_SEC ) : 0 );
 	start_timer_fixed ( &peerblk->timer, timeout );
 
-	/* Record start time */
-	peerblk->started = peerblk_timestamp();
-
+ done:
 	/* Attach to parent interface, mortalise self, and return */
 	intf_plug_plug ( xfer, &peerblk->xfer );
 	ref_put ( &peerblk->refcnt );
@@ -1506,3 +1835,35 @@ int peerblk_open ( struct interface *xfer, struct uri *uri,
  err_alloc:
 	return rc;
 }
+
+/** PeerDist concurrent origin downloads setting */
+const struct setting peerorigin_setting __setting ( SETTING_MISC, peerorigin ) = {
+	.name = "peerorigin",
+	.description = "PeerDist concurrent origin downloads",
+	.type = &setting_type_uint8,
+};
+
+/**
+ * Apply PeerDist block download settings
+ *
+ * @ret rc		Return status code
+ */
+static int apply_peerblk_settings ( void ) {
+	struct peerdist_block_queue *queue = &peerblk_raw_queue;
+
+	/* Fetch ceiling for concurrent raw block downloads */
+	peerblk_raw_limit = fetch_uintz_setting ( NULL, &peerorigin_setting );
+	if ( ! peerblk_raw_limit )
+		peerblk_raw_limit = PEERBLK_RAW_LIMIT;
+	if ( queue->max > peerblk_raw_limit )
+		queue->max = peerblk_raw_limit;
+	DBGC ( queue, "PEERBLK using up to %d concurrent origin downloads\n",
+	       peerblk_raw_limit );
+
+	return 0;
+}
+
+/** PeerDist block download settings applicator */
+struct settings_applicator peerblk_applicator __settings_applicator = {
+	.apply = apply_peerblk_settings,
+};
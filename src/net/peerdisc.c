@@ -95,7 +95,7 @@ static int peerdisc_discovered ( struct peerdisc_segment *segment,
  *
  * @v intf		Interface
  * @v peer		Selected peer (or NULL)
- * @v peers		List of available peers
+ * @v peers		List of available peers (or NULL if cached locally)
  */
 void peerdisc_stat ( struct interface *intf, struct peerdisc_peer *peer,
 		     struct list_head *peers ) {
@@ -113,6 +113,75 @@ void peerdisc_stat ( struct interface *intf, struct peerdisc_peer *peer,
 	intf_put ( dest );
 }
 
+/**
+ * Record peer block retrieval time
+ *
+ * @v segment		PeerDist discovery segment
+ * @v peer		Peer
+ * @v elapsed		Time taken to retrieve block (in ticks)
+ *
+ * The peer's position within the segment's list of peers is not
+ * changed, since other block downloads may be partway through
+ * iterating over the list.
+ */
+void peerdisc_rate ( struct peerdisc_segment *segment,
+		     struct peerdisc_peer *peer, unsigned long elapsed ) {
+
+	/* Update smoothed retrieval time */
+	if ( ! elapsed )
+		elapsed = 1;
+	if ( peer->latency ) {
+		peer->latency = ( ( ( 7 * peer->latency ) + elapsed ) / 8 );
+		if ( ! peer->latency )
+			peer->latency = 1;
+	} else {
+		peer->latency = elapsed;
+	}
+
+	DBGC2 ( segment, "PEERDISC %p peer %s latency %ld ticks\n",
+		segment, peer->location, peer->latency );
+}
+
+/**
+ * Find next PeerDist peer in order of preference
+ *
+ * @v segment		PeerDist discovery segment
+ * @v prev		Previous peer, or NULL to find the most preferred peer
+ * @v rank		Preference rank of previous peer when it was chosen
+ * @ret peer		Next peer, or NULL if no peers remain
+ *
+ * Peers are ordered by preference rank, and then by position within
+ * the list of peers.  The previous peer's rank must be recorded by
+ * the caller at the time the peer is chosen, since the peer's rating
+ * may change before the next peer is chosen.
+ */
+struct peerdisc_peer * peerdisc_next ( struct peerdisc_segment *segment,
+				       struct peerdisc_peer *prev,
+				       unsigned long rank ) {
+	struct peerdisc_peer *peer;
+	struct peerdisc_peer *best = NULL;
+	unsigned long peer_rank;
+	unsigned long best_rank = 0;
+
+	list_for_each_entry ( peer, &segment->peers, list ) {
+
+		/* Skip peers preceding the previous peer */
+		peer_rank = peerdisc_rank ( peer );
+		if ( prev && ( ( peer_rank < rank ) ||
+			       ( ( peer_rank == rank ) &&
+				 ( peer->index <= prev->index ) ) ) )
+			continue;
+
+		/* Record most preferred remaining peer */
+		if ( ( ! best ) || ( peer_rank < best_rank ) ) {
+			best = peer;
+			best_rank = peer_rank;
+		}
+	}
+
+	return best;
+}
+
 /******************************************************************************
  *
  * Discovery sockets
@@ -386,6 +455,7 @@ static int peerdisc_discovered ( struct peerdisc_segment *segment,
 	struct peerdisc_peer *peer;
 	struct peerdisc_client *peerdisc;
 	struct peerdisc_client *tmp;
+	unsigned int index = 0;
 	char *recent;
 
 	/* Ignore duplicate peers */
@@ -395,6 +465,7 @@ static int peerdisc_discovered ( struct peerdisc_segment *segment,
 				segment, location );
 			return 0;
 		}
+		index++;
 	}
 	DBGC2 ( segment, "PEERDISC %p discovered %s\n", segment, location );
 
@@ -403,6 +474,7 @@ static int peerdisc_discovered ( struct peerdisc_segment *segment,
 	if ( ! peer )
 		return -ENOMEM;
 	strcpy ( peer->location, location );
+	peer->index = index;
 
 	/* Add to end of list of peers */
 	list_add_tail ( &peer->list, &segment->peers );
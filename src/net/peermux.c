@@ -29,6 +29,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/uri.h>
 #include <ipxe/xferbuf.h>
 #include <ipxe/job.h>
+#include <ipxe/settings.h>
 #include <ipxe/peerblk.h>
 #include <ipxe/peermux.h>
 
@@ -38,6 +39,9 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  *
  */
 
+/** Number of concurrent block downloads */
+static unsigned int peermux_window = PEERMUX_WINDOW;
+
 /**
  * Free PeerDist download multiplexer
  *
@@ -59,8 +63,18 @@ static void peermux_free ( struct refcnt *refcnt ) {
  * @v rc		Reason for close
  */
 static void peermux_close ( struct peerdist_multiplexer *peermux, int rc ) {
+	struct peerdist_statistics *stats = &peermux->stats;
 	unsigned int i;
 
+	/* Report byte statistics */
+	if ( stats->total_len ) {
+		DBGC ( peermux, "PEERMUX %p sourced %zd bytes from peers, %zd "
+		       "from cache, and %zd from origin\n", peermux,
+		       stats->peer_len, stats->cached_len,
+		       ( stats->total_len - stats->peer_len -
+			 stats->cached_len ) );
+	}
+
 	/* Stop block download initiation process */
 	process_del ( &peermux->process );
 
@@ -86,11 +100,18 @@ static void peermux_close ( struct peerdist_multiplexer *peermux, int rc ) {
 static int peermux_progress ( struct peerdist_multiplexer *peermux,
 			      struct job_progress *progress ) {
 	struct peerdist_statistics *stats = &peermux->stats;
+	size_t local_len = ( stats->peer_len + stats->cached_len );
 	unsigned int percentage;
 
-	/* Construct PeerDist status message */
-	if ( stats->total ) {
-		percentage = ( ( 100 * stats->local ) / stats->total );
+	/* Construct PeerDist status message, based on the proportion
+	 * of bytes not sourced from the origin server.
+	 */
+	if ( stats->total_len ) {
+		percentage = ( ( stats->total_len >= 100 ) ?
+			       ( local_len / ( stats->total_len / 100 ) ) :
+			       ( ( 100 * local_len ) / stats->total_len ) );
+		if ( percentage > 100 )
+			percentage = 100;
 		snprintf ( progress->message, sizeof ( progress->message ),
 			   "%3d%% from %d peers", percentage, stats->peers );
 	}
@@ -144,6 +165,11 @@ static void peermux_info_close ( struct peerdist_multiplexer *peermux, int rc ){
 	/* Shut down content information interface */
 	intf_shutdown ( &peermux->info, rc );
 
+	/* Release any excess allocated space, since the content
+	 * information remains allocated for the whole download.
+	 */
+	xferbuf_shrink ( &peermux->buffer );
+
 	/* Parse content information */
 	if ( ( rc = peerdist_info ( info->raw.data, peermux->buffer.len,
 				    info ) ) != 0 ) {
@@ -248,6 +274,9 @@ static void peermux_step ( struct peerdist_multiplexer *peermux ) {
 		goto err;
 	}
 
+	/* Record block length for statistics */
+	peermblk->len = ( block->trim.end - block->trim.start );
+
 	/* Move to list of busy block downloads */
 	list_del ( &peermblk->list );
 	list_add_tail ( &peermblk->list, &peermux->busy );
@@ -303,7 +332,7 @@ peermux_block_buffer ( struct peerdist_multiplexed_block *peermblk ) {
  *
  * @v peermblk		PeerDist multiplexed block download
  * @v peer		Selected peer (or NULL)
- * @v peers		List of available peers
+ * @v peers		List of available peers (or NULL if cached locally)
  */
 static void peermux_block_stat ( struct peerdist_multiplexed_block *peermblk,
 				 struct peerdisc_peer *peer,
@@ -313,6 +342,15 @@ static void peermux_block_stat ( struct peerdist_multiplexed_block *peermblk,
 	struct peerdisc_peer *tmp;
 	unsigned int count = 0;
 
+	/* Update byte counts */
+	stats->total_len += peermblk->len;
+	if ( ! peers ) {
+		stats->cached_len += peermblk->len;
+		return;
+	}
+	if ( peer )
+		stats->peer_len += peermblk->len;
+
 	/* Record maximum number of available peers */
 	list_for_each_entry ( tmp, peers, list )
 		count++;
@@ -431,9 +469,11 @@ int peermux_filter ( struct interface *xfer, struct interface *info,
 	for ( i = 0 ; i < PEERMUX_MAX_BLOCKS ; i++ ) {
 		peermblk = &peermux->block[i];
 		peermblk->peermux = peermux;
-		list_add_tail ( &peermblk->list, &peermux->idle );
+		INIT_LIST_HEAD ( &peermblk->list );
 		intf_init ( &peermblk->xfer, &peermux_block_desc,
 			    &peermux->refcnt );
+		if ( i < peermux_window )
+			list_add_tail ( &peermblk->list, &peermux->idle );
 	}
 
 	/* Attach to parent interfaces, mortalise self, and return */
@@ -442,3 +482,36 @@ int peermux_filter ( struct interface *xfer, struct interface *info,
 	ref_put ( &peermux->refcnt );
 	return 0;
 }
+
+/** PeerDist concurrent block downloads setting */
+const struct setting peerwindow_setting __setting ( SETTING_MISC, peerwindow ) = {
+	.name = "peerwindow",
+	.description = "PeerDist concurrent block downloads",
+	.type = &setting_type_uint8,
+};
+
+/**
+ * Apply PeerDist multiplexer settings
+ *
+ * @ret rc		Return status code
+ */
+static int apply_peermux_settings ( void ) {
+	unsigned long window;
+
+	/* Fetch number of concurrent block downloads */
+	window = fetch_uintz_setting ( NULL, &peerwindow_setting );
+	if ( ! window )
+		window = PEERMUX_WINDOW;
+	if ( window > PEERMUX_MAX_BLOCKS )
+		window = PEERMUX_MAX_BLOCKS;
+	peermux_window = window;
+	DBGC ( &peermux_window, "PEERMUX using %d concurrent block "
+	       "downloads\n", peermux_window );
+
+	return 0;
+}
+
+/** PeerDist multiplexer settings applicator */
+struct settings_applicator peermux_applicator __settings_applicator = {
+	.apply = apply_peermux_settings,
+};
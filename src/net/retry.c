@@ -48,8 +48,75 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  */
 #define MIN_TIMEOUT 7
 
-/** List of running timers */
-static LIST_HEAD ( timers );
+/** Number of timer wheel slots (must be a power of two)
+ *
+ * Each running timer is placed in the slot corresponding to its
+ * expiry tick, so starting and stopping a timer are O(1) and each
+ * poll need examine only the slots for ticks that have elapsed since
+ * the previous poll.  Timers expiring more than one revolution in the
+ * future simply remain in their slot until their expiry tick is
+ * reached.
+ */
+#define RETRY_WHEEL_SLOTS 256
+
+/** Timer wheel */
+static struct list_head retry_wheel[RETRY_WHEEL_SLOTS];
+
+/** Earliest tick whose timer wheel slot may contain expired timers */
+static unsigned long retry_tick;
+
+/**
+ * Initialise timer wheel, if not already initialised
+ *
+ */
+static void retry_wheel_init ( void ) {
+	unsigned int i;
+
+	/* Do nothing if already initialised */
+	if ( retry_wheel[0].next )
+		return;
+
+	/* Initialise slots */
+	for ( i = 0 ; i < RETRY_WHEEL_SLOTS ; i++ )
+		INIT_LIST_HEAD ( &retry_wheel[i] );
+	retry_tick = currticks();
+}
+
+/**
+ * Get timer wheel slot for a given tick
+ *
+ * @v tick		Tick
+ * @ret slot		Timer wheel slot
+ */
+static inline struct list_head * retry_slot ( unsigned long tick ) {
+	return &retry_wheel[ tick & ( RETRY_WHEEL_SLOTS - 1 ) ];
+}
+
+/**
+ * Calculate number of ticks elapsed since the previous poll
+ *
+ * @v now		Current time
+ * @ret elapsed		Elapsed ticks (capped at one revolution)
+ */
+static inline unsigned long retry_elapsed ( unsigned long now ) {
+	unsigned long elapsed = ( now - retry_tick );
+
+	if ( elapsed >= RETRY_WHEEL_SLOTS )
+		elapsed = ( RETRY_WHEEL_SLOTS - 1 );
+	return elapsed;
+}
+
+/**
+ * Check if timer has expired
+ *
+ * @v timer		Retry timer
+ * @v now		Current time
+ * @ret expired		Timer has expired
+ */
+static inline int retry_expired ( struct retry_timer *timer,
+				  unsigned long now ) {
+	return ( ( now - timer->start ) >= timer->timeout );
+}
 
 /**
  * Start timer with a specified timeout
@@ -63,9 +130,11 @@ static LIST_HEAD ( timers );
  */
 void start_timer_fixed ( struct retry_timer *timer, unsigned long timeout ) {
 
-	/* Add to list of running timers (if applicable) */
-	if ( ! timer->running ) {
-		list_add ( &timer->list, &timers );
+	/* Remove from current timer wheel slot, or mark as running */
+	retry_wheel_init();
+	if ( timer->running ) {
+		list_del ( &timer->list );
+	} else {
 		ref_get ( timer->refcnt );
 		timer->running = 1;
 	}
@@ -76,6 +145,10 @@ void start_timer_fixed ( struct retry_timer *timer, unsigned long timeout ) {
 	/* Record timeout */
 	timer->timeout = timeout;
 
+	/* Add to timer wheel slot for expiry tick */
+	list_add_tail ( &timer->list,
+			retry_slot ( timer->start + timer->timeout ) );
+
 	DBGC2 ( timer, "Timer %p started at time %ld (expires at %ld)\n",
 		timer, timer->start, ( timer->start + timer->timeout ) );
 }
@@ -191,28 +264,97 @@ static void timer_expired ( struct retry_timer *timer ) {
 }
 
 /**
- * Poll the retry timer list
+ * Poll the retry timers
  *
  */
 void retry_poll ( void ) {
+	LIST_HEAD ( expired );
+	struct retry_timer *timer;
+	struct retry_timer *tmp;
+	struct list_head *slot;
+	unsigned long now = currticks();
+	unsigned long elapsed;
+	unsigned int i;
+
+	/* Initialise timer wheel, if applicable */
+	retry_wheel_init();
+
+	/* Collect all expired timers from the slots for each tick
+	 * that has elapsed since the previous poll (or from all slots,
+	 * if a full revolution has elapsed).
+	 */
+	elapsed = retry_elapsed ( now );
+	for ( i = 0 ; i <= elapsed ; i++ ) {
+		slot = retry_slot ( now - i );
+		list_for_each_entry_safe ( timer, tmp, slot, list ) {
+			if ( retry_expired ( timer, now ) ) {
+				list_del ( &timer->list );
+				list_add_tail ( &timer->list, &expired );
+			}
+		}
+	}
+
+	/* The slot for the current tick may still gain timers that
+	 * expire within this tick, so must be rescanned next time.
+	 */
+	retry_tick = now;
+
+	/* Process expired timers.  An expiry callback may stop or
+	 * restart any other timer (including one on the expired
+	 * list), so take each timer from the head of the list in
+	 * turn.  A timer restarted by its own callback is placed
+	 * back in the timer wheel and so cannot expire again within
+	 * this poll.
+	 */
+	while ( ( timer = list_first_entry ( &expired, struct retry_timer,
+					     list ) ) != NULL ) {
+		timer_expired ( timer );
+	}
+}
+
+/**
+ * Calculate time remaining until the next timer expiry
+ *
+ * @v max		Maximum time to report, in ticks
+ * @ret remaining	Time until next expiry, in ticks (capped at max)
+ */
+unsigned long retry_remaining ( unsigned long max ) {
 	struct retry_timer *timer;
+	struct list_head *slot;
 	unsigned long now = currticks();
+	unsigned long remaining = max;
+	unsigned long elapsed;
 	unsigned long used;
+	unsigned long left;
+	unsigned int i;
+
+	/* Initialise timer wheel, if applicable */
+	retry_wheel_init();
 
-	/* Process at most one timer expiry.  We cannot process
-	 * multiple expiries in one pass, because one timer expiring
-	 * may end up triggering another timer's deletion from the
-	 * list.
+	/* Scan slots in expiry order, starting from the earliest slot
+	 * that may contain an unprocessed expired timer.  A slot for
+	 * a future tick cannot contain any timer expiring sooner than
+	 * that tick, so the scan can stop as soon as it reaches the
+	 * current best remaining time.
 	 */
-	list_for_each_entry ( timer, &timers, list ) {
-		used = ( now - timer->start );
-		if ( used >= timer->timeout ) {
-			timer_expired ( timer );
+	elapsed = retry_elapsed ( now );
+	for ( i = 0 ; i < RETRY_WHEEL_SLOTS ; i++ ) {
+		if ( ( i >= elapsed ) && ( ( i - elapsed ) >= remaining ) )
 			break;
+		slot = retry_slot ( now - elapsed + i );
+		list_for_each_entry ( timer, slot, list ) {
+			used = ( now - timer->start );
+			left = ( ( used >= timer->timeout ) ?
+				 0 : ( timer->timeout - used ) );
+			if ( left < remaining )
+				remaining = left;
 		}
 	}
+
+	return remaining;
 }
 
+
 /**
  * Single-step the retry timer list
  *
@@ -224,3 +366,17 @@ static void retry_step ( struct process *process __unused ) {
 
 /** Retry timer process */
 PERMANENT_PROCESS ( retry_process, retry_step );
+
+/**
+ * Check for expired timers
+ *
+ * @ret busy		Expired timers are pending
+ */
+static int retry_busy ( void ) {
+	return ( retry_remaining ( 1 ) == 0 );
+}
+
+/** Retry timer activity source */
+struct process_busy retry_process_busy __process_busy = {
+	.busy = retry_busy,
+};
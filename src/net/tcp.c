@@ -1435,13 +1435,15 @@ static int tcp_rx ( struct io_buffer *iobuf,
 		rc = -EINVAL;
 		goto discard;
 	}
-	csum = tcpip_continue_chksum ( pshdr_csum, iobuf->data,
-				       iob_len ( iobuf ) );
-	if ( csum != 0 ) {
-		DBG ( "TCP checksum incorrect (is %04x including checksum "
-		      "field, should be 0000)\n", csum );
-		rc = -EINVAL;
-		goto discard;
+	if ( ! ( iobuf->flags & IOB_FL_CSUM_OK ) ) {
+		csum = tcpip_continue_chksum ( pshdr_csum, iobuf->data,
+					       iob_len ( iobuf ) );
+		if ( csum != 0 ) {
+			DBG ( "TCP checksum incorrect (is %04x including "
+			      "checksum field, should be 0000)\n", csum );
+			rc = -EINVAL;
+			goto discard;
+		}
 	}
 	
 	/* Parse parameters from header and strip header */
@@ -1544,10 +1546,80 @@ static int tcp_rx ( struct io_buffer *iobuf,
 	return rc;
 }
 
+/**
+ * Check whether or not received TCP packets may be coalesced
+ *
+ * @v iobuf		I/O buffer
+ * @v next		Next received I/O buffer
+ * @v pshdr_csum	Pseudo-header checksum for I/O buffer
+ * @v next_pshdr_csum	Pseudo-header checksum for next I/O buffer
+ * @ret hlen		Length of header to strip from next I/O buffer, or
+ *			negative error
+ *
+ * Consecutive in-order data segments of the same connection may be
+ * coalesced if their headers are identical other than the sequence
+ * number and checksum.  Since we never act upon PSH, it is ignored.
+ */
+static int tcp_coalesce ( struct io_buffer *iobuf, struct io_buffer *next,
+			  uint16_t pshdr_csum, uint16_t next_pshdr_csum ) {
+	const struct tcp_header *tcphdr = iobuf->data;
+	const struct tcp_header *next_tcphdr = next->data;
+	size_t len = iob_len ( iobuf );
+	size_t next_len = iob_len ( next );
+	size_t hlen;
+	uint32_t seq;
+
+	/* Check that headers are present and identical in length */
+	if ( ( len < sizeof ( *tcphdr ) ) ||
+	     ( next_len < sizeof ( *next_tcphdr ) ) ||
+	     ( tcphdr->hlen != next_tcphdr->hlen ) )
+		return -EINVAL;
+	hlen = ( ( tcphdr->hlen & TCP_MASK_HLEN ) / 16 ) * 4;
+	if ( ( hlen < sizeof ( *tcphdr ) ) || ( hlen >= len ) ||
+	     ( hlen >= next_len ) )
+		return -EINVAL;
+
+	/* Check that both segments are plain data segments */
+	if ( ( ( tcphdr->flags & ~TCP_PSH ) != TCP_ACK ) ||
+	     ( ( next_tcphdr->flags & ~TCP_PSH ) != TCP_ACK ) )
+		return -EINVAL;
+
+	/* Check that segments belong to the same connection and
+	 * convey identical state.
+	 */
+	if ( ( tcphdr->src != next_tcphdr->src ) ||
+	     ( tcphdr->dest != next_tcphdr->dest ) ||
+	     ( tcphdr->ack != next_tcphdr->ack ) ||
+	     ( tcphdr->win != next_tcphdr->win ) ||
+	     ( tcphdr->urg != next_tcphdr->urg ) ||
+	     ( memcmp ( ( tcphdr + 1 ), ( next_tcphdr + 1 ),
+			( hlen - sizeof ( *tcphdr ) ) ) != 0 ) )
+		return -EINVAL;
+
+	/* Check that next segment immediately follows this segment */
+	seq = ( ntohl ( tcphdr->seq ) + ( len - hlen ) );
+	if ( ntohl ( next_tcphdr->seq ) != seq )
+		return -EINVAL;
+
+	/* Verify checksums, since the coalesced packet will bypass
+	 * checksum verification.
+	 */
+	if ( ( ! ( iobuf->flags & IOB_FL_CSUM_OK ) ) &&
+	     ( tcpip_continue_chksum ( pshdr_csum, iobuf->data, len ) != 0 ) )
+		return -EINVAL;
+	if ( ( ! ( next->flags & IOB_FL_CSUM_OK ) ) &&
+	     ( tcpip_continue_chksum ( next_pshdr_csum, next->data,
+				       next_len ) != 0 ) )
+		return -EINVAL;
+
+	return hlen;
+}
+
 /** TCP protocol */
 struct tcpip_protocol tcp_protocol __tcpip_protocol = {
 	.name = "TCP",
 	.rx = tcp_rx,
+	.coalesce = tcp_coalesce,
 	.tcpip_proto = IP_TCP,
 };
 
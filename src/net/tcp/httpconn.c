@@ -41,6 +41,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/xfer.h>
 #include <ipxe/open.h>
 #include <ipxe/pool.h>
+#include <ipxe/settings.h>
 #include <ipxe/http.h>
 
 /** HTTP pooled connection expiry time */
@@ -49,6 +50,18 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 /** HTTP connection pool */
 static LIST_HEAD ( http_connection_pool );
 
+/** List of open HTTP connections */
+static LIST_HEAD ( http_connections );
+
+/** Maximum number of pipelined transactions per connection
+ *
+ * Pipelining is disabled if this is zero.
+ */
+static unsigned int http_pipeline_depth;
+
+static void http_conn_unpipeline ( struct http_connection *conn );
+static void http_conn_pipeline_step ( struct http_connection *conn );
+
 /**
  * Identify HTTP scheme
  *
@@ -81,6 +94,7 @@ static void http_conn_free ( struct refcnt *refcnt ) {
 		container_of ( refcnt, struct http_connection, refcnt );
 
 	/* Free connection */
+	free_iob ( conn->pushback );
 	uri_put ( conn->uri );
 	free ( conn );
 }
@@ -96,6 +110,17 @@ static void http_conn_close ( struct http_connection *conn, int rc ) {
 	/* Remove from connection pool, if applicable */
 	pool_del ( &conn->pool );
 
+	/* Remove from list of open connections */
+	list_del ( &conn->list );
+	INIT_LIST_HEAD ( &conn->list );
+
+	/* Discard any unconsumed data */
+	free_iob ( conn->pushback );
+	conn->pushback = NULL;
+
+	/* Ask any pipelined transactions to reconnect */
+	http_conn_unpipeline ( conn );
+
 	/* Shut down interfaces */
 	intf_shutdown ( &conn->socket, rc );
 	intf_shutdown ( &conn->xfer, rc );
@@ -161,6 +186,88 @@ static void http_conn_socket_close ( struct http_connection *conn, int rc ) {
 	http_conn_close ( conn, rc );
 }
 
+/**
+ * Send request from data transfer interface
+ *
+ * @v conn		HTTP connection
+ * @v iobuf		I/O buffer
+ * @v meta		Transfer metadata
+ * @ret rc		Return status code
+ */
+static int http_conn_xfer_deliver ( struct http_connection *conn,
+				    struct io_buffer *iobuf,
+				    struct xfer_metadata *meta ) {
+
+	int rc;
+
+	/* Pass on to transport layer interface */
+	rc = xfer_deliver ( &conn->socket, iobuf, meta );
+
+	/* Record request as sent, allowing pipelined requests to follow */
+	if ( ! ( conn->flags & HTTP_CONN_SENT ) ) {
+		conn->flags |= HTTP_CONN_SENT;
+		http_conn_pipeline_step ( conn );
+	}
+
+	return rc;
+}
+
+/**
+ * Accept data not consumed by the current transaction
+ *
+ * @v conn		HTTP connection
+ * @v iobuf		I/O buffer
+ */
+static void http_conn_xfer_pushback ( struct http_connection *conn,
+				      struct io_buffer *iobuf ) {
+
+	/* Retain data for the next transaction */
+	DBGC2 ( conn, "HTTPCONN %p retaining %zd unconsumed bytes\n",
+		conn, iob_len ( iobuf ) );
+	free_iob ( conn->pushback );
+	conn->pushback = iobuf;
+}
+
+/**
+ * Hand over connection to next pipelined transaction
+ *
+ * @v conn		HTTP connection
+ */
+static void http_conn_handoff ( struct http_connection *conn ) {
+	struct http_pipelined *pipelined;
+	struct io_buffer *iobuf;
+
+	/* Detach first pipelined transaction from the pipeline */
+	pipelined = list_first_entry ( &conn->pipeline, struct http_pipelined,
+				       list );
+	assert ( pipelined != NULL );
+	list_del ( &pipelined->list );
+	INIT_LIST_HEAD ( &pipelined->list );
+
+	/* Attach transaction to data transfer interface */
+	intf_plug_plug ( &conn->xfer, pipelined->xfer.dest );
+	intf_unplug ( &pipelined->xfer );
+	conn->flags = ( HTTP_CONN_PIPELINE |
+			( pipelined->sent ? HTTP_CONN_SENT : 0 ) );
+	DBGC2 ( conn, "HTTPCONN %p handed over to pipelined transaction\n",
+		conn );
+	ref_put ( &pipelined->refcnt );
+
+	/* Treat as a freshly recycled connection, so that the
+	 * transaction will be asked to reopen if the server closes
+	 * the connection before responding.
+	 */
+	conn->pool.flags = POOL_RECYCLED;
+
+	/* Deliver any data not consumed by the previous transaction */
+	iobuf = conn->pushback;
+	conn->pushback = NULL;
+	if ( iobuf ) {
+		pool_alive ( &conn->pool );
+		xfer_deliver_iob ( &conn->xfer, iobuf );
+	}
+}
+
 /**
  * Recycle this connection after closing
  *
@@ -180,12 +287,22 @@ static void http_conn_xfer_recycle ( struct http_connection *conn ) {
  * @v rc		Reason for close
  */
 static void http_conn_xfer_close ( struct http_connection *conn, int rc ) {
+	int recyclable = ( ( rc == 0 ) && pool_is_recyclable ( &conn->pool ) &&
+			   ( ! ( conn->flags & HTTP_CONN_DESYNC ) ) );
+
+	/* Hand over to the next pipelined transaction, if any */
+	if ( recyclable && ( ! list_empty ( &conn->pipeline ) ) ) {
+		intf_restart ( &conn->xfer, rc );
+		http_conn_handoff ( conn );
+		return;
+	}
 
-	/* Add to the connection pool if keepalive is enabled and no
-	 * error occurred.
+	/* Add to the connection pool if keepalive is enabled, no
+	 * error occurred, and there is no unexpected received data.
 	 */
-	if ( ( rc == 0 ) && pool_is_recyclable ( &conn->pool ) ) {
+	if ( recyclable && ( ! conn->pushback ) ) {
 		intf_restart ( &conn->xfer, rc );
+		conn->flags = 0;
 		pool_add ( &conn->pool, &http_connection_pool,
 			   HTTP_CONN_EXPIRY );
 		DBGC2 ( conn, "HTTPCONN %p pooled %s://%s\n",
@@ -197,10 +314,26 @@ static void http_conn_xfer_close ( struct http_connection *conn, int rc ) {
 	http_conn_close ( conn, rc );
 }
 
+/**
+ * Handle transport layer window change
+ *
+ * @v conn		HTTP connection
+ */
+static void http_conn_socket_window_changed ( struct http_connection *conn ) {
+
+	/* Notify current transaction and any pipelined transactions */
+	ref_get ( &conn->refcnt );
+	xfer_window_changed ( &conn->xfer );
+	http_conn_pipeline_step ( conn );
+	ref_put ( &conn->refcnt );
+}
+
 /** HTTP connection socket interface operations */
 static struct interface_operation http_conn_socket_operations[] = {
 	INTF_OP ( xfer_deliver, struct http_connection *,
 		  http_conn_socket_deliver ),
+	INTF_OP ( xfer_window_changed, struct http_connection *,
+		  http_conn_socket_window_changed ),
 	INTF_OP ( intf_close, struct http_connection *,
 		  http_conn_socket_close ),
 };
@@ -212,6 +345,10 @@ static struct interface_descriptor http_conn_socket_desc =
 
 /** HTTP connection data transfer interface operations */
 static struct interface_operation http_conn_xfer_operations[] = {
+	INTF_OP ( xfer_deliver, struct http_connection *,
+		  http_conn_xfer_deliver ),
+	INTF_OP ( http_pushback, struct http_connection *,
+		  http_conn_xfer_pushback ),
 	INTF_OP ( pool_recycle, struct http_connection *,
 		  http_conn_xfer_recycle ),
 	INTF_OP ( intf_close, struct http_connection *,
@@ -223,17 +360,292 @@ static struct interface_descriptor http_conn_xfer_desc =
 	INTF_DESC_PASSTHRU ( struct http_connection, xfer,
 			     http_conn_xfer_operations, socket );
 
+/******************************************************************************
+ *
+ * Pipelining
+ *
+ ******************************************************************************
+ */
+
+/**
+ * Free pipelined transaction
+ *
+ * @v refcnt		Reference count
+ */
+static void http_pipelined_free ( struct refcnt *refcnt ) {
+	struct http_pipelined *pipelined =
+		container_of ( refcnt, struct http_pipelined, refcnt );
+
+	ref_put ( &pipelined->conn->refcnt );
+	free ( pipelined );
+}
+
+/**
+ * Remove transaction from pipeline
+ *
+ * @v pipelined		Pipelined transaction
+ */
+static void http_pipelined_del ( struct http_pipelined *pipelined ) {
+
+	list_del ( &pipelined->list );
+	INIT_LIST_HEAD ( &pipelined->list );
+	ref_put ( &pipelined->refcnt );
+}
+
+/**
+ * Close pipelined transaction
+ *
+ * @v pipelined		Pipelined transaction
+ * @v rc		Reason for close
+ */
+static void http_pipelined_close ( struct http_pipelined *pipelined, int rc ) {
+	struct http_connection *conn = pipelined->conn;
+
+	/* Remove from pipeline, if applicable.  If the request has
+	 * already been sent, then nothing will consume the response
+	 * and the connection can no longer be used for subsequent
+	 * pipelined transactions.
+	 */
+	if ( ! list_empty ( &pipelined->list ) ) {
+		if ( pipelined->sent )
+			conn->flags |= HTTP_CONN_DESYNC;
+		http_pipelined_del ( pipelined );
+	}
+
+	/* Shut down interface */
+	intf_shutdown ( &pipelined->xfer, rc );
+}
+
+/**
+ * Check pipelined transaction flow control window
+ *
+ * @v pipelined		Pipelined transaction
+ * @ret len		Length of window
+ */
+static size_t http_pipelined_window ( struct http_pipelined *pipelined ) {
+	struct http_connection *conn = pipelined->conn;
+	struct http_pipelined *prev;
+
+	/* Requests must be sent in order: wait until the current
+	 * transaction and all preceding pipelined transactions have
+	 * sent their requests.
+	 */
+	if ( ! ( conn->flags & HTTP_CONN_SENT ) )
+		return 0;
+	list_for_each_entry ( prev, &conn->pipeline, list ) {
+		if ( prev == pipelined )
+			break;
+		if ( ! prev->sent )
+			return 0;
+	}
+
+	return xfer_window ( &conn->socket );
+}
+
+/**
+ * Send pipelined request
+ *
+ * @v pipelined		Pipelined transaction
+ * @v iobuf		I/O buffer
+ * @v meta		Transfer metadata
+ * @ret rc		Return status code
+ */
+static int http_pipelined_deliver ( struct http_pipelined *pipelined,
+				    struct io_buffer *iobuf,
+				    struct xfer_metadata *meta ) {
+	struct http_connection *conn = pipelined->conn;
+
+	int rc;
+
+	DBGC2 ( conn, "HTTPCONN %p sending pipelined request\n", conn );
+	rc = xfer_deliver ( &conn->socket, iobuf, meta );
+	if ( ! pipelined->sent ) {
+		pipelined->sent = 1;
+		http_conn_pipeline_step ( conn );
+	}
+
+	return rc;
+}
+
+/** Pipelined transaction interface operations */
+static struct interface_operation http_pipelined_operations[] = {
+	INTF_OP ( xfer_deliver, struct http_pipelined *,
+		  http_pipelined_deliver ),
+	INTF_OP ( xfer_window, struct http_pipelined *,
+		  http_pipelined_window ),
+	INTF_OP ( intf_close, struct http_pipelined *, http_pipelined_close ),
+};
+
+/** Pipelined transaction interface descriptor */
+static struct interface_descriptor http_pipelined_desc =
+	INTF_DESC ( struct http_pipelined, xfer, http_pipelined_operations );
+
+/**
+ * Pipeline transaction on a busy connection
+ *
+ * @v conn		HTTP connection
+ * @v xfer		Data transfer interface
+ * @ret rc		Return status code
+ */
+static int http_pipeline ( struct http_connection *conn,
+			   struct interface *xfer ) {
+	struct http_pipelined *pipelined;
+
+	/* Allocate and initialise structure */
+	pipelined = zalloc ( sizeof ( *pipelined ) );
+	if ( ! pipelined )
+		return -ENOMEM;
+	ref_init ( &pipelined->refcnt, http_pipelined_free );
+	intf_init ( &pipelined->xfer, &http_pipelined_desc,
+		    &pipelined->refcnt );
+	ref_get ( &conn->refcnt );
+	pipelined->conn = conn;
+
+	/* Add to pipeline (which holds the initial reference) and
+	 * attach to parent interface.
+	 */
+	list_add_tail ( &pipelined->list, &conn->pipeline );
+	intf_plug_plug ( &pipelined->xfer, xfer );
+	DBGC2 ( conn, "HTTPCONN %p pipelined %s://%s\n",
+		conn, conn->scheme->name, conn->uri->host );
+
+	return 0;
+}
+
+/**
+ * Notify next pipelined transaction that it may send its request
+ *
+ * @v conn		HTTP connection
+ *
+ * Only the first pipelined transaction that has not yet sent its
+ * request is notified: each subsequent transaction will be notified
+ * in turn once its predecessor has sent its request.
+ */
+static void http_conn_pipeline_step ( struct http_connection *conn ) {
+	struct http_pipelined *pipelined;
+
+	list_for_each_entry ( pipelined, &conn->pipeline, list ) {
+		if ( pipelined->sent )
+			continue;
+		if ( http_pipelined_window ( pipelined ) ) {
+			ref_get ( &pipelined->refcnt );
+			xfer_window_changed ( &pipelined->xfer );
+			ref_put ( &pipelined->refcnt );
+		}
+		break;
+	}
+}
+
+/**
+ * Ask all pipelined transactions to reconnect
+ *
+ * @v conn		HTTP connection
+ */
+static void http_conn_unpipeline ( struct http_connection *conn ) {
+	struct http_pipelined *pipelined;
+	struct http_pipelined *tmp;
+
+	list_for_each_entry_safe ( pipelined, tmp, &conn->pipeline, list ) {
+		DBGC2 ( conn, "HTTPCONN %p reopening pipelined transaction\n",
+			conn );
+		ref_get ( &pipelined->refcnt );
+		http_pipelined_del ( pipelined );
+		pool_reopen ( &pipelined->xfer );
+		intf_shutdown ( &pipelined->xfer, -ECANCELED );
+		ref_put ( &pipelined->refcnt );
+	}
+}
+
+/**
+ * Find busy connection suitable for pipelining
+ *
+ * @v scheme		HTTP scheme
+ * @v uri		Connection URI
+ * @v port		Port
+ * @ret conn		HTTP connection, or NULL
+ */
+static struct http_connection * http_pipelinable ( struct http_scheme *scheme,
+						   struct uri *uri,
+						   unsigned int port ) {
+	struct http_connection *conn;
+	struct http_pipelined *pipelined;
+	unsigned int depth;
+
+	list_for_each_entry ( conn, &http_connections, list ) {
+
+		/* Skip connections which are idle, which are not yet
+		 * known to support persistence, or whose current
+		 * transaction does not permit pipelining.
+		 */
+		if ( ( ! list_empty ( &conn->pool.list ) ) ||
+		     ( ! ( conn->pool.flags & POOL_RECYCLED ) ) ||
+		     ( ! ( conn->flags & HTTP_CONN_PIPELINE ) ) ||
+		     ( conn->flags & HTTP_CONN_DESYNC ) )
+			continue;
+
+		/* Skip connections to other servers */
+		if ( ( scheme != conn->scheme ) ||
+		     ( strcmp ( uri->host, conn->uri->host ) != 0 ) ||
+		     ( port != uri_port ( conn->uri, scheme->port ) ) )
+			continue;
+
+		/* Skip connections with a full pipeline */
+		depth = 0;
+		list_for_each_entry ( pipelined, &conn->pipeline, list )
+			depth++;
+		if ( depth >= http_pipeline_depth )
+			continue;
+
+		return conn;
+	}
+
+	return NULL;
+}
+
+/**
+ * Return data not consumed by an HTTP transaction
+ *
+ * @v intf		Interface
+ * @v iobuf		I/O buffer
+ *
+ * This is used by a transaction which has received a complete
+ * response to return any remaining received data (which will
+ * typically be the start of a pipelined response) to the connection.
+ */
+void http_pushback ( struct interface *intf, struct io_buffer *iobuf ) {
+	struct interface *dest;
+	http_pushback_TYPE ( void * ) *op =
+		intf_get_dest_op ( intf, http_pushback, &dest );
+	void *object = intf_object ( dest );
+
+	if ( op ) {
+		op ( object, iobuf );
+	} else {
+		/* Default is to discard the data */
+		free_iob ( iobuf );
+	}
+
+	intf_put ( dest );
+}
+
 /**
  * Connect to an HTTP server
  *
  * @v xfer		Data transfer interface
  * @v uri		Connection URI
+ * @v pipeline		Request may be pipelined
  * @ret rc		Return status code
  *
  * HTTP connections are pooled.  The caller should be prepared to
  * receive a pool_reopen() message.
+ *
+ * If pipelining is enabled and permitted by the caller, then the
+ * request may be queued on a busy connection.  The caller's request
+ * will be sent once all preceding requests have been sent, and
+ * received data will be delivered once all preceding responses have
+ * been consumed.
  */
-int http_connect ( struct interface *xfer, struct uri *uri ) {
+int http_connect ( struct interface *xfer, struct uri *uri, int pipeline ) {
 	struct http_connection *conn;
 	struct http_scheme *scheme;
 	struct sockaddr_tcpip server;
@@ -273,6 +685,7 @@ int http_connect ( struct interface *xfer, struct uri *uri ) {
 			 * attach to parent interface, and return.
 			 */
 			pool_del ( &conn->pool );
+			conn->flags = ( pipeline ? HTTP_CONN_PIPELINE : 0 );
 			intf_plug_plug ( &conn->xfer, xfer );
 			DBGC2 ( conn, "HTTPCONN %p reused %s://%s:%d\n", conn,
 				conn->scheme->name, conn->uri->host, port );
@@ -280,6 +693,12 @@ int http_connect ( struct interface *xfer, struct uri *uri ) {
 		}
 	}
 
+	/* Pipeline on a busy connection, if possible */
+	if ( pipeline && http_pipeline_depth &&
+	     ( conn = http_pipelinable ( scheme, uri, port ) ) ) {
+		return http_pipeline ( conn, xfer );
+	}
+
 	/* Allocate and initialise structure */
 	conn = zalloc ( sizeof ( *conn ) );
 	if ( ! conn ) {
@@ -289,6 +708,9 @@ int http_connect ( struct interface *xfer, struct uri *uri ) {
 	ref_init ( &conn->refcnt, http_conn_free );
 	conn->uri = uri_get ( uri );
 	conn->scheme = scheme;
+	conn->flags = ( pipeline ? HTTP_CONN_PIPELINE : 0 );
+	INIT_LIST_HEAD ( &conn->pipeline );
+	list_add_tail ( &conn->list, &http_connections );
 	intf_init ( &conn->socket, &http_conn_socket_desc, &conn->refcnt );
 	intf_init ( &conn->xfer, &http_conn_xfer_desc, &conn->refcnt );
 	pool_init ( &conn->pool, http_conn_expired, &conn->refcnt );
@@ -322,3 +744,33 @@ int http_connect ( struct interface *xfer, struct uri *uri ) {
  err_alloc:
 	return rc;
 }
+
+/** HTTP pipelining depth setting */
+const struct setting http_pipeline_setting __setting ( SETTING_MISC,
+						      http-pipeline ) = {
+	.name = "http-pipeline",
+	.description = "HTTP pipelining depth",
+	.type = &setting_type_uint8,
+};
+
+/**
+ * Apply HTTP connection settings
+ *
+ * @ret rc		Return status code
+ */
+static int apply_http_conn_settings ( void ) {
+
+	/* Fetch pipelining depth */
+	http_pipeline_depth = fetch_uintz_setting ( NULL,
+						    &http_pipeline_setting );
+	DBGC ( &http_pipeline_depth, "HTTPCONN pipelining %s (depth %d)\n",
+	       ( http_pipeline_depth ? "enabled" : "disabled" ),
+	       http_pipeline_depth );
+
+	return 0;
+}
+
+/** HTTP connection settings applicator */
+struct settings_applicator http_conn_applicator __settings_applicator = {
+	.apply = apply_http_conn_settings,
+};
@@ -300,6 +300,23 @@ static void http_close_error ( struct http_transaction *http, int rc ) {
 	http_close ( http, ( rc ? rc : -EPIPE ) );
 }
 
+/**
+ * Check if HTTP request may be pipelined
+ *
+ * @v http		HTTP transaction
+ * @ret pipeline	Request may be pipelined
+ *
+ * Only idempotent requests without a request body are pipelined, so
+ * that any such request may be safely retried on a new connection if
+ * the server closes the connection before responding.
+ */
+static int http_may_pipeline ( struct http_transaction *http ) {
+
+	return ( ( ( http->request.method == &http_get ) ||
+		   ( http->request.method == &http_head ) ) &&
+		 ( http->request.content.len == 0 ) );
+}
+
 /**
  * Reopen stale HTTP connection
  *
@@ -312,7 +329,8 @@ static void http_reopen ( struct http_transaction *http ) {
 	intf_restart ( &http->conn, -ECANCELED );
 
 	/* Reopen connection */
-	if ( ( rc = http_connect ( &http->conn, http->uri ) ) != 0 ) {
+	if ( ( rc = http_connect ( &http->conn, http->uri,
+				   http_may_pipeline ( http ) ) ) != 0 ) {
 		DBGC ( http, "HTTP %p could not reconnect: %s\n",
 		       http, strerror ( rc ) );
 		goto err_connect;
@@ -394,6 +412,7 @@ static int http_conn_deliver ( struct http_transaction *http,
 
 	/* Handle received data */
 	profile_start ( &http_rx_profiler );
+	http->rx = &iobuf;
 	while ( iobuf && iob_len ( iobuf ) ) {
 
 		/* Sanity check */
@@ -407,6 +426,7 @@ static int http_conn_deliver ( struct http_transaction *http,
 		if ( ( rc = http->state->rx ( http, &iobuf ) ) != 0 )
 			goto err;
 	}
+	http->rx = NULL;
 
 	/* Free I/O buffer, if applicable */
 	free_iob ( iobuf );
@@ -415,6 +435,7 @@ static int http_conn_deliver ( struct http_transaction *http,
 	return 0;
 
  err:
+	http->rx = NULL;
 	free_iob ( iobuf );
 	http_close ( http, rc );
 	return rc;
@@ -668,7 +689,8 @@ int http_open ( struct interface *xfer, struct http_method *method,
 		http->request.host, http->request.uri );
 
 	/* Open connection */
-	if ( ( rc = http_connect ( &http->conn, uri ) ) != 0 ) {
+	if ( ( rc = http_connect ( &http->conn, uri,
+				   http_may_pipeline ( http ) ) ) != 0 ) {
 		DBGC ( http, "HTTP %p could not connect: %s\n",
 		       http, strerror ( rc ) );
 		goto err_connect;
@@ -746,6 +768,12 @@ static int http_transfer_complete ( struct http_transaction *http ) {
 	if ( http->response.flags & HTTP_RESPONSE_KEEPALIVE )
 		pool_recycle ( &http->conn );
 
+	/* Return any unconsumed received data (which will typically
+	 * be the start of a pipelined response) to the connection.
+	 */
+	if ( http->rx && *http->rx && iob_len ( *http->rx ) )
+		http_pushback ( &http->conn, iob_disown ( *http->rx ) );
+
 	/* Restart server connection interface */
 	intf_restart ( &http->conn, 0 );
 
@@ -1583,24 +1611,37 @@ static int http_init_transfer_identity ( struct http_transaction *http ) {
  */
 static int http_rx_transfer_identity ( struct http_transaction *http,
 				       struct io_buffer **iobuf ) {
+	struct io_buffer *excess = NULL;
 	size_t len = iob_len ( *iobuf );
+	size_t remaining;
 	int rc;
 
-	/* Update lengths */
-	http->len += len;
-
-	/* Fail if this transfer would overrun the expected content
-	 * length (if any).
+	/* Split off any data beyond the expected content length (if
+	 * any).  This will typically be the start of a pipelined
+	 * response, and will be returned to the connection once the
+	 * transfer is complete.
 	 */
-	if ( ( http->response.flags & HTTP_RESPONSE_CONTENT_LEN ) &&
-	     ( http->len > http->response.content.len ) ) {
-		DBGC ( http, "HTTP %p content length overrun\n", http );
-		return -EIO_CONTENT_LENGTH;
+	if ( http->response.flags & HTTP_RESPONSE_CONTENT_LEN ) {
+		remaining = ( http->response.content.len - http->len );
+		if ( len > remaining ) {
+			excess = alloc_iob ( len - remaining );
+			if ( ! excess )
+				return -ENOMEM;
+			memcpy ( iob_put ( excess, ( len - remaining ) ),
+				 ( (*iobuf)->data + remaining ),
+				 ( len - remaining ) );
+			iob_unput ( *iobuf, ( len - remaining ) );
+			len = remaining;
+		}
 	}
 
+	/* Update lengths */
+	http->len += len;
+
 	/* Hand off to content encoding */
-	if ( ( rc = xfer_deliver_iob ( &http->transfer,
-				       iob_disown ( *iobuf ) ) ) != 0 )
+	rc = xfer_deliver_iob ( &http->transfer, iob_disown ( *iobuf ) );
+	*iobuf = excess;
+	if ( rc != 0 )
 		return rc;
 
 	/* Complete transfer if we have received the expected content
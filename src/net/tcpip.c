@@ -59,6 +59,36 @@ int tcpip_rx ( struct io_buffer *iobuf, struct net_device *netdev,
 	return -EPROTONOSUPPORT;
 }
 
+/**
+ * Check whether or not received TCP/IP packets may be coalesced
+ *
+ * @v iobuf		I/O buffer
+ * @v next		Next received I/O buffer
+ * @v tcpip_proto	Transport-layer protocol number
+ * @v pshdr_csum	Pseudo-header checksum for I/O buffer
+ * @v next_pshdr_csum	Pseudo-header checksum for next I/O buffer
+ * @ret hlen		Length of header to strip from next I/O buffer, or
+ *			negative error
+ *
+ * Both I/O buffers must start with the transport-layer header.
+ */
+int tcpip_coalesce ( struct io_buffer *iobuf, struct io_buffer *next,
+		     uint8_t tcpip_proto, uint16_t pshdr_csum,
+		     uint16_t next_pshdr_csum ) {
+	struct tcpip_protocol *tcpip;
+
+	/* Hand off to the appropriate transport-layer protocol */
+	for_each_table_entry ( tcpip, TCPIP_PROTOCOLS ) {
+		if ( ( tcpip->tcpip_proto == tcpip_proto ) &&
+		     tcpip->coalesce ) {
+			return tcpip->coalesce ( iobuf, next, pshdr_csum,
+						 next_pshdr_csum );
+		}
+	}
+
+	return -ENOTSUP;
+}
+
 /**
  * Find TCP/IP network-layer protocol
  *
@@ -166,27 +196,77 @@ size_t tcpip_mtu ( struct sockaddr_tcpip *st_dest ) {
  * byte-swap either the input partial checksum, the output checksum,
  * or both.  Deciding which to swap is left as an exercise for the
  * interested reader.
+ *
+ * The data is summed as native-endian 32-bit words into a 64-bit
+ * accumulator, which cannot overflow for any realistic length and so
+ * requires no carry propagation within the main loop.  Data starting
+ * at an odd address is handled by summing with all bytes in swapped
+ * positions and then byte-swapping the result, which is equivalent
+ * in one's complement arithmetic.
  */
 uint16_t generic_tcpip_continue_chksum ( uint16_t partial,
 					 const void *data, size_t len ) {
-	unsigned int cksum = ( ( ~partial ) & 0xffff );
-	unsigned int value;
-	unsigned int i;
-	
-	for ( i = 0 ; i < len ; i++ ) {
-		value = * ( ( uint8_t * ) data + i );
-		if ( i & 1 ) {
-			/* Odd bytes: swap on little-endian systems */
-			value = be16_to_cpu ( value );
-		} else {
-			/* Even bytes: swap on big-endian systems */
-			value = le16_to_cpu ( value );
-		}
-		cksum += value;
-		if ( cksum > 0xffff )
-			cksum -= 0xffff;
+	const uint8_t *bytes = data;
+	const uint32_t *dwords;
+	uint64_t sum;
+	unsigned int cksum;
+	int odd;
+
+	/* Start from existing partial sum, byte-swapping it if the
+	 * data starts at an odd address.
+	 */
+	cksum = ( ( ~partial ) & 0xffff );
+	odd = ( ( ( intptr_t ) bytes ) & 1 );
+	if ( odd && len ) {
+		cksum = bswap_16 ( cksum );
+		sum = ( cksum + be16_to_cpu ( *(bytes++) ) );
+		len--;
+	} else {
+		odd = 0;
+		sum = cksum;
+	}
+
+	/* Sum initial halfword to reach 32-bit alignment, if needed */
+	if ( ( ( ( intptr_t ) bytes ) & 2 ) && ( len >= 2 ) ) {
+		sum += *( ( const uint16_t * ) bytes );
+		bytes += 2;
+		len -= 2;
 	}
-	
+
+	/* Sum 32-bit words, unrolled x4 */
+	dwords = ( ( const uint32_t * ) bytes );
+	for ( ; len >= ( 4 * sizeof ( *dwords ) ) ;
+	      len -= ( 4 * sizeof ( *dwords ) ) ) {
+		sum += dwords[0];
+		sum += dwords[1];
+		sum += dwords[2];
+		sum += dwords[3];
+		dwords += 4;
+	}
+	for ( ; len >= sizeof ( *dwords ) ; len -= sizeof ( *dwords ) )
+		sum += *(dwords++);
+	bytes = ( ( const uint8_t * ) dwords );
+
+	/* Sum remaining halfword and byte, if applicable */
+	if ( len >= 2 ) {
+		sum += *( ( const uint16_t * ) bytes );
+		bytes += 2;
+		len -= 2;
+	}
+	if ( len )
+		sum += le16_to_cpu ( *bytes );
+
+	/* Fold down to a uint16_t */
+	sum = ( ( sum & 0xffffffffUL ) + ( sum >> 32 ) );
+	sum = ( ( sum & 0xffffffffUL ) + ( sum >> 32 ) );
+	sum = ( ( sum & 0xffff ) + ( sum >> 16 ) );
+	sum = ( ( sum & 0xffff ) + ( sum >> 16 ) );
+	cksum = sum;
+
+	/* Byte-swap result back, if applicable */
+	if ( odd )
+		cksum = bswap_16 ( cksum );
+
 	return ( ~cksum );
 }
 
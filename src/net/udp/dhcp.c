@@ -48,6 +48,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/dhcppkt.h>
 #include <ipxe/dhcparch.h>
 #include <ipxe/features.h>
+#include <ipxe/profile.h>
 #include <config/dhcp.h>
 
 /** @file
@@ -58,6 +59,11 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 
 struct dhcp_session;
 static int dhcp_tx ( struct dhcp_session *dhcp );
+static void dhcp_request_rx ( struct dhcp_session *dhcp,
+			      struct dhcp_packet *dhcppkt,
+			      struct sockaddr_in *peer, uint8_t msgtype,
+			      struct in_addr server_id,
+			      struct in_addr pseudo_id );
 
 /**
  * DHCP operation types
@@ -77,6 +83,44 @@ static const uint8_t dhcp_op[] = {
 	[DHCPINFORM]	= BOOTP_REQUEST,
 };
 
+/** DHCP discovery phase profiler */
+static struct profiler dhcp_discover_profiler __profiler =
+	{ .name = "dhcp.discover" };
+
+/** DHCP request phase profiler */
+static struct profiler dhcp_request_profiler __profiler =
+	{ .name = "dhcp.request" };
+
+/** ProxyDHCP request phase profiler */
+static struct profiler dhcp_proxy_profiler __profiler =
+	{ .name = "dhcp.proxy" };
+
+/** PXE Boot Server request phase profiler */
+static struct profiler dhcp_pxebs_profiler __profiler =
+	{ .name = "dhcp.pxebs" };
+
+/** A DHCP server for which no ProxyDHCP server is expected
+ *
+ * This is learned from a previous discovery on the same network
+ * device that waited for ProxyDHCPOFFERs in vain, and allows
+ * subsequent discoveries to skip the wait.
+ */
+struct dhcp_proxyless {
+	/** Network device scope ID, or zero if unused */
+	unsigned int scope_id;
+	/** DHCP server */
+	struct in_addr server;
+};
+
+/** Number of remembered DHCP servers without a ProxyDHCP server */
+#define DHCP_PROXYLESS_MAX 4
+
+/** DHCP servers for which no ProxyDHCP server is expected */
+static struct dhcp_proxyless dhcp_proxyless[DHCP_PROXYLESS_MAX];
+
+/** Next entry to be replaced in list of DHCP servers */
+static unsigned int dhcp_proxyless_next;
+
 /** Raw option data for options common to all DHCP requests */
 static uint8_t dhcp_request_options_data[] = {
 	DHCP_MESSAGE_TYPE, DHCP_BYTE ( 0 ),
@@ -189,6 +233,8 @@ struct dhcp_session_state {
 	/** Timeout parameters */
 	uint8_t min_timeout_sec;
 	uint8_t max_timeout_sec;
+	/** Phase duration profiler (in milliseconds) */
+	struct profiler *profiler;
 };
 
 static struct dhcp_session_state dhcp_state_discover;
@@ -229,6 +275,8 @@ struct dhcp_session {
 	struct dhcp_packet *proxy_offer;
 	/** ProxyDHCP offer priority */
 	int proxy_priority;
+	/** Rapid Commit DHCPACK for the selected DHCP offer, if any */
+	struct dhcp_packet *rapid_ack;
 
 	/** PXE Boot Server type */
 	uint16_t pxe_type;
@@ -256,9 +304,22 @@ static void dhcp_free ( struct refcnt *refcnt ) {
 
 	netdev_put ( dhcp->netdev );
 	dhcppkt_put ( dhcp->proxy_offer );
+	dhcppkt_put ( dhcp->rapid_ack );
 	free ( dhcp );
 }
 
+/**
+ * Record duration of current DHCP session state
+ *
+ * @v dhcp		DHCP session
+ */
+static void dhcp_profile_state ( struct dhcp_session *dhcp ) {
+	unsigned long elapsed = ( currticks() - dhcp->start );
+
+	profile_custom ( dhcp->state->profiler,
+			 ( ( elapsed * 1000 ) / TICKS_PER_SEC ) );
+}
+
 /**
  * Mark DHCP session as complete
  *
@@ -267,6 +328,10 @@ static void dhcp_free ( struct refcnt *refcnt ) {
  */
 static void dhcp_finished ( struct dhcp_session *dhcp, int rc ) {
 
+	/* Record duration of final state, if any */
+	if ( dhcp->state )
+		dhcp_profile_state ( dhcp );
+
 	/* Stop retry timer */
 	stop_timer ( &dhcp->timer );
 
@@ -285,6 +350,8 @@ static void dhcp_set_state ( struct dhcp_session *dhcp,
 			     struct dhcp_session_state *state ) {
 
 	DBGC ( dhcp, "DHCP %p entering %s state\n", dhcp, state->name );
+	if ( dhcp->state )
+		dhcp_profile_state ( dhcp );
 	dhcp->state = state;
 	dhcp->start = currticks();
 	stop_timer ( &dhcp->timer );
@@ -331,11 +398,28 @@ static int dhcp_has_pxeopts ( struct dhcp_packet *dhcppkt ) {
  * @v peer		Destination address
  */
 static int dhcp_discovery_tx ( struct dhcp_session *dhcp,
-			       struct dhcp_packet *dhcppkt __unused,
+			       struct dhcp_packet *dhcppkt,
 			       struct sockaddr_in *peer ) {
+	struct dhcp_options *options = &dhcppkt->options;
+	uint8_t *end;
 
 	DBGC ( dhcp, "DHCP %p DHCPDISCOVER\n", dhcp );
 
+	/* Request Rapid Commit, if enabled.  This is a zero-length
+	 * option, which dhcppkt_store() would treat as a deletion, so
+	 * insert it directly in front of the end-of-options marker.
+	 */
+	if ( DHCP_DISC_RAPID_COMMIT ) {
+		if ( ( options->used_len + 2 ) > options->alloc_len )
+			return -ENOSPC;
+		end = ( options->data + options->used_len - 1 );
+		assert ( *end == DHCP_END );
+		*(end++) = DHCP_RAPID_COMMIT;
+		*(end++) = 0;
+		*(end++) = DHCP_END;
+		options->used_len += 2;
+	}
+
 	/* Set server address */
 	peer->sin_addr.s_addr = INADDR_BROADCAST;
 	peer->sin_port = htons ( BOOTPS_PORT );
@@ -343,6 +427,139 @@ static int dhcp_discovery_tx ( struct dhcp_session *dhcp,
 	return 0;
 }
 
+/**
+ * Find DHCP server known to have no ProxyDHCP server
+ *
+ * @v dhcp		DHCP session
+ * @ret proxyless	Remembered DHCP server, or NULL if not found
+ */
+static struct dhcp_proxyless *
+dhcp_proxyless_find ( struct dhcp_session *dhcp ) {
+	struct dhcp_proxyless *proxyless;
+	unsigned int i;
+
+	for ( i = 0 ; i < DHCP_PROXYLESS_MAX ; i++ ) {
+		proxyless = &dhcp_proxyless[i];
+		if ( ( proxyless->scope_id == dhcp->netdev->scope_id ) &&
+		     ( proxyless->server.s_addr == dhcp->server.s_addr ) )
+			return proxyless;
+	}
+	return NULL;
+}
+
+/**
+ * Remember DHCP server as having no ProxyDHCP server
+ *
+ * @v dhcp		DHCP session
+ */
+static void dhcp_proxyless_add ( struct dhcp_session *dhcp ) {
+	struct dhcp_proxyless *proxyless;
+
+	/* Do nothing if already remembered */
+	if ( dhcp_proxyless_find ( dhcp ) )
+		return;
+
+	/* Replace oldest entry */
+	DBGC ( dhcp, "DHCP %p remembering %s as having no ProxyDHCP\n",
+	       dhcp, inet_ntoa ( dhcp->server ) );
+	proxyless = &dhcp_proxyless[dhcp_proxyless_next];
+	dhcp_proxyless_next = ( ( dhcp_proxyless_next + 1 ) %
+				DHCP_PROXYLESS_MAX );
+	proxyless->scope_id = dhcp->netdev->scope_id;
+	proxyless->server = dhcp->server;
+}
+
+/**
+ * Forget DHCP servers remembered as having no ProxyDHCP server
+ *
+ * @v dhcp		DHCP session
+ *
+ * All DHCP servers remembered for this session's network device are
+ * forgotten, since a ProxyDHCP server has now been seen on it.
+ */
+static void dhcp_proxyless_forget ( struct dhcp_session *dhcp ) {
+	struct dhcp_proxyless *proxyless;
+	unsigned int i;
+
+	for ( i = 0 ; i < DHCP_PROXYLESS_MAX ; i++ ) {
+		proxyless = &dhcp_proxyless[i];
+		if ( proxyless->scope_id == dhcp->netdev->scope_id )
+			memset ( proxyless, 0, sizeof ( *proxyless ) );
+	}
+}
+
+/**
+ * Check whether or not the ProxyDHCPOFFER wait has timed out
+ *
+ * @v dhcp		DHCP session
+ * @ret timed_out	Wait has timed out
+ */
+static int dhcp_proxy_timed_out ( struct dhcp_session *dhcp ) {
+	unsigned long elapsed = ( currticks() - dhcp->start );
+
+	return ( elapsed > ( DHCP_DISC_PROXY_TIMEOUT_SEC * TICKS_PER_SEC ) );
+}
+
+/**
+ * Check whether or not to stop waiting for ProxyDHCPOFFERs
+ *
+ * @v dhcp		DHCP session
+ * @ret done		Waiting is complete
+ */
+static int dhcp_proxy_waited ( struct dhcp_session *dhcp ) {
+
+	/* Do not wait if no ProxyDHCP server is expected */
+	if ( ! DHCP_DISC_PROXY_EXPECTED )
+		return 1;
+
+	/* Do not wait if this DHCP server is known to be alone */
+	if ( dhcp_proxyless_find ( dhcp ) ) {
+		DBGC ( dhcp, "DHCP %p expects no ProxyDHCP alongside %s\n",
+		       dhcp, inet_ntoa ( dhcp->server ) );
+		return 1;
+	}
+
+	/* Keep waiting until the timeout is reached */
+	return dhcp_proxy_timed_out ( dhcp );
+}
+
+/**
+ * Complete DHCP discovery
+ *
+ * @v dhcp		DHCP session
+ */
+static void dhcp_discovery_complete ( struct dhcp_session *dhcp ) {
+	struct sockaddr_in peer;
+	struct dhcp_packet *rapid_ack;
+
+	/* Remember if we waited in vain for ProxyDHCPOFFERs */
+	if ( DHCP_DISC_PROXY_EXPECTED &&
+	     ! ( dhcp->no_pxedhcp || dhcp->proxy_offer ) &&
+	     dhcp_proxy_timed_out ( dhcp ) ) {
+		dhcp_proxyless_add ( dhcp );
+	}
+
+	/* Transition to DHCPREQUEST */
+	dhcp_set_state ( dhcp, &dhcp_state_request );
+
+	/* If the selected server has already committed the lease via
+	 * Rapid Commit, then handle its DHCPACK immediately.  The
+	 * DHCPREQUEST will never be sent, since the retry timer is
+	 * stopped when the request state is exited.
+	 */
+	rapid_ack = dhcp->rapid_ack;
+	if ( rapid_ack ) {
+		dhcp->rapid_ack = NULL;
+		memset ( &peer, 0, sizeof ( peer ) );
+		peer.sin_family = AF_INET;
+		peer.sin_addr = dhcp->server;
+		peer.sin_port = htons ( BOOTPS_PORT );
+		dhcp_request_rx ( dhcp, rapid_ack, &peer, DHCPACK,
+				  dhcp->server, dhcp->server );
+		dhcppkt_put ( rapid_ack );
+	}
+}
+
 /**
  * Handle received packet during DHCP discovery
  *
@@ -364,7 +581,7 @@ static void dhcp_discovery_rx ( struct dhcp_session *dhcp,
 	int has_pxeclient;
 	int8_t priority = 0;
 	uint8_t no_pxedhcp = 0;
-	unsigned long elapsed;
+	int rapid;
 
 	DBGC ( dhcp, "DHCP %p %s from %s:%d", dhcp,
 	       dhcp_msgtype_name ( msgtype ), inet_ntoa ( peer->sin_addr ),
@@ -401,16 +618,26 @@ static void dhcp_discovery_rx ( struct dhcp_session *dhcp,
 			sizeof ( no_pxedhcp ) );
 	if ( no_pxedhcp )
 		DBGC ( dhcp, " nopxe" );
+
+	/* Identify Rapid Commit DHCPACK */
+	rapid = ( ( msgtype == DHCPACK ) &&
+		  ( dhcppkt_fetch ( dhcppkt, DHCP_RAPID_COMMIT,
+				    NULL, 0 ) >= 0 ) );
+	if ( rapid )
+		DBGC ( dhcp, " rapid" );
 	DBGC ( dhcp, "\n" );
 
 	/* Select as DHCP offer, if applicable */
 	if ( ip.s_addr && ( peer->sin_port == htons ( BOOTPS_PORT ) ) &&
-	     ( ( msgtype == DHCPOFFER ) || ( ! msgtype /* BOOTP */ ) ) &&
+	     ( ( msgtype == DHCPOFFER ) || ( ! msgtype /* BOOTP */ ) ||
+	       rapid ) &&
 	     ( priority >= dhcp->priority ) ) {
 		dhcp->offer = ip;
 		dhcp->server = server_id;
 		dhcp->priority = priority;
 		dhcp->no_pxedhcp = no_pxedhcp;
+		dhcppkt_put ( dhcp->rapid_ack );
+		dhcp->rapid_ack = ( rapid ? dhcppkt_get ( dhcppkt ) : NULL );
 	}
 
 	/* Select as ProxyDHCP offer, if applicable */
@@ -420,6 +647,7 @@ static void dhcp_discovery_rx ( struct dhcp_session *dhcp,
 		dhcp->proxy_server = pseudo_id;
 		dhcp->proxy_offer = dhcppkt_get ( dhcppkt );
 		dhcp->proxy_priority = priority;
+		dhcp_proxyless_forget ( dhcp );
 	}
 
 	/* We can exit the discovery state when we have a valid
@@ -427,7 +655,10 @@ static void dhcp_discovery_rx ( struct dhcp_session *dhcp,
 	 *
 	 *  o  The DHCPOFFER instructs us to ignore ProxyDHCPOFFERs, or
 	 *  o  We have a valid ProxyDHCPOFFER, or
+	 *  o  We do not expect any ProxyDHCPOFFERs, or
 	 *  o  We have allowed sufficient time for ProxyDHCPOFFERs.
+	 *
+	 * A Rapid Commit DHCPACK counts as a valid DHCPOFFER.
 	 */
 
 	/* If we don't yet have a DHCPOFFER, do nothing */
@@ -435,13 +666,12 @@ static void dhcp_discovery_rx ( struct dhcp_session *dhcp,
 		return;
 
 	/* If we can't yet transition to DHCPREQUEST, do nothing */
-	elapsed = ( currticks() - dhcp->start );
 	if ( ! ( dhcp->no_pxedhcp || dhcp->proxy_offer ||
-		 ( elapsed > DHCP_DISC_PROXY_TIMEOUT_SEC * TICKS_PER_SEC ) ) )
+		 dhcp_proxy_waited ( dhcp ) ) )
 		return;
 
-	/* Transition to DHCPREQUEST */
-	dhcp_set_state ( dhcp, &dhcp_state_request );
+	/* Complete discovery */
+	dhcp_discovery_complete ( dhcp );
 }
 
 /**
@@ -470,12 +700,10 @@ static void dhcp_defer ( struct dhcp_session *dhcp ) {
  * @v dhcp		DHCP session
  */
 static void dhcp_discovery_expired ( struct dhcp_session *dhcp ) {
-	unsigned long elapsed = ( currticks() - dhcp->start );
 
 	/* Give up waiting for ProxyDHCP before we reach the failure point */
-	if ( dhcp->offer.s_addr &&
-	     ( elapsed > DHCP_DISC_PROXY_TIMEOUT_SEC * TICKS_PER_SEC ) ) {
-		dhcp_set_state ( dhcp, &dhcp_state_request );
+	if ( dhcp->offer.s_addr && dhcp_proxy_waited ( dhcp ) ) {
+		dhcp_discovery_complete ( dhcp );
 		return;
 	}
 
@@ -496,6 +724,7 @@ static struct dhcp_session_state dhcp_state_discover = {
 	.tx_msgtype		= DHCPDISCOVER,
 	.min_timeout_sec	= DHCP_DISC_START_TIMEOUT_SEC,
 	.max_timeout_sec	= DHCP_DISC_END_TIMEOUT_SEC,
+	.profiler		= &dhcp_discover_profiler,
 };
 
 /**
@@ -655,6 +884,7 @@ static struct dhcp_session_state dhcp_state_request = {
 	.tx_msgtype		= DHCPREQUEST,
 	.min_timeout_sec	= DHCP_REQ_START_TIMEOUT_SEC,
 	.max_timeout_sec	= DHCP_REQ_END_TIMEOUT_SEC,
+	.profiler		= &dhcp_request_profiler,
 };
 
 /**
@@ -765,6 +995,7 @@ static struct dhcp_session_state dhcp_state_proxy = {
 	.tx_msgtype		= DHCPREQUEST,
 	.min_timeout_sec	= DHCP_PROXY_START_TIMEOUT_SEC,
 	.max_timeout_sec	= DHCP_PROXY_END_TIMEOUT_SEC,
+	.profiler		= &dhcp_proxy_profiler,
 };
 
 /**
@@ -917,6 +1148,7 @@ static struct dhcp_session_state dhcp_state_pxebs = {
 	.tx_msgtype		= DHCPREQUEST,
 	.min_timeout_sec	= PXEBS_START_TIMEOUT_SEC,
 	.max_timeout_sec	= PXEBS_END_TIMEOUT_SEC,
+	.profiler		= &dhcp_pxebs_profiler,
 };
 
 /****************************************************************************
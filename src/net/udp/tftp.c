@@ -44,6 +44,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/dhcp.h>
 #include <ipxe/uri.h>
 #include <ipxe/profile.h>
+#include <ipxe/job.h>
 #include <ipxe/tftp.h>
 
 /** @file
@@ -76,6 +77,9 @@ FEATURE ( FEATURE_PROTOCOL, "TFTP", DHCP_EB_FEATURE_TFTP, 1 );
 #define EINVAL_MC_INVALID_PORT __einfo_error ( EINFO_EINVAL_MC_INVALID_PORT )
 #define EINFO_EINVAL_MC_INVALID_PORT __einfo_uniqify \
 	( EINFO_EINVAL, 0x07, "Invalid multicast port" )
+#define EINVAL_WINDOWSIZE __einfo_error ( EINFO_EINVAL_WINDOWSIZE )
+#define EINFO_EINVAL_WINDOWSIZE __einfo_uniqify \
+	( EINFO_EINVAL, 0x08, "Invalid windowsize" )
 
 /**
  * A TFTP request
@@ -109,6 +113,18 @@ struct tftp_request {
 	 * "tsize" option, this value will be zero.
 	 */
 	unsigned long tsize;
+	/** Window size
+	 *
+	 * This is the "windowsize" option negotiated with the TFTP
+	 * server (RFC 7440).  If the TFTP server does not support the
+	 * "windowsize" option, this will default to 1 (i.e. each
+	 * block is acknowledged individually).
+	 */
+	unsigned int windowsize;
+	/** Block number at which the current window ends */
+	unsigned int window_end;
+	/** Number of packet loss events */
+	unsigned int losses;
 	
 	/** Server port
 	 *
@@ -140,6 +156,8 @@ struct tftp_request {
 	 * the file length.
 	 */
 	size_t filesize;
+	/** Number of distinct blocks received */
+	unsigned int received;
 	/** Retransmission timer */
 	struct retry_timer timer;
 };
@@ -154,11 +172,23 @@ enum {
 	TFTP_FL_RRQ_MULTICAST = 0x0004,
 	/** Perform MTFTP recovery on timeout */
 	TFTP_FL_MTFTP_RECOVERY = 0x0008,
+	/** A gap in the current window has been acknowledged */
+	TFTP_FL_WINDOW_GAP = 0x0010,
 };
 
 /** Maximum number of MTFTP open requests before falling back to TFTP */
 #define MTFTP_MAX_TIMEOUTS 3
 
+/** Maximum number of packet loss events before falling back to lock-step */
+#define TFTP_MAX_LOSSES 4
+
+/** Window size to be requested
+ *
+ * This drops to 1 after a transfer suffering repeated packet loss,
+ * and is restored once a transfer completes without loss.
+ */
+static unsigned int tftp_windowsize = TFTP_WINDOWSIZE;
+
 /** Client profiler */
 static struct profiler tftp_client_profiler __profiler =
 	{ .name = "tftp.client" };
@@ -195,6 +225,14 @@ static void tftp_done ( struct tftp_request *tftp, int rc ) {
 	/* Stop the retry timer */
 	stop_timer ( &tftp->timer );
 
+	/* Restore requested window size after a loss-free transfer */
+	if ( ( rc == 0 ) && ( tftp->losses == 0 ) &&
+	     ( tftp_windowsize != TFTP_WINDOWSIZE ) ) {
+		DBGC ( tftp, "TFTP %p restoring windowsize %d\n",
+		       tftp, TFTP_WINDOWSIZE );
+		tftp_windowsize = TFTP_WINDOWSIZE;
+	}
+
 	/* Close all data transfer interfaces */
 	intf_shutdown ( &tftp->socket, rc );
 	intf_shutdown ( &tftp->mc_socket, rc );
@@ -217,6 +255,9 @@ static int tftp_reopen ( struct tftp_request *tftp ) {
 	/* Disable ACK sending. */
 	tftp->flags &= ~TFTP_FL_SEND_ACK;
 
+	/* Reset window size until renegotiated */
+	tftp->windowsize = 1;
+
 	/* Reset peer address */
 	memset ( &tftp->peer, 0, sizeof ( tftp->peer ) );
 
@@ -329,6 +370,22 @@ void tftp_set_mtftp_port ( unsigned int port ) {
 	tftp_mtftp_socket.sin_port = htons ( port );
 }
 
+/**
+ * Record TFTP packet loss event
+ *
+ * @v tftp		TFTP connection
+ */
+static void tftp_loss ( struct tftp_request *tftp ) {
+
+	/* Fall back to lock-step transfers after repeated losses */
+	if ( ( ++tftp->losses >= TFTP_MAX_LOSSES ) &&
+	     ( tftp_windowsize > 1 ) ) {
+		DBGC ( tftp, "TFTP %p falling back to windowsize 1 after %d "
+		       "losses\n", tftp, tftp->losses );
+		tftp_windowsize = 1;
+	}
+}
+
 /**
  * Transmit RRQ
  *
@@ -349,6 +406,7 @@ static int tftp_send_rrq ( struct tftp_request *tftp ) {
 		+ 5 + 1 /* "octet" + NUL */
 		+ 7 + 1 + 5 + 1 /* "blksize" + NUL + ddddd + NUL */
 		+ 5 + 1 + 1 + 1 /* "tsize" + NUL + "0" + NUL */ 
+		+ 10 + 1 + 5 + 1 /* "windowsize" + NUL + ddddd + NUL */
 		+ 9 + 1 + 1 /* "multicast" + NUL + NUL */ );
 	iobuf = xfer_alloc_iob ( &tftp->socket, len );
 	if ( ! iobuf )
@@ -370,6 +428,14 @@ static int tftp_send_rrq ( struct tftp_request *tftp ) {
 					    "blksize%c%zd%ctsize%c0",
 					    0, blksize, 0, 0 ) + 1 );
 	}
+	if ( ( tftp->flags & TFTP_FL_RRQ_SIZES ) &&
+	     ( ! ( tftp->flags & TFTP_FL_RRQ_MULTICAST ) ) &&
+	     ( tftp_windowsize > 1 ) ) {
+		iob_put ( iobuf, snprintf ( iobuf->tail,
+					    iob_tailroom ( iobuf ),
+					    "windowsize%c%d", 0,
+					    tftp_windowsize ) + 1 );
+	}
 	if ( tftp->flags & TFTP_FL_RRQ_MULTICAST ) {
 		iob_put ( iobuf, snprintf ( iobuf->tail,
 					    iob_tailroom ( iobuf ),
@@ -400,6 +466,9 @@ static int tftp_send_ack ( struct tftp_request *tftp ) {
 	block = bitmap_first_gap ( &tftp->bitmap );
 	DBGC2 ( tftp, "TFTP %p sending ACK for block %d\n", tftp, block );
 
+	/* Record end of the window that this ACK will open */
+	tftp->window_end = ( block + tftp->windowsize );
+
 	/* Allocate buffer */
 	iobuf = xfer_alloc_iob ( &tftp->socket, sizeof ( *ack ) );
 	if ( ! iobuf )
@@ -524,6 +593,7 @@ static void tftp_timer_expired ( struct retry_timer *timer, int fail ) {
 				bitmap_free ( &tftp->bitmap );
 				memset ( &tftp->bitmap, 0,
 					 sizeof ( tftp->bitmap ) );
+				tftp->received = 0;
 
 				/* Reopen on standard TFTP port */
 				tftp->port = TFTP_PORT;
@@ -539,6 +609,28 @@ static void tftp_timer_expired ( struct retry_timer *timer, int fail ) {
 			rc = -ETIMEDOUT;
 			goto err;
 		}
+
+		/* If we are a passive multicast client and the
+		 * multicast stream has stalled before we have
+		 * received every block, then resend the RRQ.  We
+		 * retain all blocks received so far, and the server
+		 * will eventually select us as the master client, at
+		 * which point we will request repair of the remaining
+		 * gaps via unicast ACKs.
+		 */
+		if ( ( tftp->flags & TFTP_FL_RRQ_MULTICAST ) &&
+		     ( ! ( tftp->flags & TFTP_FL_SEND_ACK ) ) &&
+		     tftp->peer.st_family ) {
+			DBGC ( tftp, "TFTP %p rejoining with %d of %d blocks "
+			       "received\n", tftp, tftp->received,
+			       tftp->bitmap.length );
+			if ( ( rc = tftp_reopen ( tftp ) ) != 0 )
+				goto err;
+		}
+
+		/* Record loss of a block or ACK */
+		if ( tftp->peer.st_family )
+			tftp_loss ( tftp );
 	}
 	tftp_send_packet ( tftp );
 	return;
@@ -568,6 +660,30 @@ static int tftp_process_blksize ( struct tftp_request *tftp, char *value ) {
 	return 0;
 }
 
+/**
+ * Process TFTP "windowsize" option
+ *
+ * @v tftp		TFTP connection
+ * @v value		Option value
+ * @ret rc		Return status code
+ */
+static int tftp_process_windowsize ( struct tftp_request *tftp,
+				     char *value ) {
+	char *end;
+
+	tftp->windowsize = strtoul ( value, &end, 10 );
+	if ( *end || ( tftp->windowsize == 0 ) ||
+	     ( tftp->windowsize > 0xffff ) ) {
+		DBGC ( tftp, "TFTP %p got invalid windowsize \"%s\"\n",
+		       tftp, value );
+		tftp->windowsize = 1;
+		return -EINVAL_WINDOWSIZE;
+	}
+	DBGC ( tftp, "TFTP %p windowsize=%d\n", tftp, tftp->windowsize );
+
+	return 0;
+}
+
 /**
  * Process TFTP "tsize" option
  *
@@ -674,6 +790,7 @@ static struct tftp_option tftp_options[] = {
 	{ "blksize", tftp_process_blksize },
 	{ "tsize", tftp_process_tsize },
 	{ "multicast", tftp_process_multicast },
+	{ "windowsize", tftp_process_windowsize },
 	{ NULL, NULL }
 };
 
@@ -789,7 +906,9 @@ static int tftp_rx_data ( struct tftp_request *tftp,
 			  struct io_buffer *iobuf ) {
 	struct tftp_data *data = iobuf->data;
 	struct xfer_metadata meta;
+	unsigned int expected;
 	unsigned int block;
+	int ack;
 	off_t offset;
 	size_t data_len;
 	int rc;
@@ -802,14 +921,30 @@ static int tftp_rx_data ( struct tftp_request *tftp,
 		goto done;
 	}
 
-	/* Calculate block number */
-	block = ( ( bitmap_first_gap ( &tftp->bitmap ) + 1 ) & ~0xffff );
-	if ( data->block == 0 && block == 0 ) {
-		DBGC ( tftp, "TFTP %p received data block 0\n", tftp );
-		rc = -EINVAL;
+	/* Calculate block number.  Multicast clients may join
+	 * partway through a transfer, and so may see any block; a
+	 * unicast server will send only blocks within the current
+	 * window, and other blocks must be ignored.
+	 */
+	expected = bitmap_first_gap ( &tftp->bitmap );
+	if ( tftp->flags & ( TFTP_FL_RRQ_MULTICAST |
+			     TFTP_FL_MTFTP_RECOVERY ) ) {
+		block = ( ( expected + 1 ) & ~0xffff );
+		if ( data->block == 0 && block == 0 ) {
+			DBGC ( tftp, "TFTP %p received data block 0\n",
+			       tftp );
+			rc = -EINVAL;
+			goto done;
+		}
+		block += ( ntohs ( data->block ) - 1 );
+	} else if ( ! tftp_block ( expected, tftp->windowsize,
+				   ntohs ( data->block ), &block ) ) {
+		DBGC ( tftp, "TFTP %p ignoring out-of-window data block %d "
+		       "(expected %d)\n", tftp, ntohs ( data->block ),
+		       ( ( expected + 1 ) & 0xffff ) );
+		rc = 0;
 		goto done;
 	}
-	block += ( ntohs ( data->block ) - 1 );
 
 	/* Stop profiling server turnaround if applicable */
 	if ( block )
@@ -826,15 +961,17 @@ static int tftp_rx_data ( struct tftp_request *tftp,
 		goto done;
 	}
 
-	/* Deliver data */
-	memset ( &meta, 0, sizeof ( meta ) );
-	meta.flags = XFER_FL_ABS_OFFSET;
-	meta.offset = offset;
-	if ( ( rc = xfer_deliver ( &tftp->xfer, iob_disown ( iobuf ),
-				   &meta ) ) != 0 ) {
-		DBGC ( tftp, "TFTP %p could not deliver data: %s\n",
-		       tftp, strerror ( rc ) );
-		goto done;
+	/* Deliver data, unless this is a duplicate block */
+	if ( ! bitmap_test ( &tftp->bitmap, block ) ) {
+		memset ( &meta, 0, sizeof ( meta ) );
+		meta.flags = XFER_FL_ABS_OFFSET;
+		meta.offset = offset;
+		if ( ( rc = xfer_deliver ( &tftp->xfer, iob_disown ( iobuf ),
+					   &meta ) ) != 0 ) {
+			DBGC ( tftp, "TFTP %p could not deliver data: %s\n",
+			       tftp, strerror ( rc ) );
+			goto done;
+		}
 	}
 
 	/* Ensure block bitmap is ready */
@@ -842,10 +979,40 @@ static int tftp_rx_data ( struct tftp_request *tftp,
 		goto done;
 
 	/* Mark block as received */
+	if ( ! bitmap_test ( &tftp->bitmap, block ) )
+		tftp->received++;
 	bitmap_set ( &tftp->bitmap, block );
 
-	/* Acknowledge block */
-	tftp_send_packet ( tftp );
+	/* Determine whether or not an acknowledgement is due.  When
+	 * using a window, acknowledge only the end of each window,
+	 * the end of the file, or the first gap within a window (so
+	 * that the server restarts from the last in-order block).
+	 */
+	if ( ( tftp->windowsize <= 1 ) || bitmap_full ( &tftp->bitmap ) ) {
+		ack = 1;
+	} else if ( block > expected ) {
+		ack = ( ! ( tftp->flags & TFTP_FL_WINDOW_GAP ) );
+		if ( ack ) {
+			DBGC ( tftp, "TFTP %p missing block %d\n",
+			       tftp, expected );
+			tftp->flags |= TFTP_FL_WINDOW_GAP;
+			tftp_loss ( tftp );
+		}
+	} else if ( block == expected ) {
+		tftp->flags &= ~TFTP_FL_WINDOW_GAP;
+		ack = ( bitmap_first_gap ( &tftp->bitmap ) >=
+			tftp->window_end );
+	} else {
+		ack = 0;
+	}
+
+	/* Acknowledge block, or restart retransmission timer */
+	if ( ack ) {
+		tftp_send_packet ( tftp );
+	} else {
+		stop_timer ( &tftp->timer );
+		start_timer ( &tftp->timer );
+	}
 
 	/* Stop profiling client turnaround */
 	profile_stop ( &tftp_client_profiler );
@@ -1042,6 +1209,33 @@ static size_t tftp_xfer_window ( struct tftp_request *tftp ) {
 	return tftp->blksize;
 }
 
+/**
+ * Report TFTP download progress
+ *
+ * @v tftp		TFTP connection
+ * @v progress		Progress report to fill in
+ * @ret ongoing_rc	Ongoing job status code (if known)
+ *
+ * Blocks may arrive out of order (e.g. when joining a multicast
+ * session part way through), so progress is reported as the
+ * proportion of the file covered by blocks received so far.
+ */
+static int tftp_progress ( struct tftp_request *tftp,
+			   struct job_progress *progress ) {
+	size_t completed;
+
+	/* Report coverage only once the file size is known */
+	if ( ! tftp->filesize )
+		return 0;
+	completed = ( tftp->received * tftp->blksize );
+	if ( completed > tftp->filesize )
+		completed = tftp->filesize;
+	progress->completed = completed;
+	progress->total = tftp->filesize;
+
+	return 0;
+}
+
 /**
  * Terminate download
  *
@@ -1060,6 +1254,7 @@ static void tftp_close ( struct tftp_request *tftp, int rc ) {
 /** TFTP data transfer interface operations */
 static struct interface_operation tftp_xfer_operations[] = {
 	INTF_OP ( xfer_window, struct tftp_request *, tftp_xfer_window ),
+	INTF_OP ( job_progress, struct tftp_request *, tftp_progress ),
 	INTF_OP ( intf_close, struct tftp_request *, tftp_close ),
 };
 
@@ -99,6 +99,76 @@ static inline void alloc_iob_fail_okx ( size_t len, size_t align, size_t offset,
 #define alloc_iob_fail_ok( len, align, offset ) \
 	alloc_iob_fail_okx ( len, align, offset, __FILE__, __LINE__ )
 
+/** Reference counter for I/O buffer pool test */
+static struct refcnt iob_pool_refcnt;
+
+/**
+ * Free I/O buffer pool test object
+ *
+ * @v refcnt		Reference counter
+ */
+static void iob_pool_refcnt_free ( struct refcnt *refcnt __unused ) {
+	/* Nothing to do */
+}
+
+/**
+ * Perform I/O buffer pool self-tests
+ *
+ */
+static void iob_pool_test_exec ( void ) {
+	struct iob_pool pool;
+	struct io_buffer *first;
+	struct io_buffer *second;
+	struct io_buffer *third;
+
+	/* Initialise pool */
+	memset ( &pool, 0, sizeof ( pool ) );
+	ref_init ( &iob_pool_refcnt, iob_pool_refcnt_free );
+	iob_pool_init ( &pool, 1, &iob_pool_refcnt );
+
+	/* Initial allocations must come from the heap */
+	first = iob_pool_alloc ( &pool, 1536 );
+	ok ( first != NULL );
+	second = iob_pool_alloc ( &pool, 1536 );
+	ok ( second != NULL );
+	ok ( pool.hits == 0 );
+	ok ( pool.misses == 2 );
+	ok ( iob_pool_refcnt.count == 2 );
+	memset ( iob_put ( first, 1536 ), 0x55, 1536 );
+	first->flags = IOB_FL_CSUM_OK;
+
+	/* Freed buffers must be retained only up to the pool limit */
+	free_iob ( first );
+	free_iob ( second );
+	ok ( pool.count == 1 );
+	ok ( iob_pool_refcnt.count == 0 );
+
+	/* Retained buffer must be reused in a clean state */
+	third = iob_pool_alloc ( &pool, 1536 );
+	ok ( third == first );
+	ok ( pool.hits == 1 );
+	ok ( pool.count == 0 );
+	ok ( iob_len ( third ) == 0 );
+	ok ( iob_tailroom ( third ) >= 1536 );
+	ok ( third->flags == 0 );
+	free_iob ( third );
+	ok ( pool.count == 1 );
+
+	/* A change of length must discard retained buffers */
+	third = iob_pool_alloc ( &pool, 2048 );
+	ok ( third != NULL );
+	ok ( pool.count == 0 );
+	ok ( pool.misses == 3 );
+	ok ( iob_tailroom ( third ) >= 2048 );
+	free_iob ( third );
+
+	/* Flushing must release all retained buffers */
+	iob_pool_flush ( &pool );
+	ok ( pool.count == 0 );
+	ok ( list_empty ( &pool.free ) );
+	ok ( iob_pool_refcnt.count == 0 );
+}
+
 /**
  * Perform I/O buffer self-tests
  *
@@ -127,6 +197,9 @@ static void iobuf_test_exec ( void ) {
 	alloc_iob_fail_ok ( -1UL, 1024, 0 );
 	alloc_iob_fail_ok ( 0, -1UL, 0 );
 	alloc_iob_fail_ok ( 1024, -1UL, 0 );
+
+	/* Check recycling pools */
+	iob_pool_test_exec();
 }
 
 /** I/O buffer self-test */
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2026 Michael Brown <mbrown@fensystems.co.uk>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * Dynamic memory allocation self-tests
+ *
+ */
+
+/* Forcibly enable assertions */
+#undef NDEBUG
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ipxe/malloc.h>
+#include <ipxe/io.h>
+#include <ipxe/profile.h>
+#include <ipxe/test.h>
+
+/** Number of concurrently allocated blocks in stress test */
+#define MALLOC_STRESS_SLOTS 128
+
+/** Number of operations in stress test */
+#define MALLOC_STRESS_COUNT 8192
+
+/** A heap stress test */
+struct malloc_stress_test {
+	/** Seed */
+	unsigned int seed;
+	/** Maximum allocation size (log2) */
+	unsigned int max_size_log2;
+	/** Maximum alignment (log2), or zero for unaligned allocations */
+	unsigned int max_align_log2;
+};
+
+/** An allocated block */
+struct malloc_stress_block {
+	/** Memory, or NULL if not allocated */
+	uint8_t *ptr;
+	/** Size */
+	size_t size;
+	/** Fill pattern */
+	uint8_t fill;
+};
+
+/** Define a heap stress test */
+#define MALLOC_STRESS_TEST( name, SEED, SIZE, ALIGN )			\
+	static struct malloc_stress_test name = {			\
+		.seed = SEED,						\
+		.max_size_log2 = SIZE,					\
+		.max_align_log2 = ALIGN,				\
+	}
+
+/** Allocated blocks */
+static struct malloc_stress_block malloc_blocks[MALLOC_STRESS_SLOTS];
+
+/** Small unaligned allocations (e.g. protocol state) */
+MALLOC_STRESS_TEST ( small, 0x12345678UL, 8, 0 );
+
+/** Packet-sized aligned allocations (e.g. I/O buffers) */
+MALLOC_STRESS_TEST ( packets, 0x87654321UL, 11, 11 );
+
+/** Mixed allocations up to 4kB with arbitrary alignment and offset */
+MALLOC_STRESS_TEST ( mixed, 0xcafebabeUL, 12, 12 );
+
+/**
+ * Check that block contents are intact
+ *
+ * @v block		Allocated block
+ * @ret ok		Contents are intact
+ */
+static int malloc_intact ( struct malloc_stress_block *block ) {
+	size_t i;
+
+	for ( i = 0 ; i < block->size ; i++ ) {
+		if ( block->ptr[i] != block->fill )
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * Report heap stress test result
+ *
+ * @v test		Heap stress test
+ * @v file		Test code file
+ * @v line		Test code line
+ */
+static void malloc_stress_okx ( struct malloc_stress_test *test,
+				const char *file, unsigned int line ) {
+	struct malloc_stress_block *block;
+	struct profiler alloc_profiler;
+	struct profiler free_profiler;
+	size_t initial_freemem = freemem;
+	size_t align;
+	size_t offset;
+	unsigned int failures = 0;
+	unsigned int i;
+
+	/* Perform random allocations and frees */
+	memset ( &alloc_profiler, 0, sizeof ( alloc_profiler ) );
+	memset ( &free_profiler, 0, sizeof ( free_profiler ) );
+	srandom ( test->seed );
+	for ( i = 0 ; i < MALLOC_STRESS_COUNT ; i++ ) {
+		block = &malloc_blocks[ random() % MALLOC_STRESS_SLOTS ];
+
+		/* Free block, if allocated */
+		if ( block->ptr ) {
+			okx ( malloc_intact ( block ), file, line );
+			profile_start ( &free_profiler );
+			free_phys ( block->ptr, block->size );
+			profile_stop ( &free_profiler );
+			block->ptr = NULL;
+			continue;
+		}
+
+		/* Otherwise, allocate a new block */
+		block->size = ( ( random() %
+				  ( 1UL << test->max_size_log2 ) ) + 1 );
+		align = ( test->max_align_log2 ?
+			  ( 1UL << ( random() %
+				     ( test->max_align_log2 + 1 ) ) ) : 1 );
+		offset = ( ( random() & 1 ) ? ( random() % align ) : 0 );
+		profile_start ( &alloc_profiler );
+		block->ptr = malloc_phys_offset ( block->size, align, offset );
+		profile_stop ( &alloc_profiler );
+		if ( ! block->ptr ) {
+			failures++;
+			continue;
+		}
+		okx ( ( ( virt_to_phys ( block->ptr ) - offset ) &
+			( align - 1 ) ) == 0, file, line );
+		block->fill = random();
+		memset ( block->ptr, block->fill, block->size );
+	}
+
+	/* Free all remaining blocks */
+	for ( i = 0 ; i < MALLOC_STRESS_SLOTS ; i++ ) {
+		block = &malloc_blocks[i];
+		if ( ! block->ptr )
+			continue;
+		okx ( malloc_intact ( block ), file, line );
+		free_phys ( block->ptr, block->size );
+		block->ptr = NULL;
+	}
+
+	/* Check that all memory has been returned */
+	okx ( freemem == initial_freemem, file, line );
+	okx ( failures == 0, file, line );
+	DBG ( "MALLOC stress %#08x allocated in %ld +/- %ld ticks, freed in "
+	      "%ld +/- %ld ticks\n", test->seed,
+	      profile_mean ( &alloc_profiler ),
+	      profile_stddev ( &alloc_profiler ),
+	      profile_mean ( &free_profiler ),
+	      profile_stddev ( &free_profiler ) );
+}
+#define malloc_stress_ok( test ) \
+	malloc_stress_okx ( test, __FILE__, __LINE__ )
+
+/**
+ * Perform dynamic memory allocation self-tests
+ *
+ */
+static void malloc_test_exec ( void ) {
+	size_t initial_freemem = freemem;
+	void *first;
+	void *second;
+	void *third;
+	void *large;
+
+	/* Freed neighbours must be merged, in any order */
+	first = malloc ( 1000 );
+	second = malloc ( 1000 );
+	third = malloc ( 1000 );
+	ok ( first != NULL );
+	ok ( second != NULL );
+	ok ( third != NULL );
+	free ( first );
+	free ( third );
+	free ( second );
+	ok ( freemem == initial_freemem );
+
+	/* Aligned allocations with odd offsets */
+	first = malloc_phys_offset ( 100, 4096, 3 );
+	ok ( first != NULL );
+	ok ( ( ( virt_to_phys ( first ) - 3 ) & 4095 ) == 0 );
+	second = malloc_phys_offset ( 5000, 64, 63 );
+	ok ( second != NULL );
+	ok ( ( ( virt_to_phys ( second ) - 63 ) & 63 ) == 0 );
+	free_phys ( first, 100 );
+	free_phys ( second, 5000 );
+	ok ( freemem == initial_freemem );
+
+	/* Stress tests */
+	malloc_stress_ok ( &small );
+	malloc_stress_ok ( &packets );
+	malloc_stress_ok ( &mixed );
+
+	/* A large aligned allocation must succeed after stress testing */
+	large = malloc_phys ( 65536, 65536 );
+	ok ( large != NULL );
+	free_phys ( large, 65536 );
+	ok ( freemem == initial_freemem );
+}
+
+/** Dynamic memory allocation self-test */
+struct self_test malloc_test __self_test = {
+	.name = "malloc",
+	.exec = malloc_test_exec,
+};
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2026 Michael Brown <mbrown@fensystems.co.uk>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * Retry timer self-tests
+ *
+ */
+
+/* Forcibly enable assertions */
+#undef NDEBUG
+
+#include <string.h>
+#include <ipxe/timer.h>
+#include <ipxe/retry.h>
+#include <ipxe/test.h>
+
+/** Number of timers used in self-tests */
+#define RETRY_TEST_TIMERS 4
+
+/** A retry timer self-test timer */
+struct retry_test_timer {
+	/** Retry timer */
+	struct retry_timer timer;
+	/** Number of expiries */
+	unsigned int expired;
+	/** Timer to stop on expiry, if any */
+	struct retry_timer *stop;
+	/** Restart this timer on expiry */
+	int restart;
+};
+
+/** Self-test timers */
+static struct retry_test_timer retry_test_timers[RETRY_TEST_TIMERS];
+
+/**
+ * Handle self-test timer expiry
+ *
+ * @v timer		Retry timer
+ * @v fail		Failure indicator
+ */
+static void retry_test_expired ( struct retry_timer *timer,
+				 int fail __unused ) {
+	struct retry_test_timer *test =
+		container_of ( timer, struct retry_test_timer, timer );
+
+	test->expired++;
+	if ( test->stop )
+		stop_timer ( test->stop );
+	if ( test->restart )
+		start_timer_nodelay ( timer );
+}
+
+/**
+ * Reset self-test timers
+ *
+ */
+static void retry_test_reset ( void ) {
+	struct retry_test_timer *test;
+	unsigned int i;
+
+	for ( i = 0 ; i < RETRY_TEST_TIMERS ; i++ ) {
+		test = &retry_test_timers[i];
+		stop_timer ( &test->timer );
+		memset ( test, 0, sizeof ( *test ) );
+		timer_init ( &test->timer, retry_test_expired, NULL );
+	}
+}
+
+/**
+ * Perform retry timer self-tests
+ *
+ */
+static void retry_test_exec ( void ) {
+	struct retry_test_timer *timers = retry_test_timers;
+	unsigned int i;
+
+	/* All due timers must expire within a single poll */
+	retry_test_reset();
+	for ( i = 0 ; i < RETRY_TEST_TIMERS ; i++ )
+		start_timer_nodelay ( &timers[i].timer );
+	ok ( retry_remaining ( TICKS_PER_SEC ) == 0 );
+	retry_poll();
+	for ( i = 0 ; i < RETRY_TEST_TIMERS ; i++ ) {
+		ok ( timers[i].expired == 1 );
+		ok ( ! timer_running ( &timers[i].timer ) );
+	}
+
+	/* A timer stopped by another timer's expiry must not expire */
+	retry_test_reset();
+	timers[0].stop = &timers[1].timer;
+	start_timer_nodelay ( &timers[0].timer );
+	start_timer_nodelay ( &timers[1].timer );
+	retry_poll();
+	ok ( timers[0].expired == 1 );
+	ok ( timers[1].expired == 0 );
+	ok ( ! timer_running ( &timers[1].timer ) );
+
+	/* A timer restarted on expiry must expire only once per poll */
+	retry_test_reset();
+	timers[0].restart = 1;
+	start_timer_nodelay ( &timers[0].timer );
+	retry_poll();
+	ok ( timers[0].expired == 1 );
+	ok ( timer_running ( &timers[0].timer ) );
+	retry_poll();
+	ok ( timers[0].expired == 2 );
+	timers[0].restart = 0;
+	retry_poll();
+	ok ( timers[0].expired == 3 );
+	ok ( ! timer_running ( &timers[0].timer ) );
+
+	/* Timers must not expire early, and must report the earliest
+	 * deadline, including beyond one revolution of the timer wheel.
+	 */
+	retry_test_reset();
+	start_timer_fixed ( &timers[0].timer, ( 60 * TICKS_PER_SEC ) );
+	start_timer_fixed ( &timers[1].timer, ( 30 * TICKS_PER_SEC ) );
+	retry_poll();
+	ok ( timers[0].expired == 0 );
+	ok ( timers[1].expired == 0 );
+	ok ( retry_remaining ( 120 * TICKS_PER_SEC ) <=
+	     ( 30 * TICKS_PER_SEC ) );
+	ok ( retry_remaining ( 120 * TICKS_PER_SEC ) >
+	     ( 29 * TICKS_PER_SEC ) );
+	ok ( retry_remaining ( 10 ) == 10 );
+
+	/* Restarting a running timer must move it */
+	start_timer_nodelay ( &timers[0].timer );
+	retry_poll();
+	ok ( timers[0].expired == 1 );
+	ok ( timers[1].expired == 0 );
+	ok ( timer_running ( &timers[1].timer ) );
+	retry_test_reset();
+}
+
+/** Retry timer self-test */
+struct self_test retry_test __self_test = {
+	.name = "retry",
+	.exec = retry_test_exec,
+};
@@ -38,11 +38,19 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <assert.h>
 #include <ipxe/test.h>
 #include <ipxe/profile.h>
+#include <ipxe/iobuf.h>
+#include <ipxe/in.h>
+#include <ipxe/ipstat.h>
 #include <ipxe/tcpip.h>
+#include <ipxe/ip.h>
+#include <ipxe/tcp.h>
 
 /** Number of sample iterations for profiling */
 #define PROFILE_COUNT 16
 
+/** Maximum segment size for receive coalescing tests */
+#define TCPIP_COALESCE_MSS 1448
+
 /** A TCP/IP fixed-data test */
 struct tcpip_test {
 	/** Data */
@@ -61,6 +69,18 @@ struct tcpip_random_test {
 	size_t offset;
 };
 
+/** A TCP/IP receive checksum test */
+struct tcpip_rx_test {
+	/** Transport-layer protocol */
+	uint8_t tcpip_proto;
+	/** Packet (with an incorrect checksum) */
+	const void *data;
+	/** Length of packet */
+	size_t len;
+	/** Offset of checksum field */
+	size_t offset;
+};
+
 /** Define inline data */
 #define DATA(...) { __VA_ARGS__ }
 
@@ -81,6 +101,16 @@ struct tcpip_random_test {
 		.offset = OFFSET,					\
 	}
 
+/** Define a TCP/IP receive checksum test */
+#define TCPIP_RX_TEST( name, PROTO, OFFSET, DATA )			\
+	static const uint8_t name ## _data[] = DATA;			\
+	static struct tcpip_rx_test name = {				\
+		.tcpip_proto = PROTO,					\
+		.data = name ## _data,					\
+		.len = sizeof ( name ## _data ),			\
+		.offset = OFFSET,					\
+	}
+
 /** Buffer for pseudorandom-data tests */
 static uint8_t __attribute__ (( aligned ( 16 ) ))
 	tcpip_data[ 4096 + 7 /* offset */ ];
@@ -117,12 +147,35 @@ TCPIP_RANDOM_TEST ( random_unaligned_1, 0x12345678UL, 4096, 1 );
 /** Random data (unaligned, +2) */
 TCPIP_RANDOM_TEST ( random_unaligned_2, 0x12345678UL, 4096, 2 );
 
+/** Random data (unaligned, +3) */
+TCPIP_RANDOM_TEST ( random_unaligned_3, 0x87654321UL, 4096, 3 );
+
+/** Random data (unaligned, +7, truncated) */
+TCPIP_RANDOM_TEST ( random_unaligned_7, 0x87654321UL, 4093, 7 );
+
 /** Random data (aligned, truncated) */
 TCPIP_RANDOM_TEST ( random_aligned_truncated, 0x12345678UL, 4095, 0 );
 
 /** Random data (unaligned start and finish) */
 TCPIP_RANDOM_TEST ( partial, 0xcafebabe, 121, 5 );
 
+/** Random data (short, unaligned) */
+TCPIP_RANDOM_TEST ( short_unaligned, 0xdeadbeef, 7, 1 );
+
+/** Random data (typical Ethernet payload) */
+TCPIP_RANDOM_TEST ( ethernet, 0x1badcafe, 1480, 2 );
+
+/** TCP packet to an unused port with an incorrect checksum */
+TCPIP_RX_TEST ( tcp_bad_csum, IP_TCP, 16,
+	DATA ( 0x30, 0x39, 0xd4, 0x31, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+	       0x00, 0x01, 0x50, 0x10, 0x20, 0x00, 0xde, 0xad, 0x00, 0x00,
+	       0x69, 0x50, 0x58, 0x45 ) );
+
+/** UDP packet to an unused port with an incorrect checksum */
+TCPIP_RX_TEST ( udp_bad_csum, IP_UDP, 6,
+	DATA ( 0x30, 0x39, 0xd4, 0x31, 0x00, 0x0c, 0xde, 0xad, 0x69, 0x50,
+	       0x58, 0x45 ) );
+
 /**
  * Calculate TCP/IP checksum
  *
@@ -196,9 +249,11 @@ static void tcpip_random_okx ( struct tcpip_random_test *test,
 			       const char *file, unsigned int line ) {
 	uint8_t *data = ( tcpip_data + test->offset );
 	struct profiler profiler;
+	struct profiler generic_profiler;
 	uint16_t expected;
 	uint16_t generic_sum;
 	uint16_t sum;
+	size_t split;
 	unsigned int i;
 
 	/* Sanity check */
@@ -219,20 +274,350 @@ static void tcpip_random_okx ( struct tcpip_random_test *test,
 	sum = tcpip_continue_chksum ( TCPIP_EMPTY_CSUM, data, test->len );
 	okx ( sum == expected, file, line );
 
-	/* Profile optimised calculation */
+	/* Verify continued checksums split at various even offsets */
+	for ( split = 0 ; split <= test->len ; split += 62 ) {
+		generic_sum = generic_tcpip_continue_chksum ( TCPIP_EMPTY_CSUM,
+							      data, split );
+		generic_sum = generic_tcpip_continue_chksum ( generic_sum,
+							      ( data + split ),
+							      ( test->len -
+								split ) );
+		okx ( generic_sum == expected, file, line );
+		sum = tcpip_continue_chksum ( TCPIP_EMPTY_CSUM, data, split );
+		sum = tcpip_continue_chksum ( sum, ( data + split ),
+					      ( test->len - split ) );
+		okx ( sum == expected, file, line );
+	}
+
+	/* Profile optimised and generic calculations */
 	memset ( &profiler, 0, sizeof ( profiler ) );
+	memset ( &generic_profiler, 0, sizeof ( generic_profiler ) );
 	for ( i = 0 ; i < PROFILE_COUNT ; i++ ) {
 		profile_start ( &profiler );
 		sum = tcpip_continue_chksum ( TCPIP_EMPTY_CSUM, data,
 					      test->len );
 		profile_stop ( &profiler );
+		profile_start ( &generic_profiler );
+		generic_sum = generic_tcpip_continue_chksum ( TCPIP_EMPTY_CSUM,
+							      data, test->len );
+		profile_stop ( &generic_profiler );
 	}
-	DBG ( "TCPIP checksummed %zd bytes (+%zd) in %ld +/- %ld ticks\n",
-	      test->len, test->offset, profile_mean ( &profiler ),
-	      profile_stddev ( &profiler ) );
+	DBG ( "TCPIP checksummed %zd bytes (+%zd) in %ld +/- %ld ticks "
+	      "(generic %ld +/- %ld ticks)\n", test->len, test->offset,
+	      profile_mean ( &profiler ), profile_stddev ( &profiler ),
+	      profile_mean ( &generic_profiler ),
+	      profile_stddev ( &generic_profiler ) );
 }
 #define tcpip_random_ok( test ) tcpip_random_okx ( test, __FILE__, __LINE__ )
 
+/**
+ * Receive TCP/IP test packet
+ *
+ * @v test		TCP/IP receive checksum test
+ * @v csum		Checksum field value
+ * @v flags		I/O buffer flags
+ * @ret rc		Return status code
+ */
+static int tcpip_rx_test_rx ( struct tcpip_rx_test *test, uint16_t csum,
+			      unsigned int flags ) {
+	struct sockaddr_tcpip st_src;
+	struct sockaddr_tcpip st_dest;
+	struct ip_statistics stats;
+	struct io_buffer *iobuf;
+
+	/* Construct packet */
+	iobuf = alloc_iob ( test->len );
+	assert ( iobuf != NULL );
+	memcpy ( iob_put ( iobuf, test->len ), test->data, test->len );
+	memcpy ( ( iobuf->data + test->offset ), &csum, sizeof ( csum ) );
+	iobuf->flags = flags;
+
+	/* Pass to transport-layer protocol */
+	memset ( &st_src, 0, sizeof ( st_src ) );
+	memset ( &st_dest, 0, sizeof ( st_dest ) );
+	memset ( &stats, 0, sizeof ( stats ) );
+	return tcpip_rx ( iobuf, NULL, test->tcpip_proto, &st_src, &st_dest,
+			  TCPIP_EMPTY_CSUM, &stats );
+}
+
+/**
+ * Report TCP/IP receive checksum test result
+ *
+ * @v test		TCP/IP receive checksum test
+ * @v file		Test code file
+ * @v line		Test code line
+ *
+ * The test packets are addressed to an unused port, and so will
+ * always be rejected.  A packet with a correct checksum must be
+ * rejected for the same reason as a packet with an incorrect checksum
+ * that has been marked as already verified by hardware, and for a
+ * different reason to an unverified packet with an incorrect
+ * checksum.
+ */
+static void tcpip_rx_okx ( struct tcpip_rx_test *test, const char *file,
+			   unsigned int line ) {
+	uint8_t data[test->len];
+	uint16_t bad;
+	uint16_t good;
+	int good_rc;
+	int bad_rc;
+	int rc;
+
+	/* Calculate correct checksum */
+	memcpy ( data, test->data, sizeof ( data ) );
+	memcpy ( &bad, ( data + test->offset ), sizeof ( bad ) );
+	memset ( ( data + test->offset ), 0, sizeof ( good ) );
+	good = tcpip_chksum ( data, sizeof ( data ) );
+	okx ( good != bad, file, line );
+
+	/* Receive packet with correct checksum */
+	good_rc = tcpip_rx_test_rx ( test, good, 0 );
+	okx ( good_rc != 0, file, line );
+
+	/* Receive unverified packet with incorrect checksum */
+	bad_rc = tcpip_rx_test_rx ( test, bad, 0 );
+	okx ( bad_rc != 0, file, line );
+	okx ( bad_rc != good_rc, file, line );
+
+	/* Receive hardware-verified packet with incorrect checksum */
+	rc = tcpip_rx_test_rx ( test, bad, IOB_FL_CSUM_OK );
+	okx ( rc == good_rc, file, line );
+}
+#define tcpip_rx_ok( test ) tcpip_rx_okx ( test, __FILE__, __LINE__ )
+
+/**
+ * Construct IPv4 TCP segment for receive coalescing tests
+ *
+ * @v seq		Sequence number
+ * @v flags		TCP flags
+ * @v len		Length of payload
+ * @v room		Additional tailroom
+ * @ret iobuf		I/O buffer
+ *
+ * The payload contents are derived from the sequence number, so that
+ * correctly coalesced payloads may be verified.
+ */
+static struct io_buffer * tcpip_segment ( uint32_t seq, unsigned int flags,
+					  size_t len, size_t room ) {
+	struct ipv4_pseudo_header pshdr;
+	struct io_buffer *iobuf;
+	struct iphdr *iphdr;
+	struct tcp_header *tcphdr;
+	uint8_t *payload;
+	uint16_t csum;
+	size_t i;
+
+	/* Allocate and populate I/O buffer */
+	iobuf = alloc_iob ( sizeof ( *iphdr ) + sizeof ( *tcphdr ) + len +
+			    room );
+	assert ( iobuf != NULL );
+	iphdr = iob_put ( iobuf, sizeof ( *iphdr ) );
+	tcphdr = iob_put ( iobuf, sizeof ( *tcphdr ) );
+	payload = iob_put ( iobuf, len );
+	for ( i = 0 ; i < len ; i++ )
+		payload[i] = ( seq + i );
+
+	/* Construct TCP header */
+	memset ( tcphdr, 0, sizeof ( *tcphdr ) );
+	tcphdr->src = htons ( 80 );
+	tcphdr->dest = htons ( 49152 );
+	tcphdr->seq = htonl ( seq );
+	tcphdr->ack = htonl ( 0x12345678UL );
+	tcphdr->hlen = ( ( sizeof ( *tcphdr ) / 4 ) << 4 );
+	tcphdr->flags = flags;
+	tcphdr->win = htons ( 0x2000 );
+
+	/* Construct IPv4 header */
+	memset ( iphdr, 0, sizeof ( *iphdr ) );
+	iphdr->verhdrlen = ( IP_VER | ( sizeof ( *iphdr ) / 4 ) );
+	iphdr->len = htons ( iob_len ( iobuf ) );
+	iphdr->ttl = IP_TTL;
+	iphdr->protocol = IP_TCP;
+	iphdr->src.s_addr = htonl ( 0xc0a80001UL );
+	iphdr->dest.s_addr = htonl ( 0xc0a80002UL );
+	iphdr->chksum = tcpip_chksum ( iphdr, sizeof ( *iphdr ) );
+
+	/* Calculate TCP checksum */
+	memset ( &pshdr, 0, sizeof ( pshdr ) );
+	pshdr.src = iphdr->src;
+	pshdr.dest = iphdr->dest;
+	pshdr.protocol = IP_TCP;
+	pshdr.len = htons ( sizeof ( *tcphdr ) + len );
+	csum = tcpip_continue_chksum ( TCPIP_EMPTY_CSUM, &pshdr,
+				       sizeof ( pshdr ) );
+	tcphdr->csum = tcpip_continue_chksum ( csum, tcphdr,
+					       ( sizeof ( *tcphdr ) + len ) );
+
+	return iobuf;
+}
+
+/**
+ * Check coalesced IPv4 TCP segment
+ *
+ * @v iobuf		I/O buffer
+ * @v seq		Expected sequence number
+ * @v len		Expected payload length
+ * @ret ok		Segment is correct
+ */
+static int tcpip_segment_ok ( struct io_buffer *iobuf, uint32_t seq,
+			      size_t len ) {
+	struct iphdr *iphdr = iobuf->data;
+	struct tcp_header *tcphdr = ( iobuf->data + sizeof ( *iphdr ) );
+	uint8_t *payload = ( iobuf->data + sizeof ( *iphdr ) +
+			     sizeof ( *tcphdr ) );
+	size_t i;
+
+	if ( iob_len ( iobuf ) != ( sizeof ( *iphdr ) + sizeof ( *tcphdr ) +
+				    len ) )
+		return 0;
+	if ( ntohs ( iphdr->len ) != iob_len ( iobuf ) )
+		return 0;
+	if ( tcpip_chksum ( iphdr, sizeof ( *iphdr ) ) != 0 )
+		return 0;
+	if ( ntohl ( tcphdr->seq ) != seq )
+		return 0;
+	for ( i = 0 ; i < len ; i++ ) {
+		if ( payload[i] != ( ( uint8_t ) ( seq + i ) ) )
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * Attempt to coalesce IPv4 TCP segments
+ *
+ * @v first		First segment
+ * @v next		Next segment
+ * @ret merged		Coalesced segment, or NULL if not coalesced
+ */
+static struct io_buffer *
+tcpip_coalesce_segments ( struct io_buffer *first, struct io_buffer *next ) {
+
+	return ipv4_protocol.coalesce ( first, next );
+}
+
+/**
+ * Check that IPv4 TCP segments are not coalesced
+ *
+ * @v first		First segment
+ * @v next		Next segment
+ * @v file		Test code file
+ * @v line		Test code line
+ */
+static void tcpip_no_coalesce_okx ( struct io_buffer *first,
+				    struct io_buffer *next,
+				    const char *file, unsigned int line ) {
+	size_t first_len = iob_len ( first );
+	size_t next_len = iob_len ( next );
+
+	okx ( tcpip_coalesce_segments ( first, next ) == NULL, file, line );
+	okx ( iob_len ( first ) == first_len, file, line );
+	okx ( iob_len ( next ) == next_len, file, line );
+	free_iob ( first );
+	free_iob ( next );
+}
+#define tcpip_no_coalesce_ok( first, next ) \
+	tcpip_no_coalesce_okx ( first, next, __FILE__, __LINE__ )
+
+/**
+ * Perform receive coalescing self-tests
+ *
+ */
+static void tcpip_coalesce_test_exec ( void ) {
+	struct profiler profiler;
+	struct io_buffer *first;
+	struct io_buffer *next;
+	struct io_buffer *merged;
+	struct io_buffer *bad;
+	struct tcp_header *tcphdr;
+	unsigned int count;
+	uint32_t seq;
+
+	/* Consecutive segments are coalesced */
+	first = tcpip_segment ( 1000, TCP_ACK, 100, 0 );
+	next = tcpip_segment ( 1100, ( TCP_ACK | TCP_PSH ), 200, 0 );
+	merged = tcpip_coalesce_segments ( first, next );
+	ok ( merged != NULL );
+	ok ( tcpip_segment_ok ( merged, 1000, 300 ) );
+	ok ( merged->flags & IOB_FL_CSUM_OK );
+	free_iob ( merged );
+
+	/* Consecutive segments are coalesced in place, if possible */
+	first = tcpip_segment ( 2000, TCP_ACK, 100, 200 );
+	next = tcpip_segment ( 2100, TCP_ACK, 200, 0 );
+	merged = tcpip_coalesce_segments ( first, next );
+	ok ( merged == first );
+	ok ( tcpip_segment_ok ( merged, 2000, 300 ) );
+	free_iob ( merged );
+
+	/* Full-sized segments are coalesced up to the length limit */
+	memset ( &profiler, 0, sizeof ( profiler ) );
+	seq = 0x7fffff00UL;
+	merged = tcpip_segment ( seq, TCP_ACK, TCPIP_COALESCE_MSS, 0 );
+	for ( count = 1 ; ; count++ ) {
+		next = tcpip_segment ( ( seq + ( count * TCPIP_COALESCE_MSS ) ),
+				       TCP_ACK, TCPIP_COALESCE_MSS, 0 );
+		profile_start ( &profiler );
+		first = tcpip_coalesce_segments ( merged, next );
+		profile_stop ( &profiler );
+		if ( ! first )
+			break;
+		merged = first;
+	}
+	ok ( count == ( ( IPV4_COALESCE_MAX_LEN - sizeof ( struct iphdr ) -
+			  sizeof ( struct tcp_header ) ) /
+			TCPIP_COALESCE_MSS ) );
+	ok ( tcpip_segment_ok ( merged, seq,
+				( count * TCPIP_COALESCE_MSS ) ) );
+	free_iob ( merged );
+	free_iob ( next );
+	DBG ( "TCPIP coalesced %d segments in %ld +/- %ld ticks each\n",
+	      count, profile_mean ( &profiler ), profile_stddev ( &profiler ) );
+
+	/* Non-consecutive segments are not coalesced */
+	tcpip_no_coalesce_ok ( tcpip_segment ( 3000, TCP_ACK, 100, 200 ),
+			       tcpip_segment ( 3101, TCP_ACK, 100, 0 ) );
+	tcpip_no_coalesce_ok ( tcpip_segment ( 3000, TCP_ACK, 100, 200 ),
+			       tcpip_segment ( 3000, TCP_ACK, 100, 0 ) );
+
+	/* Control segments are not coalesced */
+	tcpip_no_coalesce_ok ( tcpip_segment ( 4000, TCP_ACK, 100, 200 ),
+			       tcpip_segment ( 4100, ( TCP_ACK | TCP_FIN ),
+					       100, 0 ) );
+	tcpip_no_coalesce_ok ( tcpip_segment ( 4000, TCP_ACK, 100, 200 ),
+			       tcpip_segment ( 4100, ( TCP_ACK | TCP_RST ),
+					       100, 0 ) );
+
+	/* Segments without payload are not coalesced */
+	tcpip_no_coalesce_ok ( tcpip_segment ( 5000, TCP_ACK, 100, 200 ),
+			       tcpip_segment ( 5100, TCP_ACK, 0, 0 ) );
+
+	/* Segments with differing headers are not coalesced */
+	next = tcpip_segment ( 6100, TCP_ACK, 100, 0 );
+	tcphdr = ( next->data + sizeof ( struct iphdr ) );
+	tcphdr->win = htons ( 0x1000 );
+	tcpip_no_coalesce_ok ( tcpip_segment ( 6000, TCP_ACK, 100, 200 ),
+			       next );
+
+	/* Segments with incorrect checksums are not coalesced... */
+	bad = tcpip_segment ( 7100, TCP_ACK, 100, 0 );
+	tcphdr = ( bad->data + sizeof ( struct iphdr ) );
+	tcphdr->csum ^= htons ( 0x0001 );
+	tcpip_no_coalesce_ok ( tcpip_segment ( 7000, TCP_ACK, 100, 200 ),
+			       bad );
+
+	/* ... unless already verified by hardware */
+	bad = tcpip_segment ( 7100, TCP_ACK, 100, 0 );
+	tcphdr = ( bad->data + sizeof ( struct iphdr ) );
+	tcphdr->csum ^= htons ( 0x0001 );
+	bad->flags = IOB_FL_CSUM_OK;
+	first = tcpip_segment ( 7000, TCP_ACK, 100, 200 );
+	merged = tcpip_coalesce_segments ( first, bad );
+	ok ( merged != NULL );
+	ok ( tcpip_segment_ok ( merged, 7000, 200 ) );
+	free_iob ( merged );
+}
+
 /**
  * Perform TCP/IP self-tests
  *
@@ -249,8 +634,15 @@ static void tcpip_test_exec ( void ) {
 	tcpip_random_ok ( &random_aligned );
 	tcpip_random_ok ( &random_unaligned_1 );
 	tcpip_random_ok ( &random_unaligned_2 );
+	tcpip_random_ok ( &random_unaligned_3 );
+	tcpip_random_ok ( &random_unaligned_7 );
 	tcpip_random_ok ( &random_aligned_truncated );
 	tcpip_random_ok ( &partial );
+	tcpip_random_ok ( &short_unaligned );
+	tcpip_random_ok ( &ethernet );
+	tcpip_rx_ok ( &tcp_bad_csum );
+	tcpip_rx_ok ( &udp_bad_csum );
+	tcpip_coalesce_test_exec();
 }
 
 /** TCP/IP self-test */
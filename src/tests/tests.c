@@ -81,3 +81,7 @@ REQUIRE_OBJECT ( hmac_test );
 REQUIRE_OBJECT ( dhe_test );
 REQUIRE_OBJECT ( gcm_test );
 REQUIRE_OBJECT ( nap_test );
+REQUIRE_OBJECT ( xferbuf_test );
+REQUIRE_OBJECT ( malloc_test );
+REQUIRE_OBJECT ( retry_test );
+REQUIRE_OBJECT ( tftp_test );
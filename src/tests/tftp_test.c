@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2026 Michael Brown <mbrown@fensystems.co.uk>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * TFTP self-tests
+ *
+ */
+
+/* Forcibly enable assertions */
+#undef NDEBUG
+
+#include <stdint.h>
+#include <string.h>
+#include <ipxe/bitmap.h>
+#include <ipxe/tftp.h>
+#include <ipxe/test.h>
+
+/** Number of blocks in simulated windowed transfer (spans a rollover) */
+#define TFTP_SIM_BLOCKS 70000
+
+/** Window size for simulated windowed transfer */
+#define TFTP_SIM_WINDOWSIZE 16
+
+/** A simulated windowed transfer */
+struct tftp_sim_test {
+	/** Window size */
+	unsigned int windowsize;
+	/** Block loss interval (or zero for no loss) */
+	unsigned int loss;
+	/** Lost acknowledgement interval, in windows (or zero) */
+	unsigned int ack_loss;
+	/** Stale block interval, in windows (or zero) */
+	unsigned int stale;
+};
+
+/**
+ * Report block index calculation result
+ *
+ * @v expected		Index of first block not yet received
+ * @v windowsize	Window size
+ * @v number		Block number within DATA packet
+ * @v ok		Expected result
+ * @v block		Expected block index
+ * @v file		Test code file
+ * @v line		Test code line
+ */
+static void tftp_block_okx ( unsigned int expected, unsigned int windowsize,
+			     unsigned int number, int ok, unsigned int block,
+			     const char *file, unsigned int line ) {
+	unsigned int actual = -1U;
+
+	okx ( tftp_block ( expected, windowsize, number, &actual ) == ok,
+	      file, line );
+	if ( ok )
+		okx ( actual == block, file, line );
+}
+#define tftp_block_ok( expected, windowsize, number, block )		\
+	tftp_block_okx ( expected, windowsize, number, 1, block,	\
+			 __FILE__, __LINE__ )
+#define tftp_block_nok( expected, windowsize, number )			\
+	tftp_block_okx ( expected, windowsize, number, 0, 0,		\
+			 __FILE__, __LINE__ )
+
+/**
+ * Receive simulated DATA packet
+ *
+ * @v bitmap		Block bitmap
+ * @v windowsize	Window size
+ * @v index		Block index sent by server
+ * @ret ok		Block index was reconstructed correctly
+ */
+static int tftp_sim_rx ( struct bitmap *bitmap, unsigned int windowsize,
+			 unsigned int index ) {
+	unsigned int block;
+
+	if ( ! tftp_block ( bitmap_first_gap ( bitmap ), windowsize,
+			    ( ( index + 1 ) & 0xffff ), &block ) )
+		return 0;
+	if ( block != index )
+		return 0;
+	bitmap_set ( bitmap, block );
+	return 1;
+}
+
+/**
+ * Report simulated windowed transfer result
+ *
+ * @v test		Simulated transfer test
+ * @v file		Test code file
+ * @v line		Test code line
+ */
+static void tftp_sim_okx ( struct tftp_sim_test *test, const char *file,
+			   unsigned int line ) {
+	struct bitmap bitmap;
+	unsigned int windowsize = test->windowsize;
+	unsigned int windows = 0;
+	unsigned int dropped = -1U;
+	unsigned int base;
+	unsigned int index;
+	unsigned int block;
+	unsigned int stale;
+	unsigned int failures = 0;
+
+	memset ( &bitmap, 0, sizeof ( bitmap ) );
+	okx ( bitmap_resize ( &bitmap, TFTP_SIM_BLOCKS ) == 0, file, line );
+
+	while ( ! bitmap_full ( &bitmap ) ) {
+
+		/* Server sends window starting at acknowledged block */
+		base = bitmap_first_gap ( &bitmap );
+		windows++;
+
+		/* Simulate a lost acknowledgement by resending the
+		 * preceding window before the current window.
+		 */
+		if ( test->ack_loss && ( ( windows % test->ack_loss ) == 0 ) &&
+		     ( base >= windowsize ) ) {
+			for ( index = ( base - windowsize ) ; index < base ;
+			      index++ ) {
+				if ( ! tftp_sim_rx ( &bitmap, windowsize,
+						     index ) )
+					failures++;
+			}
+		}
+
+		/* Simulate a delayed block from well before the window,
+		 * which must be ignored.
+		 */
+		if ( test->stale && ( ( windows % test->stale ) == 0 ) &&
+		     ( base > ( 2 * windowsize ) ) ) {
+			stale = ( base - ( 2 * windowsize ) - 1 );
+			if ( tftp_block ( base, windowsize,
+					  ( ( stale + 1 ) & 0xffff ), &block ) )
+				failures++;
+		}
+
+		/* Send window, losing each selected block once */
+		for ( index = base ; ( ( index < ( base + windowsize ) ) &&
+				       ( index < TFTP_SIM_BLOCKS ) ) ;
+		      index++ ) {
+			if ( test->loss && ( ( index % test->loss ) == 5 ) &&
+			     ( index != dropped ) ) {
+				dropped = index;
+				continue;
+			}
+			if ( ! tftp_sim_rx ( &bitmap, windowsize, index ) ) {
+				failures++;
+				goto done;
+			}
+		}
+	}
+
+ done:
+	okx ( failures == 0, file, line );
+	okx ( bitmap_first_gap ( &bitmap ) == TFTP_SIM_BLOCKS, file, line );
+	bitmap_free ( &bitmap );
+}
+#define tftp_sim_ok( test ) tftp_sim_okx ( test, __FILE__, __LINE__ )
+
+/** Lock-step transfer */
+static struct tftp_sim_test lockstep = {
+	.windowsize = 1,
+	.ack_loss = 97,
+};
+
+/** Windowed transfer without loss */
+static struct tftp_sim_test windowed = {
+	.windowsize = TFTP_SIM_WINDOWSIZE,
+};
+
+/** Windowed transfer with block loss, lost ACKs, and stale blocks */
+static struct tftp_sim_test lossy = {
+	.windowsize = TFTP_SIM_WINDOWSIZE,
+	.loss = 997,
+	.ack_loss = 53,
+	.stale = 31,
+};
+
+/** Windowed transfer with a large window */
+static struct tftp_sim_test wide = {
+	.windowsize = 512,
+	.loss = 4093,
+	.ack_loss = 7,
+};
+
+/**
+ * Perform TFTP self-tests
+ *
+ */
+static void tftp_test_exec ( void ) {
+
+	/* Start of transfer */
+	tftp_block_ok ( 0, 16, 1, 0 );
+	tftp_block_ok ( 0, 16, 16, 15 );
+	tftp_block_nok ( 0, 16, 17 );
+	tftp_block_nok ( 0, 16, 0 );
+	tftp_block_nok ( 0, 16, 65535 );
+
+	/* Lock-step transfer */
+	tftp_block_ok ( 10, 1, 11, 10 );
+	tftp_block_ok ( 10, 1, 10, 9 );
+	tftp_block_nok ( 10, 1, 12 );
+	tftp_block_nok ( 10, 1, 9 );
+
+	/* Duplicates from preceding window */
+	tftp_block_ok ( 32, 16, 17, 16 );
+	tftp_block_ok ( 32, 16, 32, 31 );
+	tftp_block_nok ( 32, 16, 16 );
+
+	/* Rollover */
+	tftp_block_ok ( 65534, 16, 65535, 65534 );
+	tftp_block_ok ( 65534, 16, 0, 65535 );
+	tftp_block_ok ( 65534, 16, 1, 65536 );
+	tftp_block_ok ( 65534, 16, 14, 65549 );
+	tftp_block_nok ( 65534, 16, 15 );
+	tftp_block_ok ( 65540, 16, 65530, 65529 );
+	tftp_block_nok ( 65540, 16, 65520 );
+	tftp_block_ok ( 131070, 16, 65535, 131070 );
+	tftp_block_ok ( 131070, 16, 3, 131074 );
+
+	/* Simulated transfers */
+	tftp_sim_ok ( &lockstep );
+	tftp_sim_ok ( &windowed );
+	tftp_sim_ok ( &lossy );
+	tftp_sim_ok ( &wide );
+}
+
+/** TFTP self-test */
+struct self_test tftp_test __self_test = {
+	.name = "tftp",
+	.exec = tftp_test_exec,
+};
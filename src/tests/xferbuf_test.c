@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2026 Michael Brown <mbrown@fensystems.co.uk>.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * Data transfer buffer self-tests
+ *
+ */
+
+/* Forcibly enable assertions */
+#undef NDEBUG
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <ipxe/iobuf.h>
+#include <ipxe/xfer.h>
+#include <ipxe/xferbuf.h>
+#include <ipxe/test.h>
+
+/**
+ * Report data transfer buffer delivery test result
+ *
+ * @v xferbuf		Data transfer buffer
+ * @v offset		Offset, or -1 to deliver at current position
+ * @v len		Length of data to deliver
+ * @v file		Test code file
+ * @v line		Test code line
+ */
+static void xferbuf_deliver_okx ( struct xfer_buffer *xferbuf, off_t offset,
+				  size_t len, const char *file,
+				  unsigned int line ) {
+	struct xfer_metadata meta;
+	struct io_buffer *iobuf;
+	size_t pos;
+	uint8_t *data;
+	unsigned int i;
+
+	/* Construct I/O buffer containing a recognisable pattern */
+	iobuf = alloc_iob ( len );
+	okx ( iobuf != NULL, file, line );
+	if ( ! iobuf )
+		return;
+	pos = ( ( offset < 0 ) ? xferbuf->pos : ( ( size_t ) offset ) );
+	data = iob_put ( iobuf, len );
+	for ( i = 0 ; i < len ; i++ )
+		data[i] = ( pos + i );
+
+	/* Deliver data */
+	memset ( &meta, 0, sizeof ( meta ) );
+	if ( offset >= 0 ) {
+		meta.flags = XFER_FL_ABS_OFFSET;
+		meta.offset = offset;
+	}
+	okx ( xferbuf_deliver ( xferbuf, iobuf, &meta ) == 0, file, line );
+	okx ( xferbuf->len >= ( pos + len ), file, line );
+	okx ( xferbuf->size >= xferbuf->len, file, line );
+}
+#define xferbuf_deliver_ok( xferbuf, offset, len ) \
+	xferbuf_deliver_okx ( xferbuf, offset, len, __FILE__, __LINE__ )
+
+/**
+ * Report data transfer buffer contents test result
+ *
+ * @v xferbuf		Data transfer buffer
+ * @v len		Expected length
+ * @v file		Test code file
+ * @v line		Test code line
+ */
+static void xferbuf_contents_okx ( struct xfer_buffer *xferbuf, size_t len,
+				   const char *file, unsigned int line ) {
+	uint8_t *data = xferbuf->data;
+	unsigned int i;
+
+	okx ( xferbuf->len == len, file, line );
+	for ( i = 0 ; i < len ; i++ )
+		okx ( data[i] == ( ( uint8_t ) i ), file, line );
+}
+#define xferbuf_contents_ok( xferbuf, len ) \
+	xferbuf_contents_okx ( xferbuf, len, __FILE__, __LINE__ )
+
+/**
+ * Perform data transfer buffer self-test
+ *
+ */
+static void xferbuf_test_exec ( void ) {
+	struct xfer_buffer xferbuf;
+	unsigned int i;
+
+	/* Incremental delivery of unknown length */
+	memset ( &xferbuf, 0, sizeof ( xferbuf ) );
+	xferbuf_malloc_init ( &xferbuf );
+	for ( i = 0 ; i < 64 ; i++ )
+		xferbuf_deliver_ok ( &xferbuf, -1, 100 );
+	xferbuf_contents_ok ( &xferbuf, 6400 );
+	ok ( xferbuf.size > xferbuf.len );
+	ok ( xferbuf_shrink ( &xferbuf ) == 0 );
+	ok ( xferbuf.size == xferbuf.len );
+	xferbuf_contents_ok ( &xferbuf, 6400 );
+	xferbuf_free ( &xferbuf );
+	ok ( xferbuf.len == 0 );
+	ok ( xferbuf.size == 0 );
+
+	/* Presized delivery (as used by xfer_seek()) */
+	memset ( &xferbuf, 0, sizeof ( xferbuf ) );
+	xferbuf_malloc_init ( &xferbuf );
+	xferbuf_deliver_ok ( &xferbuf, 5000, 0 );
+	ok ( xferbuf.size == 5000 );
+	xferbuf_deliver_ok ( &xferbuf, 0, 0 );
+	for ( i = 0 ; i < 50 ; i++ )
+		xferbuf_deliver_ok ( &xferbuf, -1, 100 );
+	ok ( xferbuf.size == 5000 );
+	xferbuf_contents_ok ( &xferbuf, 5000 );
+	ok ( xferbuf_shrink ( &xferbuf ) == 0 );
+	ok ( xferbuf.size == 5000 );
+	xferbuf_free ( &xferbuf );
+
+	/* Out-of-order delivery */
+	memset ( &xferbuf, 0, sizeof ( xferbuf ) );
+	xferbuf_malloc_init ( &xferbuf );
+	xferbuf_deliver_ok ( &xferbuf, 3000, 1000 );
+	xferbuf_deliver_ok ( &xferbuf, 1000, 2000 );
+	xferbuf_deliver_ok ( &xferbuf, 0, 1000 );
+	xferbuf_contents_ok ( &xferbuf, 4000 );
+	xferbuf_free ( &xferbuf );
+}
+
+/** Data transfer buffer self-test */
+struct self_test xferbuf_test __self_test = {
+	.name = "xferbuf",
+	.exec = xferbuf_test_exec,
+};
@@ -72,6 +72,13 @@ static int ( * is_autoboot_device ) ( struct net_device *netdev );
 #define EINFO_ENOENT_BOOT \
 	__einfo_uniqify ( EINFO_ENOENT, 0x01, "Nothing to boot" )
 
+/** Configure all network devices concurrently during autoboot */
+#ifdef AUTOBOOT_PARALLEL
+#define AUTOBOOT_PARALLEL_DHCP 1
+#else
+#define AUTOBOOT_PARALLEL_DHCP 0
+#endif
+
 #define NORMAL	"\033[0m"
 #define BOLD	"\033[1m"
 #define CYAN	"\033[36m"
@@ -381,28 +388,18 @@ static int have_pxe_menu ( void ) {
 }
 
 /**
- * Boot from a network device
+ * Boot from a configured network device
  *
  * @v netdev		Network device
  * @ret rc		Return status code
  */
-int netboot ( struct net_device *netdev ) {
+static int netboot_configured ( struct net_device *netdev ) {
 	struct uri *filename;
 	struct uri *root_path;
 	char *san_filename;
 	int rc;
 
-	/* Close all other network devices */
-	close_other_netdevs ( netdev );
-
-	/* Open device and display device status */
-	if ( ( rc = ifopen ( netdev ) ) != 0 )
-		goto err_ifopen;
-	ifstat ( netdev );
-
-	/* Configure device */
-	if ( ( rc = ifconf ( netdev, NULL, 0 ) ) != 0 )
-		goto err_dhcp;
+	/* Display routing table */
 	route();
 
 	/* Try PXE menu boot, if applicable */
@@ -452,11 +449,72 @@ int netboot ( struct net_device *netdev ) {
 	uri_put ( root_path );
 	uri_put ( filename );
  err_pxe_menu_boot:
- err_dhcp:
- err_ifopen:
 	return rc;
 }
 
+/**
+ * Boot from a network device
+ *
+ * @v netdev		Network device
+ * @ret rc		Return status code
+ */
+int netboot ( struct net_device *netdev ) {
+	int rc;
+
+	/* Close all other network devices */
+	close_other_netdevs ( netdev );
+
+	/* Open device and display device status */
+	if ( ( rc = ifopen ( netdev ) ) != 0 )
+		return rc;
+	ifstat ( netdev );
+
+	/* Configure device */
+	if ( ( rc = ifconf ( netdev, NULL, 0 ) ) != 0 )
+		return rc;
+
+	/* Boot from device */
+	return netboot_configured ( netdev );
+}
+
+/**
+ * Boot from whichever network device is configured first
+ *
+ * @ret netdev		Network device attempted, or NULL
+ * @ret rc		Return status code
+ *
+ * All candidate network devices are opened and configured
+ * concurrently, so that a device without a DHCP server does not
+ * delay booting from a device with one.
+ */
+static int netboot_any ( struct net_device **netdev ) {
+	struct net_device *candidate;
+	int rc;
+
+	/* Open all candidate devices, and close all other devices */
+	*netdev = NULL;
+	for_each_netdev ( candidate ) {
+		if ( is_autoboot_device &&
+		     ( ! is_autoboot_device ( candidate ) ) ) {
+			ifclose ( candidate );
+			continue;
+		}
+		if ( ifopen ( candidate ) == 0 )
+			ifstat ( candidate );
+	}
+
+	/* Configure all candidate devices concurrently */
+	if ( ( rc = ifconf_any ( netdev, 0 ) ) != 0 )
+		return rc;
+	printf ( "Booting from %s\n", ( *netdev )->name );
+
+	/* Close all other network devices */
+	close_other_netdevs ( *netdev );
+
+	/* Boot from device */
+	return netboot_configured ( *netdev );
+}
+
 /**
  * Test if network device matches the autoboot device bus type and location
  *
@@ -529,9 +587,21 @@ void set_autoboot_ll_addr ( const void *ll_addr, size_t len,
  * Boot the system
  */
 static int autoboot ( void ) {
+	struct net_device *attempted = NULL;
 	struct net_device *netdev;
 	int rc = -ENODEV;
 
+	/* Try booting from whichever device is configured first, if
+	 * applicable.  Give up if no device could be configured;
+	 * otherwise, if booting fails, fall back to trying each
+	 * remaining device in turn.
+	 */
+	if ( AUTOBOOT_PARALLEL_DHCP ) {
+		rc = netboot_any ( &attempted );
+		if ( ! attempted )
+			goto done;
+	}
+
 	/* Try booting from each network device.  If we have a
 	 * specified autoboot device location, then use only devices
 	 * matching that location.
@@ -542,10 +612,15 @@ static int autoboot ( void ) {
 		if ( is_autoboot_device && ( ! is_autoboot_device ( netdev ) ) )
 			continue;
 
+		/* Skip any device already attempted */
+		if ( netdev == attempted )
+			continue;
+
 		/* Attempt booting from this device */
 		rc = netboot ( netdev );
 	}
 
+ done:
 	printf ( "No more network devices\n" );
 	return rc;
 }
@@ -122,6 +122,10 @@ void ifstat ( struct net_device *netdev ) {
 		printf ( "  [Link status: %s]\n",
 			 strerror ( netdev->link_rc ) );
 	}
+	if ( netdev->rx_pool.hits || netdev->rx_pool.misses ) {
+		printf ( "  [RX pool hits:%lu misses:%lu]\n",
+			 netdev->rx_pool.hits, netdev->rx_pool.misses );
+	}
 	ifstat_errors ( &netdev->tx_stats, "TXE" );
 	ifstat_errors ( &netdev->rx_stats, "RXE" );
 }
@@ -166,6 +170,11 @@ static struct interface_operation ifpoller_job_op[] = {
 static struct interface_descriptor ifpoller_job_desc =
 	INTF_DESC ( struct ifpoller, job, ifpoller_job_op );
 
+/** Network device poller */
+static struct ifpoller ifpoller = {
+	.job = INTF_INIT ( ifpoller_job_desc ),
+};
+
 /**
  * Poll network device until completion
  *
@@ -179,9 +188,6 @@ static int ifpoller_wait ( struct net_device *netdev,
 			   struct net_device_configurator *configurator,
 			   unsigned long timeout,
 			   int ( * progress ) ( struct ifpoller *ifpoller ) ) {
-	static struct ifpoller ifpoller = {
-		.job = INTF_INIT ( ifpoller_job_desc ),
-	};
 
 	ifpoller.netdev = netdev;
 	ifpoller.configurator = configurator;
@@ -304,3 +310,75 @@ int ifconf ( struct net_device *netdev,
 		 netdev->name, netdev->ll_protocol->ntoa ( netdev->ll_addr ) );
 	return ifpoller_wait ( netdev, configurator, timeout, ifconf_progress );
 }
+
+/**
+ * Check concurrent configuration progress
+ *
+ * @v ifpoller		Network device poller
+ * @ret ongoing_rc	Ongoing job status code (if known)
+ */
+static int ifconf_any_progress ( struct ifpoller *ifpoller ) {
+	struct net_device *netdev;
+	int in_progress = 0;
+
+	/* Terminate successfully as soon as any device is configured */
+	for_each_netdev ( netdev ) {
+		if ( ! netdev_is_open ( netdev ) )
+			continue;
+		if ( netdev_configuration_in_progress ( netdev ) ) {
+			in_progress = 1;
+		} else if ( netdev_configuration_ok ( netdev ) ) {
+			ifpoller->netdev = netdev;
+			intf_close ( &ifpoller->job, 0 );
+			return 0;
+		}
+	}
+
+	/* Terminate with failure once all configurations have failed */
+	if ( ! in_progress )
+		intf_close ( &ifpoller->job, -EADDRNOTAVAIL_CONFIG );
+
+	return 0;
+}
+
+/**
+ * Perform concurrent configuration of all open network devices
+ *
+ * @v netdev		Network device to fill in
+ * @v timeout		Timeout period, in ticks
+ * @ret rc		Return status code
+ *
+ * Configuration is started on every open network device at once,
+ * and completes as soon as any one device has been successfully
+ * configured.  Configuration of the remaining devices continues in
+ * the background until they are closed.
+ */
+int ifconf_any ( struct net_device **netdev, unsigned long timeout ) {
+	struct net_device *candidate;
+	unsigned int count = 0;
+	int rc;
+
+	/* Start configuration on all open devices */
+	for_each_netdev ( candidate ) {
+		if ( ! netdev_is_open ( candidate ) )
+			continue;
+		if ( ( rc = netdev_configure_all ( candidate ) ) != 0 ) {
+			printf ( "Could not configure %s: %s\n",
+				 candidate->name, strerror ( rc ) );
+			continue;
+		}
+		count++;
+	}
+	if ( ! count )
+		return -EADDRNOTAVAIL_CONFIG;
+
+	/* Wait for any configuration to complete */
+	printf ( "Configuring %d network device%s", count,
+		 ( ( count == 1 ) ? "" : "s" ) );
+	if ( ( rc = ifpoller_wait ( NULL, NULL, timeout,
+				    ifconf_any_progress ) ) != 0 )
+		return rc;
+
+	*netdev = ifpoller.netdev;
+	return 0;
+}
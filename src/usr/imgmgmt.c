@@ -26,7 +26,13 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
+#include <assert.h>
+#include <ipxe/refcnt.h>
+#include <ipxe/list.h>
+#include <ipxe/interface.h>
+#include <ipxe/job.h>
 #include <ipxe/image.h>
 #include <ipxe/downloader.h>
 #include <ipxe/monojob.h>
@@ -40,6 +46,47 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  *
  */
 
+/** A background image download */
+struct imgdownload_background {
+	/** Reference count */
+	struct refcnt refcnt;
+	/** List of background downloads */
+	struct list_head list;
+	/** Job control interface */
+	struct interface job;
+	/** Image */
+	struct image *image;
+	/** Redacted URI string */
+	char *uri_string;
+	/** Downloaded length */
+	size_t len;
+	/** Final status code, or -EINPROGRESS */
+	int rc;
+};
+
+/** List of background downloads */
+static LIST_HEAD ( imgdownload_backgrounds );
+
+/** Aggregate background download job control interface */
+static struct interface imgwait_job;
+
+/**
+ * Construct redacted URI string
+ *
+ * @v uri		URI
+ * @ret uri_string	Redacted URI string, or NULL on failure
+ */
+static char * imgdownload_redact ( struct uri *uri ) {
+	struct uri uri_redacted;
+
+	memcpy ( &uri_redacted, uri, sizeof ( uri_redacted ) );
+	uri_redacted.user = NULL;
+	uri_redacted.password = NULL;
+	uri_redacted.equery = NULL;
+	uri_redacted.efragment = NULL;
+	return format_uri_alloc ( &uri_redacted );
+}
+
 /**
  * Download a new image
  *
@@ -50,17 +97,11 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  */
 int imgdownload ( struct uri *uri, unsigned long timeout,
 		  struct image **image ) {
-	struct uri uri_redacted;
 	char *uri_string_redacted;
 	int rc;
 
 	/* Construct redacted URI */
-	memcpy ( &uri_redacted, uri, sizeof ( uri_redacted ) );
-	uri_redacted.user = NULL;
-	uri_redacted.password = NULL;
-	uri_redacted.equery = NULL;
-	uri_redacted.efragment = NULL;
-	uri_string_redacted = format_uri_alloc ( &uri_redacted );
+	uri_string_redacted = imgdownload_redact ( uri );
 	if ( ! uri_string_redacted ) {
 		rc = -ENOMEM;
 		goto err_uri_string;
@@ -130,6 +171,283 @@ int imgdownload_string ( const char *uri_string, unsigned long timeout,
 	return rc;
 }
 
+/**
+ * Free background download
+ *
+ * @v refcnt		Reference count
+ */
+static void imgdownload_background_free ( struct refcnt *refcnt ) {
+	struct imgdownload_background *bg =
+		container_of ( refcnt, struct imgdownload_background, refcnt );
+
+	image_put ( bg->image );
+	free ( bg->uri_string );
+	free ( bg );
+}
+
+/**
+ * Count background downloads still in progress
+ *
+ * @ret count		Number of downloads in progress
+ */
+static unsigned int imgdownload_pending ( void ) {
+	struct imgdownload_background *bg;
+	unsigned int count = 0;
+
+	list_for_each_entry ( bg, &imgdownload_backgrounds, list ) {
+		if ( bg->rc == -EINPROGRESS )
+			count++;
+	}
+	return count;
+}
+
+/**
+ * Handle background download completion
+ *
+ * @v bg		Background download
+ * @v rc		Reason for completion
+ */
+static void imgdownload_background_close ( struct imgdownload_background *bg,
+					   int rc ) {
+
+	/* Shut down job control interface */
+	intf_shutdown ( &bg->job, rc );
+
+	/* Do nothing more if already complete */
+	if ( bg->rc != -EINPROGRESS )
+		return;
+
+	/* Record completion.  The image is not registered until
+	 * imgwait() is called, so that images are always registered
+	 * in the order in which their downloads were started.
+	 */
+	bg->len = bg->image->len;
+	bg->rc = rc;
+
+	/* Complete aggregate job once all downloads have completed */
+	if ( ! imgdownload_pending() )
+		intf_close ( &imgwait_job, 0 );
+}
+
+/** Background download job control interface operations */
+static struct interface_operation imgdownload_background_job_op[] = {
+	INTF_OP ( intf_close, struct imgdownload_background *,
+		  imgdownload_background_close ),
+};
+
+/** Background download job control interface descriptor */
+static struct interface_descriptor imgdownload_background_job_desc =
+	INTF_DESC ( struct imgdownload_background, job,
+		    imgdownload_background_job_op );
+
+/**
+ * Start downloading a new image in the background
+ *
+ * @v uri		URI
+ * @v image		Image to fill in
+ * @ret rc		Return status code
+ *
+ * Use imgwait() to wait for all background downloads to complete
+ * and to register the downloaded images.
+ */
+int imgdownload_background ( struct uri *uri, struct image **image ) {
+	struct imgdownload_background *bg;
+	int rc;
+
+	/* Allocate and initialise structure */
+	bg = zalloc ( sizeof ( *bg ) );
+	if ( ! bg ) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+	ref_init ( &bg->refcnt, imgdownload_background_free );
+	intf_init ( &bg->job, &imgdownload_background_job_desc, &bg->refcnt );
+	bg->rc = -EINPROGRESS;
+
+	/* Construct redacted URI */
+	bg->uri_string = imgdownload_redact ( uri );
+	if ( ! bg->uri_string ) {
+		rc = -ENOMEM;
+		goto err_uri_string;
+	}
+
+	/* Resolve URI */
+	uri = resolve_uri ( cwuri, uri );
+	if ( ! uri ) {
+		rc = -ENOMEM;
+		goto err_resolve_uri;
+	}
+
+	/* Allocate image */
+	bg->image = alloc_image ( uri );
+	if ( ! bg->image ) {
+		rc = -ENOMEM;
+		goto err_alloc_image;
+	}
+
+	/* Create downloader */
+	if ( ( rc = create_downloader ( &bg->job, bg->image ) ) != 0 ) {
+		printf ( "Could not start download: %s\n", strerror ( rc ) );
+		goto err_create_downloader;
+	}
+
+	/* Add to list of background downloads (which holds the
+	 * initial reference, and hence a reference to the image).
+	 */
+	list_add_tail ( &bg->list, &imgdownload_backgrounds );
+	*image = bg->image;
+	uri_put ( uri );
+	return 0;
+
+ err_create_downloader:
+ err_alloc_image:
+	uri_put ( uri );
+ err_resolve_uri:
+ err_uri_string:
+	ref_put ( &bg->refcnt );
+ err_alloc:
+	return rc;
+}
+
+/**
+ * Start downloading a new image in the background
+ *
+ * @v uri_string	URI string
+ * @v timeout		Download timeout (unused)
+ * @v image		Image to fill in
+ * @ret rc		Return status code
+ *
+ * The download timeout is applied by imgwait().
+ */
+int imgdownload_background_string ( const char *uri_string,
+				    unsigned long timeout __unused,
+				    struct image **image ) {
+	struct uri *uri;
+	int rc;
+
+	if ( ! ( uri = parse_uri ( uri_string ) ) )
+		return -ENOMEM;
+
+	rc = imgdownload_background ( uri, image );
+
+	uri_put ( uri );
+	return rc;
+}
+
+/**
+ * Report aggregate background download progress
+ *
+ * @v intf		Aggregate job control interface
+ * @v progress		Progress data to fill in
+ * @ret ongoing_rc	Ongoing job status code (if known)
+ */
+static int imgwait_progress ( struct interface *intf __unused,
+			      struct job_progress *progress ) {
+	struct imgdownload_background *bg;
+	struct job_progress bg_progress;
+	unsigned int pending = 0;
+	int unknown = 0;
+
+	/* Sum progress over all downloads */
+	list_for_each_entry ( bg, &imgdownload_backgrounds, list ) {
+		if ( bg->rc == -EINPROGRESS ) {
+			job_progress ( &bg->job, &bg_progress );
+			progress->completed += bg_progress.completed;
+			progress->total += bg_progress.total;
+			if ( ! bg_progress.total )
+				unknown = 1;
+			pending++;
+		} else {
+			progress->completed += bg->len;
+			progress->total += bg->len;
+		}
+	}
+
+	/* Report total as unknown if any individual total is unknown */
+	if ( unknown )
+		progress->total = 0;
+	snprintf ( progress->message, sizeof ( progress->message ),
+		   "%d pending", pending );
+
+	return 0;
+}
+
+/**
+ * Handle aggregate background download job closure
+ *
+ * @v intf		Aggregate job control interface
+ * @v rc		Reason for close
+ */
+static void imgwait_close ( struct interface *intf, int rc ) {
+	struct imgdownload_background *bg;
+	struct imgdownload_background *tmp;
+
+	/* Shut down interface */
+	intf_restart ( intf, rc );
+
+	/* Cancel any downloads still in progress (e.g. on timeout) */
+	list_for_each_entry_safe ( bg, tmp, &imgdownload_backgrounds, list ) {
+		ref_get ( &bg->refcnt );
+		imgdownload_background_close ( bg, rc );
+		ref_put ( &bg->refcnt );
+	}
+}
+
+/** Aggregate background download job control interface operations */
+static struct interface_operation imgwait_job_op[] = {
+	INTF_OP ( job_progress, struct interface *, imgwait_progress ),
+	INTF_OP ( intf_close, struct interface *, imgwait_close ),
+};
+
+/** Aggregate background download job control interface descriptor */
+static struct interface_descriptor imgwait_job_desc =
+	INTF_DESC_PURE ( imgwait_job_op );
+
+/** Aggregate background download job control interface */
+static struct interface imgwait_job = INTF_INIT ( imgwait_job_desc );
+
+/**
+ * Wait for all background downloads to complete
+ *
+ * @v timeout		Download timeout
+ * @ret rc		Return status code
+ *
+ * Successfully downloaded images are registered in the order in
+ * which their downloads were started, regardless of the order in
+ * which the downloads completed.
+ */
+int imgwait ( unsigned long timeout ) {
+	struct imgdownload_background *bg;
+	struct imgdownload_background *tmp;
+	int rc = 0;
+
+	/* Wait for any downloads still in progress */
+	if ( imgdownload_pending() ) {
+		intf_plug_plug ( &imgwait_job, &monojob );
+		rc = monojob_wait ( "Waiting for downloads", timeout );
+	}
+
+	/* Register or report completed downloads, in order */
+	list_for_each_entry_safe ( bg, tmp, &imgdownload_backgrounds, list ) {
+		assert ( bg->rc != -EINPROGRESS );
+		if ( bg->rc == 0 ) {
+			if ( ( bg->rc = register_image ( bg->image ) ) != 0 ) {
+				printf ( "Could not register image: %s\n",
+					 strerror ( bg->rc ) );
+			}
+		} else {
+			printf ( "Could not download %s: %s\n",
+				 bg->uri_string, strerror ( bg->rc ) );
+		}
+		if ( ( bg->rc != 0 ) && ( rc == 0 ) )
+			rc = bg->rc;
+		list_del ( &bg->list );
+		ref_put ( &bg->refcnt );
+	}
+
+	return rc;
+}
+
 /**
  * Acquire an image
  *